@@ -5,6 +5,8 @@
 
 #include <memory>
 #include <concepts>
+#include <algorithm>
+#include <utility>
 
 namespace patch
 {
@@ -40,11 +42,32 @@ public:
     }   
     ~CircularArray() {}
 
+    // A piece of the underlying storage, used to hand blocks of samples to
+    // vectorised code without going through the index wrapping.
+    struct ConstRange
+    {
+        const type* data;
+        size_t size;
+    };
+
     void push(type element)
     {
         mData[mIndex++] = element;
         mIndex %= mSize;
     }
+    void push(const type* elements, size_t count)
+    {
+        if (count >= mSize)
+        {
+            elements += count - mSize;
+            count = mSize;
+        }
+
+        const size_t firstPart = std::min(count, mSize - mIndex);
+        std::copy(elements, elements + firstPart, mData.get() + mIndex);
+        std::copy(elements + firstPart, elements + count, mData.get());
+        mIndex = (mIndex + count) % mSize;
+    }
     type pushAndPop(type element)
     {
         type pop = mData[mIndex];
@@ -72,6 +95,16 @@ public:
     {
         return (*this)[(size_t) index];
     }
+    // Splits [index, index + count) into at most two contiguous ranges, in
+    // order. count is clamped to the size of the array.
+    std::pair<ConstRange, ConstRange> getRanges(size_t index, size_t count) const
+    {
+        count = std::min(count, mSize);
+        const size_t start = (mIndex + index) % mSize;
+        const size_t firstPart = std::min(count, mSize - start);
+        return { ConstRange{ mData.get() + start, firstPart },
+                 ConstRange{ mData.get(), count - firstPart } };
+    }
     const type* accesUnordered() const
     {
         return mData.get();
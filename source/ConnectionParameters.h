@@ -1,9 +1,7 @@
 #pragma once
-#include "juce_gui_basics/juce_gui_basics.h"
-#include <vector>
-#include <type_traits>
 #include <atomic>
-#include <functional>
+#include <cstdint>
+#include "MixKernels.h"
 
 namespace patch
 {
@@ -14,340 +12,115 @@ enum class OverdriveProtection
     clip
 };
 
-// PatchToggleButton
+// Bumped by every AtomicParameter::setValue. Editors compare it against the
+// value they saw last and only poll their attachments if it moved.
+inline std::atomic<uint64_t> parameterSequence = 0;
 
-class PatchToggleButton
-{
-public:
-    PatchToggleButton()
-    {
-        button.onClick = [this]()
-        {
-            for(auto& callback : callbacks)
-            {
-                callback();
-            }
-        };
-
-        addCallback([this]()
-        {
-            for(auto listener : listeners)
-            {
-                listener->toggleStateChanged(this);
-            }
-        });
-    }
-
-    ~PatchToggleButton()
-    {
-        button.onStateChange = nullptr;
-        removeAllListeners();
-    }
-
-    void addCallback(std::function<void()> callback)
-    {
-        callbacks.emplace_back(callback);
-    }
-
-    bool getState() { return button.getToggleState(); }
-
-    void setState(bool state, juce::NotificationType sendNotifications) 
-    { 
-        button.setToggleState(state, sendNotifications); 
-    }
-
-    // DO NOT MESS WITH onStateChange FROM OUTSIDE THIS CLASS
-    juce::ToggleButton button;
-
-    class Listener
-    {
-    public:
-        virtual void toggleStateChanged(PatchToggleButton* emitter) = 0;
-    };
-
-    void addListener(Listener* listenerToAdd)
-    {
-        const auto it = std::find(listeners.begin(), listeners.end(), listenerToAdd);
-        if(it != listeners.end()) return; // already added 
-        listeners.push_back(listenerToAdd);
-    }
-
-    void removeListener(Listener* listenerToRemove)
-    {
-        const auto it = std::find(listeners.begin(), listeners.end(), listenerToRemove);
-        if(it == listeners.end()) return; // listener not found
-        listeners.erase(it);
-    }
-
-private:
-    void removeAllListeners()
-    {
-        listeners.clear();
-    }
-
-    std::vector<Listener*> listeners;
-    std::vector<std::function<void()>> callbacks;
-};
-
-// ToggleParameter
+// AtomicParameter
+// The value alone, no UI is attached to it. Widgets are synced by the
+// attachments in ParameterAttachments.h, which poll.
 
-class ToggleParameter : public PatchToggleButton::Listener
+template<typename type>
+class AtomicParameter
 {
 public:
-    ToggleParameter()
-        : value(false)
-    {}
-
-    ToggleParameter(bool initVal)
-        : value(initVal)
-    {}
-
-    ~ToggleParameter()
-    {
-        detachAll();
-    }
-
-    void attachToggleButton(PatchToggleButton* buttonToAttach)
-    {
-        buttonToAttach->addListener(this);
-        buttons.push_back(buttonToAttach);
-        buttonToAttach->setState(value.load(std::memory_order_relaxed), juce::dontSendNotification);
-    }
-
-    void detachToggleButton(PatchToggleButton* buttonToDetach)
-    {
-        buttonToDetach->removeListener(this);
-        auto it = std::find(buttons.begin(), buttons.end(), buttonToDetach);
-        if (it == buttons.end())
-            return;
-        buttons.erase(it);
-    }
-
-    void toggleStateChanged(PatchToggleButton* emitter)
-    {
-        bool valueToSet = emitter->getState();
-        value.store(valueToSet);
-        for(auto button : buttons)
-        {
-            button->setState(valueToSet, juce::dontSendNotification);
-        }
-    }
-
-    bool getValue() const { return value.load(std::memory_order_relaxed); }
-
-    void setValue(bool val) 
-    {
-        value = val;
-        for(auto button : buttons)
-        {
-            button->setState(val, juce::dontSendNotification);
-        }
-    }
-
-private:
-    void detachAll()
-    {
-        buttons.clear();
-    }
-
-    std::vector<PatchToggleButton*> buttons;
-    std::atomic_bool value;
-};
-
-// SliderParameter
-
-template<typename type = float>
-    requires std::is_floating_point_v<type>
-class SliderParameter : public juce::Slider::Listener
-{
-public:
-    SliderParameter()
-        : value((type)0)
-    {}
-
-    SliderParameter(type init)
+    AtomicParameter(type init)
         : value(init)
     {}
 
-    ~SliderParameter() override
-    {
-        detachAll();
-    }
-
-    void attachSlider(juce::Slider* sliderToAttach)
-    {
-        sliderToAttach->addListener(this);
-        sliders.push_back(sliderToAttach);
-        sliderToAttach->setValue((double)value.load(std::memory_order_relaxed), juce::dontSendNotification);
-    }
-
-    void detachSlider(juce::Slider* sliderToDetach)
-    {
-        sliderToDetach->removeListener(this);
-        auto it = std::find(sliders.begin(), sliders.end(), sliderToDetach);
-        if (it == sliders.end())
-            return;
-        sliders.erase(it);
-    }
-
-    void sliderValueChanged(juce::Slider* emitter) override
-    {
-        type valueToSet = (type)emitter->getValue();
-        value.store(valueToSet);
-        for(auto slider : sliders)
-        {
-            slider->setValue((double)valueToSet, juce::dontSendNotification);
-        }
-    }
-
     type getValue() const { return value.load(std::memory_order_relaxed); }
 
     void setValue(type val)
     {
-        value.store(val);
-        for(auto slider : sliders)
-        {
-            slider->setValue((double)val, juce::dontSendNotification);
-        }
+        value.store(val, std::memory_order_relaxed);
+        parameterSequence.fetch_add(1, std::memory_order_release);
     }
 
 private:
-    void detachAll()
-    {
-        for(auto slider : sliders)
-        {
-            slider->removeListener(this);
-        }
-        sliders.clear();
-    }
-
-    std::vector<juce::Slider*> sliders;
     std::atomic<type> value;
 };
 
-// ComboBoxParameter
-
-template<typename Enum>
-    requires std::is_enum_v<Enum>
-class ComboBoxParameter : public juce::ComboBox::Listener
-{
-public:
-    ComboBoxParameter()
-        : value(Enum(0))
-    {}
+static_assert(std::atomic<float>::is_always_lock_free);
+static_assert(std::atomic<OverdriveProtection>::is_always_lock_free);
 
-    ComboBoxParameter(Enum init)
-        : value(init)
-    {}
+// ConnectionCost
+// What mixing a connection took since the statistics were reset, added to by
+// the thread mixing it and polled by the editor to tell which connection is
+// expensive.
 
-    ~ComboBoxParameter() override
-    {
-        detachAll();
-    }
-
-    void attachComboBoxParameter(juce::ComboBox* comboBoxToAttach)
-    {
-        comboBoxes.push_back(comboBoxToAttach);
-        comboBoxToAttach->addListener(this);
-        comboBoxToAttach->setSelectedId((int)value.load(std::memory_order_relaxed), juce::dontSendNotification);
-    }
-
-    void detachComboBox(juce::ComboBox* comboBoxToDetach)
-    {
-        comboBoxToDetach->removeListener(this);
-        auto it = std::find(comboBoxes.begin(), comboBoxes.end(), comboBoxToDetach);
-        if (it == comboBoxes.end())
-            return;
-        comboBoxes.erase(it);
-    }
-
-    void comboBoxChanged (juce::ComboBox *comboBoxThatHasChanged) override
-    {
-        Enum valueToSet = (Enum)comboBoxThatHasChanged->getSelectedId();
-        value.store(valueToSet);
-        for(auto comboBox : comboBoxes)
-        {
-            comboBox->setSelectedId((int)valueToSet);
-        }
-    }
-
-    Enum getValue() const { return value.load(std::memory_order_relaxed); }
+struct ConnectionCost
+{
+    std::atomic<uint64_t> ticks = 0;
+    std::atomic<uint64_t> samples = 0;
+    std::atomic<uint64_t> blocks = 0;
 
-    void setValue(Enum val)
+    void add(uint64_t elapsedTicks, size_t numberOfSamples)
     {
-        value.store(val);
-        for(auto comboBox : comboBoxes)
-        {
-            comboBox->setSelectedId((int)val, juce::dontSendNotification);
-        }
+        ticks.fetch_add(elapsedTicks, std::memory_order_relaxed);
+        samples.fetch_add(numberOfSamples, std::memory_order_relaxed);
+        blocks.fetch_add(1, std::memory_order_relaxed);
     }
 
-private:
-    void detachAll()
+    void clear()
     {
-        for(auto comboBox : comboBoxes)
-        {
-            comboBox->onChange = nullptr;
-        }
-        comboBoxes.clear();
+        ticks.store(0, std::memory_order_relaxed);
+        samples.store(0, std::memory_order_relaxed);
+        blocks.store(0, std::memory_order_relaxed);
     }
-
-    std::vector<juce::ComboBox*> comboBoxes;
-    std::atomic<Enum> value;
 };
 
-namespace id
-{
-    using id = const juce::Identifier;
-
-    id stateInfo = "State Information";
-    id connection = "Connection Information";
-    id uuid = "UUID";
-    id mode = "Mode";
-    id name = "Name";
-    
-    id on = "Parameter On";
-    id gain = "Parameter Gain";
-    id delay = "Parameter Delay";
-    id delayCorr = "Parameter Delay Correction";
-    id prot = "Parameter Overdrive Protection";
-}
-
 /*  ConnectionParameters
     This struct shoule be used to describe the conneciton between a Transmitter
     instance and a Reciever instance.
 */
 struct ConnectionParameters
 {
-    ToggleParameter on = false;
-    SliderParameter<float> gain = 0.f;
+    AtomicParameter<bool> on = false;
+    AtomicParameter<float> gain = 0.f;
+    // With clip, what the connection delivers never exceeds full scale. Core
+    // sets it on loops that would grow otherwise, see Core::setLoopProtection.
+    AtomicParameter<OverdriveProtection> protection = OverdriveProtection::off;
 
     // these are not implemented just yet
 
-    int delay = 0;
-    ToggleParameter delayCorrection = false;
-    ComboBoxParameter<OverdriveProtection> protection = OverdriveProtection::off;
+    AtomicParameter<int> delay = 0;
+    AtomicParameter<bool> delayCorrection = false;
 
-    juce::ValueTree serialize()
-    {
-        juce::ValueTree info(id::connection);
-        info.setProperty(id::on, on.getValue(), nullptr);
-        info.setProperty(id::gain, gain.getValue(), nullptr);
-        info.setProperty(id::delay, delay, nullptr);
-        info.setProperty(id::delayCorr, delayCorrection.getValue(), nullptr);
-        info.setProperty(id::prot, (int)protection.getValue(), nullptr);
+    // Written by Core in the mixing pass, not part of the state
+    LevelMeter level;
+    ConnectionCost cost;
 
-        return info;
-    }
+    // Bumped by ParameterStore::release, see ConnectionHandle.
+    std::atomic<uint32_t> generation = 0;
+};
+
+// ConnectionHandle
+// Editors hold on to ConnectionParameters until they see the next topology
+// version. The slot may have been released and handed to another connection
+// by then, the handle tells by the generation it was taken at.
 
-    void deserialize(juce::ValueTree info)
+class ConnectionHandle
+{
+public:
+    ConnectionHandle() = default;
+    ConnectionHandle(ConnectionParameters* connectionParameters)
+        : parameters(connectionParameters)
+        , generation(connectionParameters != nullptr
+                     ? connectionParameters->generation.load(std::memory_order_acquire) : 0)
+    {}
+
+    // nullptr if there was no connection or its slot was released since
+    ConnectionParameters* get() const { return isReleased() ? nullptr : parameters; }
+
+    bool isReleased() const
     {
-        on.setValue(info.getProperty(id::on));
-        gain.setValue(info.getProperty(id::gain));
-        delay = info.getProperty(id::delay);
-        delayCorrection.setValue(info.getProperty(id::delayCorr));
-        protection.setValue((OverdriveProtection)(int)info.getProperty(id::prot));
+        return parameters != nullptr
+            && parameters->generation.load(std::memory_order_acquire) != generation;
     }
+
+private:
+    ConnectionParameters* parameters = nullptr;
+    uint32_t generation = 0;
 };
 
 } // namespace patch
@@ -1,10 +1,242 @@
 #include "Core.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+
 using namespace patch;
 
+namespace
+{
+    // Mixes blocks of numberOfChannels channels, from firstChannel on in both
+    // buffers. Every connection gets the instantiation for its number of
+    // channels when the routes are built, see Core::getBlockMixer.
+    template<size_t numberOfChannels>
+    struct ChannelMixer
+    {
+        using Destinations = std::array<RoutingSample*, numberOfChannels>;
+        using Sources = std::array<const RoutingSample*, numberOfChannels>;
+
+        // the same piece of every channel
+        struct Ranges
+        {
+            Sources data;
+            size_t size;
+        };
+
+        // Mixes the ranges one after the other into destinations, see
+        // kernels::mixChannelsAndMeasure. The gain goes from startGain to
+        // endGain over numberOfSamples, backwards reads every range from its
+        // end.
+        template<bool measureDestination, bool clip>
+        static void mixRanges(Destinations destinations, std::initializer_list<Ranges> ranges,
+                              float startGain, float endGain, bool backwards, size_t numberOfSamples,
+                              LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+        {
+            const float increment = numberOfSamples > 0
+                ? (endGain - startGain) / (float)numberOfSamples
+                : 0.f;
+            float gain = startGain;
+
+            for (const Ranges& range : ranges)
+            {
+                if (range.size == 0) continue;
+
+                if (!backwards && startGain == endGain)
+                {
+                    kernels::mixChannelsAndMeasure<numberOfChannels, measureDestination,
+                                                   RoutingSample, clip>(
+                        destinations, range.data, gain, range.size, sourceLevel, destinationLevel);
+                }
+                else
+                {
+                    Sources sources = range.data;
+                    if (backwards)
+                        for (auto& source : sources)
+                            source += range.size - 1;
+
+                    kernels::mixChannelsAndMeasureRamp<numberOfChannels, measureDestination,
+                                                       RoutingSample, clip>(
+                        destinations, sources, backwards ? -1 : 1, gain, increment, range.size,
+                        sourceLevel, destinationLevel);
+                }
+
+                for (auto& destination : destinations)
+                    destination += range.size;
+                gain += increment * (float)range.size;
+            }
+        }
+
+            // count samples of a transit slot, from start on. The gain goes from
+        // startGain to endGain over rampLength samples, backwards reads them
+        // from the last one.
+        template<bool measureDestination, bool clip>
+        static void mixTransit(juce::AudioBuffer<RoutingSample>& destination,
+                               const juce::AudioBuffer<RoutingSample>& source, int firstChannel,
+                               int channels, size_t start, size_t count, float startGain,
+                               float endGain, bool backwards, size_t rampLength,
+                               LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+        {
+            jassert(channels == (int)numberOfChannels);
+            jassert(start + count <= (size_t)source.getNumSamples());
+            juce::ignoreUnused(channels);
+
+            Destinations destinations;
+            Ranges range{ {}, count };
+            for (size_t ch = 0; ch < numberOfChannels; ch++)
+            {
+                destinations[ch] = destination.getWritePointer(firstChannel + (int)ch);
+                range.data[ch] = source.getReadPointer(firstChannel + (int)ch) + start;
+            }
+
+            mixRanges<measureDestination, clip>(destinations, { range }, startGain, endGain,
+                                                backwards, rampLength, sourceLevel,
+                                                destinationLevel);
+        }
+    };
+
+    // Channel counts without their own instantiation, one channel at a time.
+    struct AnyChannelMixer
+    {
+        template<bool measureDestination, bool clip>
+        static void mixTransit(juce::AudioBuffer<RoutingSample>& destination,
+                               const juce::AudioBuffer<RoutingSample>& source, int firstChannel,
+                               int channels, size_t start, size_t count, float startGain,
+                               float endGain, bool backwards, size_t rampLength,
+                               LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+        {
+            for (int ch = firstChannel; ch < firstChannel + channels; ch++)
+                ChannelMixer<1>::mixTransit<measureDestination, clip>(destination, source, ch, 1,
+                                                                      start, count, startGain,
+                                                                      endGain, backwards,
+                                                                      rampLength, sourceLevel,
+                                                                      destinationLevel);
+        }
+    };
+}
+
+struct Core::BlockMixer
+{
+    using TransitFunction = void (*)(juce::AudioBuffer<RoutingSample>&,
+                                     const juce::AudioBuffer<RoutingSample>&, int, int, size_t,
+                                     size_t, float, float, bool, size_t, LevelAccumulator&,
+                                     LevelAccumulator&);
+
+    // indexed by whether the connection clips, see OverdriveProtection, and
+    // by whether the destination is measured as well
+    TransitFunction mixTransit[2][2];
+
+    template<class Mixer>
+    static constexpr BlockMixer of()
+    {
+        return { { { &Mixer::template mixTransit<false, false>, &Mixer::template mixTransit<true, false> },
+                   { &Mixer::template mixTransit<false, true>, &Mixer::template mixTransit<true, true> } } };
+    }
+};
+
+const Core::BlockMixer& Core::getBlockMixer(int numberOfChannels)
+{
+    // mono, stereo, 5.1 and 7.1 are unrolled, anything else is not
+    static constexpr BlockMixer any = BlockMixer::of<AnyChannelMixer>();
+    static constexpr std::array<BlockMixer, 9> mixers {
+        any,
+        BlockMixer::of<ChannelMixer<1>>(),
+        BlockMixer::of<ChannelMixer<2>>(),
+        any,
+        any,
+        any,
+        BlockMixer::of<ChannelMixer<6>>(),
+        any,
+        BlockMixer::of<ChannelMixer<8>>()
+    };
+
+    return numberOfChannels >= 0 && numberOfChannels < (int)mixers.size()
+        ? mixers[(size_t)numberOfChannels]
+        : any;
+}
+
+namespace
+{
+    // what a connection weighs in the loops it is on
+    float getLoopEdgeGain(const ConnectionParameters& params)
+    {
+        return params.on.getValue() ? std::abs(params.gain.getValue()) : 0.f;
+    }
+
+    // Only weak references, so a domain goes away with the last instance in
+    // it. Function-local, so it exists before the first domain is created
+    // and after the last one is gone, whatever the order of static
+    // destruction.
+    struct DomainRegistry
+    {
+        std::mutex lock;
+        std::map<juce::String, std::weak_ptr<Core>> domains;
+    };
+
+    DomainRegistry& getDomainRegistry()
+    {
+        static DomainRegistry registry;
+        return registry;
+    }
+}
+
+Core::Core(const juce::String& domainName)
+    : mDomainName(domainName)
+{
+    // the audio threads always find one, if an empty one
+    mRouting.store(new Routing(), std::memory_order_release);
+
+    // without a message thread, e.g. in the tests, finishStateRestore stands
+    // in for it
+    if(juce::MessageManager::getInstanceWithoutCreating() != nullptr)
+        startTimer(pollInterval);
+}
+
+Core::~Core()
+{
+    stopTimer();
+
+    // no instance is left to route with them
+    mRetiredRoutings.clear();
+    delete mRouting.load(std::memory_order_acquire);
+}
+
+std::shared_ptr<Core> Core::getDomain(const juce::String& name)
+{
+    DomainRegistry& registry = getDomainRegistry();
+    const std::lock_guard<std::mutex> lock(registry.lock);
+
+    std::weak_ptr<Core>& domain = registry.domains[name];
+    if(auto core = domain.lock())
+        return core;
+
+    // the last reference to a domain may be let go of at this very moment,
+    // the name belongs to the new one then
+    std::shared_ptr<Core> core(new Core(name));
+    domain = core;
+
+    std::erase_if(registry.domains, [](const auto& domainkv) { return domainkv.second.expired(); });
+    return core;
+}
+
+std::vector<juce::String> Core::getDomainNames()
+{
+    DomainRegistry& registry = getDomainRegistry();
+    const std::lock_guard<std::mutex> lock(registry.lock);
+
+    std::vector<juce::String> names;
+    for(const auto& domainkv : registry.domains)
+        if(!domainkv.second.expired())
+            names.push_back(domainkv.first);
+
+    return names;
+}
+
 void Core::registerInstance(Instance* ptr)
 {
+    const juce::ScopedWriteLock lock(mBufferOperation);
+
     while(checkForUuidMatch(ptr->getId()))
     {
         juce::Uuid id;
@@ -12,6 +244,8 @@ void Core::registerInstance(Instance* ptr)
     }
 
     mBypassedInstances.emplace(ptr->getId(), ptr);
+    updateOffline();
+    topologyChanged();
 }
 
 void Core::tryDeleteInstance(juce::Uuid id)
@@ -19,231 +253,2079 @@ void Core::tryDeleteInstance(juce::Uuid id)
     Instance* instancePtr = findInstanceById(id);
     if(instancePtr == nullptr) return;
 
+    // takes the lock of the instance, which comes before this one
     instancePtr->setMode(Mode::bypass);
 
+    const juce::ScopedWriteLock lock(mBufferOperation);
     mBypassedInstances.erase(id);
+    removePendingConnectionsOf(id);
+    updateOffline();
+    topologyChanged();
 }
 
-void Core::prepareToPlay(double sampleRate, int samplesPerBlock)
+void Core::instanceSwitchedRenderMode(Instance* ptr)
 {
-    juce::ScopedLock lock(mBufferOperation);
+    MY_TRACE_SCOPE_ID("Core::instanceSwitchedRenderMode", ptr->getId());
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    updateOffline();
+}
 
-    mSampleRate = sampleRate;
-    mMaxBufferSize = samplesPerBlock;
+void Core::updateOffline()
+{
+    bool isOffline = false;
+    for(auto* instanceList : {&mBypassedInstances, &mRecieverInstances, &mTransmitterInstances})
+        for(auto& instkv : *instanceList)
+            isOffline = isOffline || instkv.second->isNonRealtime();
 
-    for(auto& kv : mBuffers)
-    {
-        auto& bufferPair = kv.second;
+    mOffline.store(isOffline, std::memory_order_release);
+}
+
+namespace
+{
+    // TransitSlot::state, the tag of the collection the slot holds, its status
+    // and the samples written to it
+    constexpr int slotTagShift = 24;
+    constexpr int slotStatusShift = 22;
+    constexpr uint64_t slotWrittenMask = (1ull << slotStatusShift) - 1;
 
-        bufferPair.first.setSize(2, mMaxBufferSize);
-        bufferPair.second.setSize(2, mMaxBufferSize);
+    constexpr uint64_t makeSlotState(uint64_t tag, uint64_t status, size_t written)
+    {
+        return tag << slotTagShift | status << slotStatusShift | ((uint64_t)written & slotWrittenMask);
     }
+    constexpr uint64_t tagOf(uint64_t state) { return state >> slotTagShift; }
+    constexpr uint64_t statusOf(uint64_t state) { return (state >> slotStatusShift) & 3; }
+    constexpr size_t writtenOf(uint64_t state) { return (size_t)(state & slotWrittenMask); }
 }
 
-void Core::processRouting(int incomingSize)
+// What an epoch is part of, one word of mEpochHistory: the low bits of the
+// epoch as a tag, how many epochs of its collection came before it, where its
+// blocks go in the collection and, for the first epoch of a collection, how
+// long the collection before it is, which it delivers.
+struct Core::EpochEntry
 {
-    juce::ScopedLock lock(mBufferOperation);
+    uint64_t collected = 0;
+    size_t offset = 0;
+    size_t delivered = 0;
+
+    static constexpr uint64_t tagMask = 0xffff;
+    // a collection is delivered after this many epochs whatever its length
+    static constexpr uint64_t maxCollected = 254;
 
-    for(auto& kv : mBuffers)
+    uint64_t pack(uint64_t epoch) const
     {
-        auto& bufferPair = kv.second;
-        auto& delayBuffer = bufferPair.first;
-        auto& transitBuffer = bufferPair.second;
+        return (epoch & tagMask) << 48 | collected << 40 | (uint64_t)offset << 20
+               | (uint64_t)delivered;
+    }
 
-        for (int ch = 0; ch < 2; ch++)
-            for (int s = 0; s < mTransitLength; s++)
-                delayBuffer.getChannel(ch)->push(transitBuffer.getSample(ch, s));
+    // false if the word belongs to another epoch
+    static bool unpack(uint64_t packed, uint64_t epoch, EpochEntry& entry)
+    {
+        if((packed >> 48) != (epoch & tagMask)) return false;
 
-        transitBuffer.clear();
+        entry.collected = (packed >> 40) & 0xff;
+        entry.offset = (size_t)((packed >> 20) & maxEpochSamples);
+        entry.delivered = (size_t)(packed & maxEpochSamples);
+        return true;
     }
 
-    mTransitLength = 0;
+    // the entry of the epoch after this one, once this one is final
+    EpochEntry next(size_t length, int quantum) const
+    {
+        const size_t total = juce::jmin(offset + length, (size_t)maxEpochSamples);
+        if(quantum <= 0 || total >= (size_t)quantum || collected >= maxCollected)
+            return { 0, 0, total };
+
+        return { collected + 1, total, 0 };
+    }
+};
 
-    for (auto& instkv : mBypassedInstances)
+// Publishes the snapshot the instance routes with in its hazard, see
+// reclaimRoutings. One at a time per instance.
+class Core::ScopedRoutingPin
+{
+public:
+    ScopedRoutingPin(const Core& core, std::atomic<const void*>& hazard)
+        : mHazard(hazard)
     {
-        instkv.second->setCoreFinished();
+        // the snapshot is looked at again after it was published, so
+        // reclaimRoutings either sees it or this sees the one replacing it
+        const Routing* routing = core.mRouting.load(std::memory_order_acquire);
+        while(true)
+        {
+            mHazard.store(routing, std::memory_order_seq_cst);
+            const Routing* current = core.mRouting.load(std::memory_order_seq_cst);
+            if(current == routing) break;
+            routing = current;
+        }
+        mRouting = routing;
     }
 
-    for (auto& instkv : mRecieverInstances)
+    ~ScopedRoutingPin() { mHazard.store(nullptr, std::memory_order_release); }
+
+    ScopedRoutingPin(const ScopedRoutingPin&) = delete;
+    ScopedRoutingPin& operator=(const ScopedRoutingPin&) = delete;
+
+    const Routing& getRouting() const { return *mRouting; }
+
+private:
+    std::atomic<const void*>& mHazard;
+    const Routing* mRouting = nullptr;
+};
+
+bool Core::waitForEpoch(Instance& instance, uint64_t epoch)
+{
+    MY_TRACE_SCOPE("Core::waitForEpoch");
+    const auto deadline = juce::Time::getHighResolutionTicks()
+                          + juce::Time::secondsToHighResolutionTicks(maxOfflineWait);
+
+    while(true)
     {
-        instkv.second->setCoreFinished();
+        {
+            const ScopedRoutingPin pin(*this, instance.getRoutingHazard(InstanceAccessToken{}));
+            if(getEpoch() != epoch || isEpochComplete(pin.getRouting(), epoch)) return true;
+        }
 
-        for(auto& bufferkv : mBuffers)
+        if(juce::Time::getHighResolutionTicks() > deadline)
         {
-            const juce::Uuid& transmitterId = bufferkv.first;
-            const juce::Uuid& recieverId = instkv.first;
-            const ConnectionParameters* params = getConnectionParameters(transmitterId, recieverId);
-            const bool isConnected = params->on.getValue();
-            if(!isConnected) continue;
+            mStatistics.offlineTimeouts.add();
+            return false;
+        }
+        juce::Thread::yield();
+    }
+}
+
+bool Core::isEpochComplete(const Routing& routing, uint64_t epoch) const
+{
+    // Only the instances that processed a block in the epoch before are
+    // waited for. The host may not be processing the others at all, they are
+    // waited for again once they are back.
+    const auto isWaitedFor = [epoch](const ProcessingStamp& processingStamp)
+    {
+        const uint64_t processedEpoch = processingStamp.getEpoch();
+        return processedEpoch != 0 && processedEpoch + 1 == epoch;
+    };
 
-            const float gain = params->gain.getValue();
-            
-            const auto& bufferPair = bufferkv.second;
+    for(const auto& recieverkv : routing.recievers)
+        if(isWaitedFor(recieverkv.second->stamp))
+            return false;
+    for(const auto& sourcekv : routing.sources)
+        if(!sourcekv.second.isBus && isWaitedFor(sourcekv.second.buffer->stamp))
+            return false;
 
-            for (int ch = 0; ch < 2; ch++)
-            {
-                for (ptrdiff_t s = 0; s < incomingSize; s++)
-                {
-                    float sample = bufferPair.first.getChannel(ch)->operator[](s);
-                    sample *= gain;
-                    instkv.second->getRecieveBuffer()->setSample(ch, (int)s, sample);
-                }
-            }
-        }
+    return true;
+}
+
+void Core::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    if(sampleRate == mSampleRate && samplesPerBlock == mMaxBufferSize) return;
+
+    mSampleRate = sampleRate;
+    mMaxBufferSize = samplesPerBlock;
+    rebuildBuffers();
+    rebuildRoutes();
+}
+
+void Core::setRoutingQuantum(int numberOfSamples)
+{
+    const juce::ScopedWriteLock lock(mBufferOperation);
+
+    numberOfSamples = juce::jmax(0, numberOfSamples);
+    if(numberOfSamples == getRoutingQuantum()) return;
+
+    mQuantum.store(numberOfSamples, std::memory_order_relaxed);
+
+    // the blocks of the epoch are dropped with the buffers they went to
+    uint64_t state = mEpochState.load(std::memory_order_acquire);
+    while((state & epochClosed) == 0 && (state & maxEpochSamples) != 0
+          && !mEpochState.compare_exchange_weak(state, state & ~maxEpochSamples,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire))
+    {}
+
+    rebuildBuffers();
+    rebuildRoutes();
+}
+
+void Core::rebuildBuffers()
+{
+    // the audio threads write to the ones of their snapshot until they get
+    // the next one
+    for(auto& bufferkv : mBuffers)
+    {
+        auto buffer = createBuffer();
+        buffer->sharedSlot = bufferkv.second->sharedSlot;
+        bufferkv.second = std::move(buffer);
     }
 
-    for (auto instkv : mTransmitterInstances)
+    for(auto& statekv : mRecieverStates)
+        statekv.second = createRecieverState();
+}
+
+std::shared_ptr<Core::Buffer> Core::createBuffer()
+{
+    auto buffer = std::make_shared<Buffer>();
+    for(TransitSlot& slot : buffer->transit)
     {
-        instkv.second->setCoreFinished();
+        slot.samples.setSize(2 /*hardcoded for now*/, getRoutingBufferSize());
+        slot.samples.clear();
     }
+    return buffer;
 }
 
-void Core::releaseResources() 
+std::shared_ptr<Core::RecieverState> Core::createRecieverState()
 {
-    // Make sure this is safe to call multiple times, because every instance
-    // will call this is their constructor
+    auto state = std::make_shared<RecieverState>();
+    // only two-channels setups are supported in this version
+    state->buffer.setSize(2, getRoutingBufferSize());
+    state->buffer.clear();
+    state->scratch.setSize(2, getRoutingBufferSize());
+    state->pins = &mPassPins;
+    state->pin = mPassPins.allocate();
+
+    // a pass delivered before the reciever was there is not mixed
+    EpochView view;
+    if(viewEpoch(mEpochState.load(std::memory_order_acquire), view))
+        state->mixedPass = view.pass;
+    return state;
 }
 
-void Core::instanceSwitchedMode(Instance* ptr, Mode previousMode)
-{    
-    juce::ScopedLock lock(mBufferOperation);
+bool Core::loadEpochEntry(uint64_t epoch, EpochEntry& entry) const
+{
+    return EpochEntry::unpack(mEpochHistory[epoch % epochHistorySize].load(std::memory_order_acquire),
+                              epoch, entry);
+}
 
-    if(previousMode == ptr->getMode()) return;
+void Core::storeEpochEntry(uint64_t epoch, const EpochEntry& entry)
+{
+    std::atomic<uint64_t>& word = mEpochHistory[epoch % epochHistorySize];
+    const uint64_t packed = entry.pack(epoch);
 
-    // deassign from previous Mode responsibilities
-    switch (previousMode)
+    // every thread that helps stores the same, only ever over the entry of an
+    // older epoch, one that got here late finds it written
+    uint64_t previous = word.load(std::memory_order_relaxed);
+    while(true)
     {
-        case Mode::transmit :
-            mTransmitterInstances.erase(ptr->getId());
-            mMatrix.erase(ptr->getId());
-            mBuffers.erase(ptr->getId());
-            updateConnectionList(Mode::recieve);
-            break;
-        case Mode::recieve :
-            mRecieverInstances.erase(ptr->getId());
-            for (auto& parameterVectorKv : mMatrix)
-            {
-                auto& parameterVector = parameterVectorKv.second;
-                parameterVector.erase(ptr->getId());
-            }
-            updateConnectionList(Mode::transmit);
-            break;
-        case Mode::bypass :
-            mBypassedInstances.erase(ptr->getId());
-        default :
-            break;
+        const uint64_t age = ((packed >> 48) - (previous >> 48)) & EpochEntry::tagMask;
+        if(age == 0 || age > EpochEntry::tagMask / 2) return;
+
+        if(word.compare_exchange_weak(previous, packed, std::memory_order_release,
+                                      std::memory_order_relaxed))
+            return;
     }
+}
 
-    // assign to new Mode responsibilities
-    switch(ptr->getMode())
+bool Core::viewEpoch(uint64_t state, EpochView& view) const
+{
+    const uint64_t epoch = state >> epochShift;
+    EpochEntry entry;
+    if(!loadEpochEntry(epoch, entry)) return false;
+
+    const uint64_t first = epoch - entry.collected;
+    view.epoch = epoch;
+    view.collection = first + 1;
+    view.offset = entry.offset;
+    view.pass = 0;
+    view.passSamples = 0;
+
+    // nothing was collected before the first collection
+    if(first == 0) return true;
+
+    EpochEntry firstEntry, lastEntry;
+    if(!loadEpochEntry(first, firstEntry) || !loadEpochEntry(first - 1, lastEntry)) return false;
+
+    view.pass = first - 1 - lastEntry.collected + 1;
+    view.passSamples = firstEntry.delivered;
+    return true;
+}
+
+bool Core::processRouting(Instance& starter, int incomingSize, uint64_t epoch)
+{
+    MY_TRACE_SCOPE("Core::processRouting");
+    ScopedDurationMeasurement measurement(mStatistics.processRoutingDuration);
+    const ScopedRoutingPin pin(*this, starter.getRoutingHazard(InstanceAccessToken{}));
+
+    // another instance started it while this one was getting here
+    uint64_t state = mEpochState.load(std::memory_order_acquire);
+    while((state >> epochShift) == epoch)
     {
-        case Mode::bypass :
-            mBypassedInstances.emplace(ptr->getId(), ptr);
-            break;
-        case Mode::recieve :
-            mRecieverInstances.emplace(ptr->getId(), ptr);
-            for (auto& parameterVectorKv : mMatrix)
-            {
-                auto& parameterVector = parameterVectorKv.second;
-                parameterVector.emplace(ptr->getId(), 
-                                        std::make_unique<ConnectionParameters>());
-            }
-            updateConnectionList(Mode::transmit);
-            break;
-        case Mode::transmit :
-            mTransmitterInstances.emplace(ptr->getId(), ptr);
+        if((state & epochClosed) == 0)
+        {
+            // without a quantum every pass is as long as the block that
+            // starts it at least
+            uint64_t closed = state | epochClosed;
+            if(getRoutingQuantum() == 0)
             {
-                ParameterVector vector{};
-                vector.reserve(mRecieverInstances.size());
-                for(auto& recieverkv : mRecieverInstances)
-                {
-                    vector.emplace (recieverkv.first, 
-                                    std::make_unique<ConnectionParameters>());
-                }
-                mMatrix.emplace(ptr->getId(), std::move(vector));
-            
-                Buffer transmitterBufferPair = {MCCBuffer(), juce::AudioBuffer<float>()};
-                transmitterBufferPair.first.setSize(2 /*hardcoded for now*/, mMaxBufferSize);
-                transmitterBufferPair.second.setSize(2 /*hardcoded for now*/, mMaxBufferSize);
-                transmitterBufferPair.second.clear();
-                mBuffers.emplace(ptr->getId(), std::move(transmitterBufferPair));
+                const uint64_t length = juce::jmin((uint64_t)juce::jmax(0, incomingSize), maxEpochSamples);
+                closed = (closed & ~maxEpochSamples) | juce::jmax(state & maxEpochSamples, length);
             }
-            updateConnectionList(Mode::recieve);
-            break;
-        default :
-            break;
+
+            if(!mEpochState.compare_exchange_weak(state, closed, std::memory_order_acq_rel,
+                                                  std::memory_order_acquire))
+                continue;
+            state = closed;
+        }
+
+        return advanceEpoch(state, pin.getRouting());
     }
+
+    return false;
 }
 
-// Transmitter Instance -> Core
-void Core::bufferForNextBlock(juce::Uuid id, juce::AudioBuffer<float>& buffer)
+bool Core::advanceEpoch(uint64_t state, const Routing& routing)
 {
-    juce::ScopedLock lock(mBufferOperation);
+    const uint64_t epoch = state >> epochShift;
+    EpochEntry entry;
+    // a thread that fell that far behind has nothing left to help with
+    if(!loadEpochEntry(epoch, entry)) return false;
 
-    mTransitLength = buffer.getNumSamples();
+    // written before anyone can be in the next epoch
+    const EpochEntry next = entry.next((size_t)(state & maxEpochSamples), getRoutingQuantum());
+    storeEpochEntry(epoch + 1, next);
+    if(!mEpochState.compare_exchange_strong(state, (epoch + 1) << epochShift,
+                                            std::memory_order_acq_rel, std::memory_order_acquire))
+        return false;
 
-    for (int ch = 0; ch < 2; ch++)
+    mStatistics.routingPasses.add();
+    mLastPassTime.store(juce::jmax((juce::uint32)1, juce::Time::getMillisecondCounter()),
+                        std::memory_order_relaxed);
+
+    // instances that did not process a block in the epoch that just ended
+    uint64_t lateInstances = 0;
+    uint64_t sameBlockEdges = 0;
+    for(const auto& recieverkv : routing.recievers)
     {
-        mBuffers[id].second.addFrom(
-            ch,
-            0,
-            buffer.getReadPointer(ch, 0),
-            mTransitLength
-        );
+        if(recieverkv.second->stamp.getEpoch() < epoch)
+            lateInstances++;
+        sameBlockEdges += recieverkv.second->sameBlockEdges.load(std::memory_order_relaxed);
     }
-}
+    for(const auto& sourcekv : routing.sources)
+        if(!sourcekv.second.isBus && sourcekv.second.buffer->stamp.getEpoch() < epoch)
+            lateInstances++;
+    mStatistics.lateEpochs.add(lateInstances);
+    mStatistics.sameBlockEdges.set(sameBlockEdges);
 
-bool Core::checkForUuidMatch(const juce::Uuid& id)
-{
-    if(mBypassedInstances.contains(id)) return true;
-    if(mTransmitterInstances.contains(id)) return true;
-    if(mRecieverInstances.contains(id)) return true;
+    // with a quantum, blocks are collected until there are enough to route,
+    // the recievers keep reading what the last pass delivered
+    if(next.collected > 0) return true;
 
-    return false;
+    // every reciever mixes what this pass delivers on its own thread, see
+    // recieveForThisBlock, recievers that share nothing do not wait for
+    // each other
+    uint64_t activeEdges = 0;
+    for(const BusRoute& busRoute : routing.busRoutes)
+        for(const BusInput& input : busRoute.inputs)
+            if(input.parameters->on.getValue()) activeEdges++;
+    for(const Route& route : routing.routes)
+    {
+        for(const RouteEdge& edge : route.edges)
+            if(edge.parameters->on.getValue()) activeEdges++;
+        for(const RemoteEdge& edge : route.remoteEdges)
+            if(edge.parameters->on.getValue()) activeEdges++;
+    }
+
+    mStatistics.activeEdges.set(activeEdges);
+    mStatistics.silentSkips.add(routing.unroutedConnections);
+    return true;
 }
 
-ConnectionParameters* Core::getConnectionParameters(juce::Uuid transmitter, juce::Uuid reciever)
+Core::Collected Core::findCollected(const Buffer& source, uint64_t collection)
 {
-    if(!mMatrix.contains(transmitter)) return nullptr;
-    if(!mMatrix[transmitter].contains(reciever)) return nullptr;
-    return mMatrix[transmitter][reciever].get();
+    if(collection == 0) return {};
+
+    // the reciever pinned it, the slot is not taken for another one while
+    // it reads it
+    for(const TransitSlot& slot : source.transit)
+    {
+        const uint64_t state = slot.state.load(std::memory_order_seq_cst);
+        if(tagOf(state) == collection && statusOf(state) != TransitSlot::reclaiming)
+            return { &slot.samples, writtenOf(state) };
+    }
+
+    return {};
 }
 
-Instance* Core::findInstanceById(juce::Uuid id)
+Core::TransitSlot* Core::openSlot(Buffer& buffer, uint64_t collection)
 {
-    for(auto instancelist : {mBypassedInstances, mTransmitterInstances, mRecieverInstances})
+    // only the transmitter writes its slots
+    TransitSlot* oldest = nullptr;
+    for(TransitSlot& slot : buffer.transit)
     {
-        for(auto ptrkv : instancelist)
+        const uint64_t state = slot.state.load(std::memory_order_relaxed);
+        if(tagOf(state) == collection)
         {
-            if(ptrkv.first == id)
-                return ptrkv.second;
+            if(statusOf(state) == TransitSlot::open) return &slot;
+
+            // a reciever was still reading it last time
+            if(mPassPins.isAnyAtOrBelow(slot.previous)) return nullptr;
+            slot.state.store(makeSlotState(collection, TransitSlot::open, 0), std::memory_order_seq_cst);
+            return &slot;
         }
+
+        if(tagOf(state) < collection
+           && (oldest == nullptr || tagOf(state) < tagOf(oldest->state.load(std::memory_order_relaxed))))
+            oldest = &slot;
     }
-    return nullptr;
+
+    // a transmitter that fell behind does not take the slot of a newer one
+    if(oldest == nullptr) return nullptr;
+
+    // marked before the pins are looked at, a reciever that pins after this
+    // does not find what the slot held anymore
+    oldest->previous = tagOf(oldest->state.load(std::memory_order_relaxed));
+    oldest->state.store(makeSlotState(collection, TransitSlot::reclaiming, 0),
+                        std::memory_order_seq_cst);
+    if(mPassPins.isAnyAtOrBelow(oldest->previous)) return nullptr;
+
+    oldest->state.store(makeSlotState(collection, TransitSlot::open, 0), std::memory_order_seq_cst);
+    return oldest;
 }
 
-void Core::updateConnectionList(Mode mode)
+Core::Collected Core::collectBus(const BusRoute& busRoute, RecieverState& state,
+                                 const EpochView& view)
 {
-    switch(mode)
+    if(view.pass == 0) return {};
+
+    Buffer& bus = *busRoute.bus;
+    const size_t numberOfSamples = juce::jmin(view.passSamples,
+                                              (size_t)bus.transit[0].samples.getNumSamples());
+
+    // Takes the slot for the pass, or finds the sum of another reciever.
+    // Slots holding older passes are only taken once no reciever reads them.
+    TransitSlot* claimed = nullptr;
+    for(size_t attempt = 0; attempt < 2 * numberOfTransitSlots && claimed == nullptr; attempt++)
     {
-        case Mode::recieve :
-            for(auto ptrkv : mRecieverInstances)
+        TransitSlot* match = nullptr;
+        TransitSlot* oldest = nullptr;
+        uint64_t matchState = 0;
+        uint64_t oldestState = 0;
+        for(TransitSlot& slot : bus.transit)
+        {
+            const uint64_t slotState = slot.state.load(std::memory_order_seq_cst);
+            if(tagOf(slotState) == view.pass)
             {
-                auto func = ptrkv.second->updateConnectionList;
-                if(func)
-                    func();
+                match = &slot;
+                matchState = slotState;
+                break;
             }
-            return;
-        case Mode::transmit :
-            for(auto ptrkv : mTransmitterInstances)
+            if(tagOf(slotState) < view.pass && (oldest == nullptr || tagOf(slotState) < tagOf(oldestState)))
             {
-                auto func = ptrkv.second->updateConnectionList;
-                if(func)
-                    func();
+                oldest = &slot;
+                oldestState = slotState;
             }
-            return;
-        case Mode::bypass :
-        default:
-            return;
+        }
+
+        if(match != nullptr)
+        {
+            if(statusOf(matchState) == TransitSlot::done)
+                return { &match->samples, writtenOf(matchState) };
+            // another reciever sums it right now
+            if(statusOf(matchState) == TransitSlot::open
+               || mPassPins.isAnyAtOrBelow(view.pass - 1))
+                break;
+
+            if(match->state.compare_exchange_strong(matchState,
+                                                    makeSlotState(view.pass, TransitSlot::open, 0),
+                                                    std::memory_order_seq_cst))
+                claimed = match;
+            continue;
+        }
+
+        if(oldest == nullptr) break;
+        oldest->state.compare_exchange_strong(oldestState,
+                                              makeSlotState(view.pass, TransitSlot::reclaiming, 0),
+                                              std::memory_order_seq_cst);
+    }
+
+    // whoever sums it into the slot publishes what the inputs cost
+    juce::AudioBuffer<RoutingSample>& destination = claimed != nullptr ? claimed->samples : state.scratch;
+    uint64_t activeEdges = 0;
+    uint64_t silentSkips = 0;
+    LevelAccumulator busLevel;
+
+    for(int ch = 0; ch < destination.getNumChannels(); ch++)
+        std::fill_n(destination.getWritePointer(ch), numberOfSamples, RoutingSample{});
+
+    for(const BusInput& input : busRoute.inputs)
+    {
+        ConnectionParameters* params = input.parameters;
+        if(!params->on.getValue())
+        {
+            if(claimed != nullptr)
+            {
+                params->level.clear();
+                silentSkips++;
+            }
+            continue;
+        }
+        activeEdges++;
+        const juce::int64 mixStart = juce::Time::getHighResolutionTicks();
+
+        const Collected collected = findCollected(*input.source, view.pass);
+        const size_t count = juce::jmin(collected.available, numberOfSamples);
+        const float gain = params->gain.getValue();
+        const bool clip = params->protection.getValue() == OverdriveProtection::clip;
+        LevelAccumulator connectionLevel;
+        if(count > 0)
+            input.mixer->mixTransit[clip][false](destination, *collected.samples, 0,
+                                                 input.numberOfChannels, 0, count, gain, gain,
+                                                 false, numberOfSamples, connectionLevel, busLevel);
+
+        if(claimed == nullptr) continue;
+        params->level.publish(connectionLevel);
+        params->cost.add((uint64_t)(juce::Time::getHighResolutionTicks() - mixStart),
+                         numberOfSamples);
+    }
+
+    if(claimed != nullptr)
+    {
+        mStatistics.samplesRouted.add(activeEdges * 2 * (uint64_t)numberOfSamples);
+        mStatistics.silentSkips.add(silentSkips);
+
+        // the pin of this reciever keeps it, even if it could not be marked
+        uint64_t expected = makeSlotState(view.pass, TransitSlot::open, 0);
+        claimed->state.compare_exchange_strong(expected,
+                                               makeSlotState(view.pass, TransitSlot::done,
+                                                             numberOfSamples),
+                                               std::memory_order_seq_cst);
+    }
+
+    return { &destination, numberOfSamples };
+}
+
+void Core::mixRoute(const Route& route, RecieverState& state, const EpochView& view, int latency,
+                    size_t numberOfSamples, bool measureReciever, LevelMeter& recieveLevel,
+                    uint64_t& activeEdges, uint64_t& silentSkips)
+{
+    numberOfSamples = juce::jmin(numberOfSamples, (size_t)state.buffer.getNumSamples());
+    LevelAccumulator recieverLevel;
+
+    // the last connection that is still on measures the finished mix in
+    // the same pass, connections switched on after this are picked up in
+    // the next block
+    size_t lastEdge = route.edges.size();
+    for (size_t edge = route.edges.size(); edge-- > 0;)
+    {
+        if(route.edges[edge].delivery->latency == latency
+           && route.edges[edge].parameters->on.getValue())
+        {
+            lastEdge = edge;
+            break;
+        }
     }
+
+    for(size_t edge = 0; edge < route.edges.size(); edge++)
+    {
+        const RouteEdge& routeEdge = route.edges[edge];
+        ConnectionParameters* params = routeEdge.parameters;
+        if(routeEdge.delivery->latency != latency) continue;
+
+        if(edge > lastEdge || !params->on.getValue())
+        {
+            params->level.clear();
+            silentSkips++;
+            continue;
+        }
+        activeEdges++;
+        const juce::int64 mixStart = juce::Time::getHighResolutionTicks();
+
+        LevelAccumulator connectionLevel;
+        if(measureReciever && edge == lastEdge)
+            mixEdge<true>(routeEdge, state, view, numberOfSamples, connectionLevel, recieverLevel);
+        else
+            mixEdge<false>(routeEdge, state, view, numberOfSamples, connectionLevel, recieverLevel);
+
+        params->level.publish(connectionLevel);
+        params->cost.add((uint64_t)(juce::Time::getHighResolutionTicks() - mixStart),
+                         numberOfSamples);
+    }
+
+    if(measureReciever && lastEdge < route.edges.size())
+        recieveLevel.publish(recieverLevel);
+}
+
+void Core::mixRemoteEdges(const Route& route, const Routing& routing, RecieverState& state,
+                          size_t numberOfSamples, bool measureReciever, LevelMeter& recieveLevel,
+                          uint64_t& activeEdges, uint64_t& silentSkips)
+{
+    if(route.remoteEdges.empty()) return;
+
+    SharedRouting& sharedRouting = *routing.sharedRouting;
+    numberOfSamples = juce::jmin(numberOfSamples, (size_t)state.buffer.getNumSamples());
+    LevelAccumulator recieverLevel;
+
+    std::array<RoutingSample*, SharedRouting::numberOfChannels> destinations;
+    for (size_t ch = 0; ch < SharedRouting::numberOfChannels; ch++)
+        destinations[ch] = state.buffer.getWritePointer((int)ch);
+
+    // where the readers start, what the compensators aim for
+    const size_t targetFill = juce::jmin(2 * numberOfSamples, SharedRouting::maxLatency);
+
+    // the last one that is on measures the mix, like in mixRoute
+    size_t lastEdge = route.remoteEdges.size();
+    for (size_t edge = route.remoteEdges.size(); edge-- > 0;)
+    {
+        if(route.remoteEdges[edge].parameters->on.getValue())
+        {
+            lastEdge = edge;
+            break;
+        }
+    }
+
+    for(size_t edge = 0; edge < route.remoteEdges.size(); edge++)
+    {
+        const RemoteEdge& remoteEdge = route.remoteEdges[edge];
+        ConnectionParameters* params = remoteEdge.parameters;
+
+        // a transmitter that went away keeps its edge until the routes follow
+        if(edge > lastEdge || !params->on.getValue()
+           || !sharedRouting.holds(remoteEdge.slot, remoteEdge.transmitter))
+        {
+            params->level.clear();
+            silentSkips++;
+            continue;
+        }
+        activeEdges++;
+        const juce::int64 mixStart = juce::Time::getHighResolutionTicks();
+
+        RemoteState& remote = *remoteEdge.state;
+        auto& compensator = remote.compensator;
+        bool isStarted = remote.readPosition != SharedRouting::notStarted;
+        size_t fill = sharedRouting.getFill(remoteEdge.slot, remote.readPosition);
+
+        // more than even the compensation could catch up with, starts over
+        if(isStarted && fill > SharedRouting::maxLatency)
+        {
+            mStatistics.overruns.add();
+            remote.readPosition = SharedRouting::notStarted;
+            isStarted = false;
+        }
+        if(!isStarted)
+        {
+            compensator.reset();
+            fill = targetFill;
+        }
+
+        const size_t required = compensator.beginBlock(fill, targetFill, numberOfSamples);
+        SharedRouting::Pieces pieces;
+        const size_t available = sharedRouting.read(remoteEdge.slot, remote.readPosition,
+                                                    required, pieces);
+        for (size_t ch = 0; ch < SharedRouting::numberOfChannels; ch++)
+        {
+            RoutingSample* input = compensator.getInput(ch);
+            std::copy_n(pieces.data[0][ch], pieces.size[0], input);
+            std::copy_n(pieces.data[1][ch], pieces.size[1], input + pieces.size[0]);
+        }
+
+        // ran dry, what is missing stays silent and the reader starts over
+        if(available < required)
+        {
+            if(isStarted)
+                mStatistics.underruns.add();
+            remote.readPosition = SharedRouting::notStarted;
+        }
+        compensator.addedInput(available, required);
+
+        const float gain = params->gain.getValue();
+        const bool clip = params->protection.getValue() == OverdriveProtection::clip;
+        LevelAccumulator connectionLevel;
+        if(measureReciever && edge == lastEdge)
+        {
+            if(clip)
+                compensator.mixInto<true, true>(destinations, gain, connectionLevel, recieverLevel);
+            else
+                compensator.mixInto<true>(destinations, gain, connectionLevel, recieverLevel);
+        }
+        else
+        {
+            if(clip)
+                compensator.mixInto<false, true>(destinations, gain, connectionLevel, recieverLevel);
+            else
+                compensator.mixInto<false>(destinations, gain, connectionLevel, recieverLevel);
+        }
+
+        params->level.publish(connectionLevel);
+        params->cost.add((uint64_t)(juce::Time::getHighResolutionTicks() - mixStart),
+                         numberOfSamples);
+    }
+
+    if(measureReciever && lastEdge < route.remoteEdges.size())
+        recieveLevel.publish(recieverLevel);
+}
+
+template<bool measureReciever>
+void Core::mixEdge(const RouteEdge& edge, RecieverState& state, const EpochView& view,
+                   size_t numberOfSamples, LevelAccumulator& connectionLevel,
+                   LevelAccumulator& recieverLevel)
+{
+    const uint64_t epoch = view.epoch;
+    const float gain = edge.parameters->gain.getValue();
+    const bool clip = edge.parameters->protection.getValue() == OverdriveProtection::clip;
+    const Buffer& source = *edge.source;
+    const BlockMixer& mixer = *edge.mixer;
+    Delivery& delivery = *edge.delivery;
+
+    // count samples of what a source collected from start on, the gain ramps
+    // over the whole block
+    const auto mix = [&](bool measure, const Collected& collected, size_t start, size_t count,
+                         float startGain, float endGain, bool backwards)
+    {
+        if(count == 0) return;
+        mixer.mixTransit[clip][measure](state.buffer, *collected.samples, 0, edge.numberOfChannels,
+                                        start, count, startGain, endGain, backwards,
+                                        numberOfSamples, connectionLevel, recieverLevel);
+    };
+
+    // the host changed its order and the transmitter was not processed yet,
+    // the connection falls back to the pass right away
+    if(delivery.latency == 0 && source.stamp.of(epoch).epoch.load(std::memory_order_acquire) != epoch)
+    {
+        delivery.latency = 1;
+        delivery.stableEpochs = 0;
+        state.sameBlockEdges.fetch_sub(1, std::memory_order_relaxed);
+        mStatistics.orderViolations.add();
+        mOrderChanged.store(true, std::memory_order_release);
+    }
+
+    if(delivery.latency == 0)
+    {
+        // what was sent in this epoch, behind what was collected before it
+        const Collected current = findCollected(source, view.collection);
+        const size_t count = juce::jmin(numberOfSamples,
+                                        current.available - juce::jmin(current.available, view.offset));
+
+        if(delivery.transition == Delivery::Transition::crossfade)
+        {
+            // the block of the pass was not delivered yet, fade from it to
+            // the current one instead of skipping it
+            const Collected pass = findCollected(source, view.pass);
+            mix(false, pass, 0, juce::jmin(numberOfSamples, pass.available), gain, 0.f, false);
+            mix(measureReciever, current, view.offset, count, 0.f, gain, false);
+        }
+        else
+        {
+            mix(measureReciever, current, view.offset, count, gain, gain, false);
+        }
+
+        delivery.transition = Delivery::Transition::none;
+        delivery.consumedEpoch = epoch;
+    }
+    else if(delivery.consumedEpoch != 0 && delivery.consumedEpoch + 1 == epoch)
+    {
+        // The block of the pass was delivered in the last block already.
+        // Repeating it would jump back in time, played backwards it continues
+        // where the last block ended. It fades out and the next block fades
+        // in.
+        const Collected pass = findCollected(source, view.pass);
+        const size_t count = juce::jmin(numberOfSamples, pass.available);
+        mix(measureReciever, pass, pass.available - count, count, gain, 0.f, true);
+        delivery.transition = Delivery::Transition::fadeIn;
+    }
+    else
+    {
+        const Collected pass = edge.bus != nullptr ? collectBus(*edge.bus, state, view)
+                                                   : findCollected(source, view.pass);
+        const float startGain = delivery.transition == Delivery::Transition::fadeIn ? 0.f : gain;
+        mix(measureReciever, pass, 0, juce::jmin(numberOfSamples, pass.available), startGain, gain,
+            false);
+        delivery.transition = Delivery::Transition::none;
+    }
+}
+
+void Core::releaseResources() 
+{
+    // Make sure this is safe to call multiple times, because every instance
+    // will call this is their constructor
+}
+
+void Core::instanceSwitchedMode(Instance* ptr, Mode previousMode)
+{
+    MY_TRACE_SCOPE_ID("Core::instanceSwitchedMode", ptr->getId());
+    const juce::ScopedWriteLock lock(mBufferOperation);
+
+    if(previousMode == ptr->getMode()) return;
+
+    topologyChanged();
+
+    // deassign from previous Mode responsibilities
+    switch (previousMode)
+    {
+        case Mode::transmit :
+        {
+            mTransmitterInstances.erase(ptr->getId());
+            removeConnectionsOf(ptr->getId());
+            // withdrawn once no audio thread writes to it anymore
+            auto buffer = mBuffers.find(ptr->getId());
+            if(buffer != mBuffers.end() && buffer->second->sharedSlot >= 0)
+                mRouting.load(std::memory_order_relaxed)->withdrawnSlots.push_back(buffer->second->sharedSlot);
+            mBuffers.erase(ptr->getId());
+            break;
+        }
+        case Mode::recieve :
+            mRecieverInstances.erase(ptr->getId());
+            mRecieverStates.erase(ptr->getId());
+            removeConnectionsOf(ptr->getId());
+            break;
+        case Mode::bypass :
+            mBypassedInstances.erase(ptr->getId());
+        default :
+            break;
+    }
+
+    // assign to new Mode responsibilities
+    switch(ptr->getMode())
+    {
+        case Mode::bypass :
+            mBypassedInstances.emplace(ptr->getId(), ptr);
+            break;
+        case Mode::recieve :
+            mRecieverInstances.emplace(ptr->getId(), ptr);
+            mRecieverStates.insert_or_assign(ptr->getId(), createRecieverState());
+            break;
+        case Mode::transmit :
+        {
+            mTransmitterInstances.emplace(ptr->getId(), ptr);
+            auto buffer = createBuffer();
+            if(mSharedRouting != nullptr)
+                buffer->sharedSlot = mSharedRouting->publish(ptr->getId(), ptr->getName());
+            mBuffers.insert_or_assign(ptr->getId(), std::move(buffer));
+            break;
+        }
+        default :
+            break;
+    }
+
+    resolvePendingConnections(ptr);
+    rebuildRoutes();
+}
+
+void Core::instanceRenamed(Instance* ptr)
+{
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+
+        auto it = mBuffers.find(ptr->getId());
+        if(mSharedRouting != nullptr && it != mBuffers.end())
+            mSharedRouting->rename(it->second->sharedSlot, ptr->getName());
+    }
+
+    topologyChanged();
+}
+
+// Transmitter Instance -> Core
+template<typename SampleType>
+uint64_t Core::bufferForNextBlock(Instance& transmitter, juce::AudioBuffer<SampleType>& buffer)
+{
+    MY_TRACE_SCOPE_ID("Core::bufferForNextBlock", transmitter.getId());
+    const ScopedRoutingPin pin(*this, transmitter.getRoutingHazard(InstanceAccessToken{}));
+    const Routing& routing = pin.getRouting();
+
+    auto it = routing.sources.find(transmitter.getId());
+    if(it == routing.sources.end()) return getEpoch();
+    Buffer& source = *it->second.buffer;
+
+    // The epoch is as long as the longest block sent in it, the samples are
+    // added to it before the block is written. An epoch that was closed
+    // while its starter was held up is moved on from here.
+    const size_t capacity = (size_t)source.transit[0].samples.getNumSamples();
+    EpochView view;
+    size_t offset = 0;
+    size_t numberOfSamples = 0;
+    uint64_t state = mEpochState.load(std::memory_order_acquire);
+    while(true)
+    {
+        if((state & epochClosed) != 0)
+        {
+            advanceEpoch(state, routing);
+            state = mEpochState.load(std::memory_order_acquire);
+            continue;
+        }
+        if(!viewEpoch(state, view)) return state >> epochShift;
+
+        offset = juce::jmin(view.offset, capacity);
+        numberOfSamples = juce::jmin((size_t)buffer.getNumSamples(), capacity - offset,
+                                     (size_t)maxEpochSamples);
+        if((state & maxEpochSamples) >= numberOfSamples
+           || mEpochState.compare_exchange_weak(state, (state & ~maxEpochSamples) | numberOfSamples,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire))
+            break;
+    }
+
+    // dropped if a reciever that fell behind still reads the slot it needs
+    if(TransitSlot* slot = openSlot(source, view.collection))
+    {
+        const size_t written = writtenOf(slot->state.load(std::memory_order_relaxed));
+        for (int ch = 0; ch < 2; ch++)
+        {
+            RoutingSample* samples = slot->samples.getWritePointer(ch);
+
+            // the epochs of the collection it missed stay silent
+            if(written < offset)
+                std::fill(samples + written, samples + offset, RoutingSample{});
+
+            if constexpr (std::is_same_v<SampleType, RoutingSample>)
+            {
+                std::copy_n(buffer.getReadPointer(ch), numberOfSamples, samples + offset);
+            }
+            else
+            {
+                std::fill_n(samples + offset, numberOfSamples, RoutingSample{});
+                kernels::addConverted(samples + offset, buffer.getReadPointer(ch), numberOfSamples);
+            }
+        }
+
+        slot->state.store(makeSlotState(view.collection, TransitSlot::open,
+                                        juce::jmax(written, offset + numberOfSamples)),
+                          std::memory_order_release);
+    }
+
+    // other processes read it at their own pace
+    if(it->second.sharedSlot >= 0 && buffer.getNumChannels() >= (int)SharedRouting::numberOfChannels)
+        routing.sharedRouting->write(it->second.sharedSlot, buffer.getArrayOfReadPointers(),
+                                     (size_t)buffer.getNumSamples());
+
+    // publishes the block to recievers that take it in the same block
+    stamp(source.stamp, view.epoch);
+    return view.epoch;
+}
+
+template uint64_t Core::bufferForNextBlock(Instance&, juce::AudioBuffer<float>&);
+template uint64_t Core::bufferForNextBlock(Instance&, juce::AudioBuffer<double>&);
+
+// Core -> Reciever Instance
+template<typename SampleType>
+uint64_t Core::recieveForThisBlock(Instance& reciever, juce::AudioBuffer<SampleType>& buffer)
+{
+    MY_TRACE_SCOPE_ID("Core::recieveForThisBlock", reciever.getId());
+    const ScopedRoutingPin pin(*this, reciever.getRoutingHazard(InstanceAccessToken{}));
+    const Routing& routing = pin.getRouting();
+
+    const uint64_t epochState = mEpochState.load(std::memory_order_acquire);
+    EpochView view;
+    auto stateIt = routing.recievers.find(reciever.getId());
+    if(stateIt == routing.recievers.end() || !viewEpoch(epochState, view))
+        return epochState >> epochShift;
+
+    RecieverState& state = *stateIt->second;
+    stamp(state.stamp, view.epoch);
+    // out of pins, it stays silent
+    if(state.pin == PassPins::none) return view.epoch;
+
+    // before any slot is looked at, everything this reads is at or after it
+    mPassPins.pin(state.pin, view.pass != 0 ? view.pass : view.collection);
+
+    auto routeIt = routing.routeIndices.find(reciever.getId());
+    const Route* route = routeIt != routing.routeIndices.end() ? &routing.routes[routeIt->second]
+                                                                : nullptr;
+    if(route != nullptr && state.latencyEpoch != view.epoch)
+        assignLatencies(*route, state, view.epoch);
+    const uint64_t sameBlockEdges = route != nullptr
+        ? state.sameBlockEdges.load(std::memory_order_relaxed)
+        : 0;
+
+    LevelMeter& recieveLevel = reciever.getRecieveLevel();
+    uint64_t activeEdges = 0;
+    uint64_t silentSkips = 0;
+
+    // the first block after a routing pass mixes what the pass delivers,
+    // the same-block connections measure the reciever if there are any.
+    // Recievers without a route, e.g. during a bulk load, stay silent.
+    if(view.pass != 0 && view.pass != state.mixedPass)
+    {
+        state.mixedPass = view.pass;
+        state.buffer.clear();
+        state.position = 0;
+        recieveLevel.clear();
+
+        if(route != nullptr)
+        {
+            mixRemoteEdges(*route, routing, state, view.passSamples, route->edges.empty(),
+                           recieveLevel, activeEdges, silentSkips);
+            mixRoute(*route, state, view, 1, view.passSamples, sameBlockEdges == 0, recieveLevel,
+                     activeEdges, silentSkips);
+            mStatistics.samplesRouted.add(activeEdges * 2 * (uint64_t)view.passSamples);
+            activeEdges = 0;
+        }
+    }
+
+    const size_t blockSize = (size_t)buffer.getNumSamples();
+    if(route != nullptr && sameBlockEdges > 0)
+    {
+        mixRoute(*route, state, view, 0, blockSize, true, recieveLevel, activeEdges, silentSkips);
+        mStatistics.samplesRouted.add(activeEdges * 2 * (uint64_t)blockSize);
+    }
+
+    mStatistics.silentSkips.add(silentSkips);
+    mPassPins.unpin(state.pin);
+
+    // with a routing quantum one pass is read over several blocks
+    const int numberOfSamples = juce::jmin(buffer.getNumSamples(),
+                                           state.buffer.getNumSamples() - state.position);
+    for (int ch = 0; ch < 2 && numberOfSamples > 0; ch++)
+    {
+        if constexpr (std::is_same_v<SampleType, RoutingSample>)
+            buffer.addFrom(ch, 0, state.buffer.getReadPointer(ch, state.position), numberOfSamples);
+        else
+            kernels::addConverted(buffer.getWritePointer(ch),
+                                  state.buffer.getReadPointer(ch, state.position),
+                                  (size_t)numberOfSamples);
+    }
+    state.position += juce::jmax(0, numberOfSamples);
+
+    return view.epoch;
+}
+
+template uint64_t Core::recieveForThisBlock(Instance&, juce::AudioBuffer<float>&);
+template uint64_t Core::recieveForThisBlock(Instance&, juce::AudioBuffer<double>&);
+
+void Core::stamp(ProcessingStamp& processingStamp, uint64_t epoch)
+{
+    ProcessingStamp::Entry& entry = processingStamp.entries[epoch & 1];
+    entry.position.store(mNextPosition.fetch_add(1, std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+    entry.thread.store(juce::Thread::getCurrentThreadId(), std::memory_order_relaxed);
+    entry.epoch.store(epoch, std::memory_order_release);
+}
+
+uint64_t Core::getOrderSignature()
+{
+    // The order of the last epoch, the current one may still be going on.
+    // The same whatever order the maps are in, it changes with the order or
+    // thread of any instance.
+    const uint64_t epoch = getEpoch() - 1;
+    std::vector<std::tuple<uint64_t, juce::Uuid, juce::Thread::ThreadID>> stamped;
+    const auto add = [&stamped, epoch](const juce::Uuid& id, const ProcessingStamp& processingStamp)
+    {
+        const ProcessingStamp::Entry& entry = processingStamp.of(epoch);
+        if(entry.epoch.load(std::memory_order_acquire) != epoch) return;
+
+        stamped.emplace_back(entry.position.load(std::memory_order_relaxed), id,
+                             entry.thread.load(std::memory_order_relaxed));
+    };
+
+    for(auto& bufferkv : mBuffers)
+        add(bufferkv.first, bufferkv.second->stamp);
+    for(auto& statekv : mRecieverStates)
+        add(statekv.first, statekv.second->stamp);
+    std::sort(stamped.begin(), stamped.end(),
+              [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+
+    uint64_t signature = 0;
+    for(const auto& [position, id, thread] : stamped)
+        signature = signature * 0x9e3779b97f4a7c15ull
+                    + (std::hash<juce::Uuid>{}(id) ^ std::hash<juce::Thread::ThreadID>{}(thread));
+    return signature;
+}
+
+void Core::applyConnectionEdits(const std::vector<ConnectionEdit>& edits)
+{
+    // the parameters are atomics, only the rebuild needs the lock
+    for(const ConnectionEdit& edit : edits)
+    {
+        if(!edit.on.has_value() && !edit.gain.has_value()) continue;
+
+        ConnectionParameters* params = getOrCreateConnectionParameters(edit.transmitter, edit.reciever);
+        if(params == nullptr) continue;
+
+        if(edit.on.has_value())
+            params->on.setValue(edit.on.value());
+        if(edit.gain.has_value())
+            params->gain.setValue(edit.gain.value());
+    }
+
+    connectionsChanged();
+}
+
+void Core::connectionsChanged()
+{
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+        rebuildRoutes();
+    }
+
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void Core::rebuildRoutes()
+{
+    MY_TRACE_SCOPE("Core::rebuildRoutes");
+
+    // the routes the audio threads may still use, what they carry over is
+    // taken from there
+    const Routing& previous = *mRouting.load(std::memory_order_relaxed);
+    const int bufferSize = getRoutingBufferSize();
+    auto routing = std::make_unique<Routing>();
+    routing->sharedRouting = mSharedRouting;
+    for(auto& bufferkv : mBuffers)
+        routing->sources.emplace(bufferkv.first,
+                                 Routing::Source{ bufferkv.second,
+                                                  mSharedRouting != nullptr ? bufferkv.second->sharedSlot : -1,
+                                                  isBus(bufferkv.first) });
+    routing->recievers = mRecieverStates;
+
+    // what the new routes do not carry over is detached once they are
+    // published, after the new edges attached, so the rings they keep
+    // reading never pause
+    const auto publish = [this, &previous](std::unique_ptr<Routing> next, uint64_t sameBlockEdges)
+    {
+        std::unordered_set<const RemoteState*> carried;
+        for(const Route& route : next->routes)
+            for(const RemoteEdge& edge : route.remoteEdges)
+                carried.insert(edge.state.get());
+
+        const std::shared_ptr<SharedRouting> previousSharedRouting = previous.sharedRouting;
+        std::vector<std::pair<int, uint64_t>> attachments;
+        for(const Route& route : previous.routes)
+            for(const RemoteEdge& edge : route.remoteEdges)
+                if(!carried.contains(edge.state.get()))
+                    attachments.emplace_back(edge.slot, edge.state->attachment);
+
+        mStatistics.sameBlockEdges.set(sameBlockEdges);
+        publishRouting(std::move(next));
+
+        if(previousSharedRouting != nullptr)
+            for(const auto& [slot, attachment] : attachments)
+                previousSharedRouting->detach(slot, attachment);
+    };
+
+    // nothing may point into the connections while they are being loaded, the last
+    // endBulkLoad does the one rebuild that counts
+    if(mBulkLoadDepth > 0)
+    {
+        publish(std::move(routing), 0);
+        return;
+    }
+
+    if(mSharedRouting != nullptr)
+        mSharedRoutingVersion = mSharedRouting->getVersion();
+
+    // the buses first, the routes point into them
+    uint64_t unroutedConnections = 0;
+    for(const Connection& connection : mConnections)
+    {
+        ConnectionParameters* params = connection.parameters;
+        if(!params->on.getValue())
+        {
+            params->level.clear();
+            unroutedConnections++;
+            continue;
+        }
+        if(!isBus(connection.key.reciever)) continue;
+
+        auto buffer = mBuffers.find(connection.key.transmitter);
+        auto bus = mBuffers.find(connection.key.reciever);
+        if(buffer == mBuffers.end() || bus == mBuffers.end()) continue;
+
+        auto [index, isNew] = routing->busRouteIndices.try_emplace(bus->first, routing->busRoutes.size());
+        if(isNew)
+            routing->busRoutes.push_back({ bus->second.get(), {} });
+        const int numberOfChannels = juce::jmin(buffer->second->transit[0].samples.getNumChannels(),
+                                                bus->second->transit[0].samples.getNumChannels());
+        routing->busRoutes[index->second].inputs.push_back({ buffer->first, buffer->second.get(), params,
+                                                             &getBlockMixer(numberOfChannels),
+                                                             numberOfChannels });
+    }
+
+    const auto routeOf = [&routing](const juce::Uuid& reciever, RecieverState* state) -> Route&
+    {
+        auto [index, isNew] = routing->routeIndices.try_emplace(reciever, routing->routes.size());
+        if(isNew)
+            routing->routes.push_back({ reciever, state, {}, {} });
+        return routing->routes[index->second];
+    };
+
+    uint64_t sameBlockEdges = 0;
+    for(const Connection& connection : mConnections)
+    {
+        ConnectionParameters* params = connection.parameters;
+        if(!params->on.getValue() || isBus(connection.key.reciever)) continue;
+
+        auto reciever = mRecieverStates.find(connection.key.reciever);
+        if(reciever == mRecieverStates.end()) continue;
+
+        auto previousRoute = previous.routeIndices.find(reciever->first);
+        const Route* previousEdges = previousRoute != previous.routeIndices.end()
+            ? &previous.routes[previousRoute->second]
+            : nullptr;
+
+        auto buffer = mBuffers.find(connection.key.transmitter);
+        if(buffer == mBuffers.end())
+        {
+            // a transmitter of another process, or of none at the moment
+            const int slot = mSharedRouting != nullptr
+                ? mSharedRouting->findTransmitter(connection.key.transmitter)
+                : -1;
+            if(slot < 0) continue;
+
+            RemoteEdge edge{ connection.key.transmitter, slot, params, nullptr };
+            if(previousEdges != nullptr && previous.sharedRouting == mSharedRouting)
+                for(const RemoteEdge& previousEdge : previousEdges->remoteEdges)
+                    if(previousEdge.transmitter == edge.transmitter && previousEdge.slot == slot
+                       && previousEdge.state->bufferSize == bufferSize)
+                        edge.state = previousEdge.state;
+
+            if(edge.state == nullptr)
+            {
+                edge.state = std::make_shared<RemoteState>();
+                edge.state->attachment = mSharedRouting->attach(slot, connection.key.transmitter);
+                edge.state->bufferSize = bufferSize;
+                edge.state->compensator.prepare((size_t)bufferSize);
+            }
+
+            routeOf(reciever->first, reciever->second.get()).remoteEdges.push_back(std::move(edge));
+            continue;
+        }
+
+        // an input-less bus is never summed and stays silent
+        const BusRoute* bus = nullptr;
+        if(auto busRoute = routing->busRouteIndices.find(buffer->first);
+           busRoute != routing->busRouteIndices.end())
+            bus = &routing->busRoutes[busRoute->second];
+
+        const int numberOfChannels = juce::jmin(buffer->second->transit[0].samples.getNumChannels(),
+                                                reciever->second->buffer.getNumChannels());
+        RouteEdge edge{ buffer->first, buffer->second.get(), bus, params,
+                        &getBlockMixer(numberOfChannels), numberOfChannels, nullptr };
+        if(previousEdges != nullptr)
+            for(const RouteEdge& previousEdge : previousEdges->edges)
+                if(previousEdge.transmitter == buffer->first)
+                    edge.delivery = previousEdge.delivery;
+        if(edge.delivery == nullptr)
+            edge.delivery = std::make_shared<Delivery>();
+
+        if(edge.delivery->latency == 0)
+            sameBlockEdges++;
+        routeOf(reciever->first, reciever->second.get()).edges.push_back(std::move(edge));
+    }
+
+    // summed in the order described at Route, not in the order the
+    // connections were made
+    const auto byTransmitter = [](const auto& a, const auto& b) { return a.transmitter < b.transmitter; };
+    for(auto& route : routing->routes)
+    {
+        std::sort(route.edges.begin(), route.edges.end(), byTransmitter);
+        std::sort(route.remoteEdges.begin(), route.remoteEdges.end(), byTransmitter);
+    }
+    for(auto& busRoute : routing->busRoutes)
+        std::sort(busRoute.inputs.begin(), busRoute.inputs.end(), byTransmitter);
+
+    routing->unroutedConnections = unroutedConnections;
+    publish(std::move(routing), sameBlockEdges);
+
+    findFeedbackLoops();
+}
+
+void Core::publishRouting(std::unique_ptr<Routing> routing)
+{
+    // the audio threads move over with their next call, the snapshot they
+    // used before is freed once none of them does anymore
+    mRetiredRoutings.emplace_back(mRouting.exchange(routing.release(), std::memory_order_seq_cst));
+    reclaimRoutings();
+}
+
+void Core::reclaimRoutings()
+{
+    if(mRetiredRoutings.empty()) return;
+
+    // after they were retired, see ScopedRoutingPin
+    std::vector<const void*> pinned;
+    for(auto* instanceList : {&mBypassedInstances, &mRecieverInstances, &mTransmitterInstances})
+        for(auto& instkv : *instanceList)
+            if(const void* hazard = instkv.second->getRoutingHazard(InstanceAccessToken{})
+                                        .load(std::memory_order_seq_cst))
+                pinned.push_back(hazard);
+
+    // oldest first, what one of them let go of the ones before it may still use
+    size_t freed = 0;
+    for(; freed < mRetiredRoutings.size(); freed++)
+    {
+        Routing& routing = *mRetiredRoutings[freed];
+        if(std::find(pinned.begin(), pinned.end(), &routing) != pinned.end()) break;
+
+        for(ConnectionParameters* params : routing.releasedParameters)
+            mParameterStore.release(params);
+        if(routing.sharedRouting != nullptr)
+            for(int slot : routing.withdrawnSlots)
+                routing.sharedRouting->withdraw(slot);
+    }
+
+    mRetiredRoutings.erase(mRetiredRoutings.begin(), mRetiredRoutings.begin() + (std::ptrdiff_t)freed);
+}
+
+size_t Core::getGraphNode(const juce::Uuid& id)
+{
+    auto [node, isNew] = mGraphNodes.try_emplace(id, mGraph.getNumberOfNodes());
+    if(isNew && !mFreeGraphNodes.empty())
+    {
+        node->second = mFreeGraphNodes.back();
+        mFreeGraphNodes.pop_back();
+    }
+    mGraph.resize(node->second + 1);
+    return node->second;
+}
+
+void Core::findFeedbackLoops()
+{
+    MY_TRACE_SCOPE("Core::findFeedbackLoops");
+    const juce::ScopedLock lock(mLoopLock);
+
+    // gains edited before this are in the edges below
+    mCheckedParameterSequence = parameterSequence.load(std::memory_order_acquire);
+
+    std::vector<RoutingGraph::Edge> edges;
+    mLoopEdges.clear();
+    const auto add = [&](const juce::Uuid& transmitter, const juce::Uuid& reciever,
+                         ConnectionParameters* params, bool toBus)
+    {
+        const LoopEdge edge{ getGraphNode(transmitter), getGraphNode(reciever), params,
+                             getLoopEdgeGain(*params), toBus };
+        edges.push_back({ edge.from, edge.to, edge.gain });
+        mLoopEdges.insert_or_assign({ transmitter, reciever }, edge);
+    };
+
+    // buses are in mBuffers, so they are among the transmitters already
+    const Routing& routing = *mRouting.load(std::memory_order_relaxed);
+    for(auto& indexkv : routing.busRouteIndices)
+        for(auto& input : routing.busRoutes[indexkv.second].inputs)
+            add(input.transmitter, indexkv.first, input.parameters, true);
+
+    for(auto& route : routing.routes)
+        for(auto& edge : route.edges)
+            add(edge.transmitter, route.reciever, edge.parameters, false);
+
+    // as last guessed, see updateHostLinks
+    for(const auto& [reciever, transmitter] : mHostLinks)
+        if(routing.routeIndices.contains(reciever) && mBuffers.contains(transmitter))
+            edges.push_back({ getGraphNode(reciever), getGraphNode(transmitter), 1.f });
+
+    mGraph.setEdges(std::move(edges));
+
+    // nodes of what is gone have no edges left and are handed out again
+    for(auto it = mGraphNodes.begin(); it != mGraphNodes.end();)
+    {
+        if(mBuffers.contains(it->first) || routing.routeIndices.contains(it->first))
+        {
+            ++it;
+            continue;
+        }
+
+        mFreeGraphNodes.push_back(it->second);
+        it = mGraphNodes.erase(it);
+    }
+
+    protectLoops();
+}
+
+void Core::updateLoopGains()
+{
+    const juce::ScopedLock lock(mLoopLock);
+
+    const uint64_t sequence = parameterSequence.load(std::memory_order_acquire);
+    if(sequence == mCheckedParameterSequence) return;
+    mCheckedParameterSequence = sequence;
+
+    // the graph drops the loop gain of the components of these only
+    bool changed = false;
+    for(auto& loopkv : mLoopEdges)
+    {
+        LoopEdge& edge = loopkv.second;
+        const float gain = getLoopEdgeGain(*edge.parameters);
+        if(gain == edge.gain) continue;
+
+        edge.gain = gain;
+        mGraph.addEdge(edge.from, edge.to, gain);
+        changed = true;
+    }
+
+    if(changed)
+        protectLoops();
+}
+
+void Core::updateHostLinks()
+{
+    MY_TRACE_SCOPE("Core::updateHostLinks");
+
+    struct Stamped
+    {
+        uint64_t position;
+        juce::Thread::ThreadID thread;
+        juce::Uuid id;
+    };
+    const auto byPosition = [](const Stamped& a, const Stamped& b) { return a.position < b.position; };
+
+    // only held for reading, so the instances go on exchanging blocks
+    const juce::ScopedReadLock lock(mBufferOperation);
+    const Routing& routing = *mRouting.load(std::memory_order_relaxed);
+
+    // the last epoch, every instance that processed in it stamped it already
+    const uint64_t epoch = getEpoch() - 1;
+    const auto read = [epoch](const ProcessingStamp& processingStamp, const juce::Uuid& id,
+                              Stamped& stamped)
+    {
+        const ProcessingStamp::Entry& entry = processingStamp.of(epoch);
+        if(entry.epoch.load(std::memory_order_acquire) != epoch) return false;
+
+        stamped = { entry.position.load(std::memory_order_relaxed),
+                    entry.thread.load(std::memory_order_relaxed), id };
+        return true;
+    };
+
+    std::vector<Stamped> transmitters;
+    transmitters.reserve(mBuffers.size());
+    for(auto& bufferkv : mBuffers)
+        if(Stamped stamped; read(bufferkv.second->stamp, bufferkv.first, stamped))
+            transmitters.push_back(stamped);
+    std::sort(transmitters.begin(), transmitters.end(), byPosition);
+
+    // The host does not tell us how its channels are wired, this is a
+    // guess: a transmitter processed right after a reciever on the same
+    // thread most likely sits behind it in the same channel. A wrong guess
+    // only marks more connections as part of a loop, so does a stamp that
+    // was written while it was read.
+    std::vector<std::pair<juce::Uuid, juce::Uuid>> links;
+    for(auto& route : routing.routes)
+    {
+        Stamped reciever;
+        if(!read(route.state->stamp, route.reciever, reciever)) continue;
+
+        const Stamped next{ reciever.position + 1, {}, {} };
+        const auto it = std::lower_bound(transmitters.begin(), transmitters.end(), next,
+                                         byPosition);
+        if(it != transmitters.end() && it->position == next.position && it->thread == reciever.thread)
+            links.emplace_back(reciever.id, it->id);
+    }
+    std::sort(links.begin(), links.end());
+
+    const juce::ScopedLock loopLock(mLoopLock);
+    if(links == mHostLinks) return;
+
+    for(const auto& link : mHostLinks)
+    {
+        if(std::binary_search(links.begin(), links.end(), link)) continue;
+
+        const auto from = mGraphNodes.find(link.first);
+        const auto to = mGraphNodes.find(link.second);
+        if(from != mGraphNodes.end() && to != mGraphNodes.end())
+            mGraph.removeEdge(from->second, to->second);
+    }
+    for(const auto& link : links)
+        mGraph.addEdge(getGraphNode(link.first), getGraphNode(link.second), 1.f);
+
+    mHostLinks = std::move(links);
+    protectLoops();
+}
+
+void Core::protectLoops()
+{
+    const bool shouldProtect = mLoopProtection.load(std::memory_order_relaxed);
+    double worstLoopGain = 0.0;
+    std::unordered_set<ConnectionKey, ConnectionKeyHash> protectedConnections;
+
+    for(auto& loopkv : mLoopEdges)
+    {
+        const ConnectionKey& key = loopkv.first;
+        const LoopEdge& edge = loopkv.second;
+        ConnectionParameters& params = *edge.parameters;
+
+        const double loopGain = mGraph.isOnLoop(edge.from, edge.to)
+            ? mGraph.getLoopGain(mGraph.getComponent(edge.from))
+            : 0.0;
+        worstLoopGain = juce::jmax(worstLoopGain, loopGain);
+
+        const bool wasProtected = mProtectedConnections.contains(key);
+        if(shouldProtect && loopGain > maxStableLoopGain)
+        {
+            // protection the user set is left alone, later as well
+            if(params.protection.getValue() == OverdriveProtection::off)
+                params.protection.setValue(OverdriveProtection::clip);
+            else if(!wasProtected)
+                continue;
+            protectedConnections.insert(key);
+        }
+        else if(wasProtected && params.protection.getValue() == OverdriveProtection::clip)
+        {
+            params.protection.setValue(OverdriveProtection::off);
+        }
+    }
+
+    // connections that are gone or off cannot feed back, what they were set
+    // to is kept with them
+    mProtectedConnections = std::move(protectedConnections);
+    mWorstLoopGain.store(worstLoopGain, std::memory_order_relaxed);
+}
+
+void Core::setLoopProtection(bool shouldProtect)
+{
+    const juce::ScopedLock lock(mLoopLock);
+    mLoopProtection = shouldProtect;
+    protectLoops();
+}
+
+void Core::assignLatencies(const Route& route, RecieverState& state, uint64_t epoch)
+{
+    // once per epoch, looks at the one before it
+    state.latencyEpoch = epoch;
+    const ProcessingStamp::Entry& recieverStamp = state.stamp.of(epoch);
+    const bool mayBeInOrder = getRoutingQuantum() == 0 && !isOffline();
+    bool changed = false;
+    uint64_t sameBlockEdges = 0;
+
+    for(const RouteEdge& edge : route.edges)
+    {
+        Delivery& delivery = *edge.delivery;
+
+        // Of the connections that form a feedback loop at least one goes
+        // backwards in this order, that one keeps the block of latency.
+        // Different threads may run in any order, so they never qualify.
+        // Neither does anything while routing in a quantum or offline, nor
+        // a bus.
+        const bool inOrder = mayBeInOrder && edge.bus == nullptr
+            && delivery.orderedEpoch != 0 && delivery.orderedEpoch + 1 == epoch;
+        if(!inOrder)
+        {
+            delivery.stableEpochs = 0;
+            if(delivery.latency == 0)
+            {
+                delivery.latency = 1;
+                changed = true;
+            }
+        }
+        else if(delivery.latency == 1 && ++delivery.stableEpochs >= sameBlockHysteresis)
+        {
+            delivery.latency = 0;
+            delivery.transition = Delivery::Transition::crossfade;
+            changed = true;
+        }
+
+        // whether the transmitter came first in this epoch, for the next one
+        const ProcessingStamp::Entry& transmitterStamp = edge.source->stamp.of(epoch);
+        if(transmitterStamp.epoch.load(std::memory_order_acquire) == epoch
+           && transmitterStamp.thread.load(std::memory_order_relaxed)
+                  == recieverStamp.thread.load(std::memory_order_relaxed)
+           && transmitterStamp.position.load(std::memory_order_relaxed)
+                  < recieverStamp.position.load(std::memory_order_relaxed))
+            delivery.orderedEpoch = epoch;
+
+        if(delivery.latency == 0)
+            sameBlockEdges++;
+    }
+
+    state.sameBlockEdges.store(sameBlockEdges, std::memory_order_relaxed);
+    if(changed)
+        mOrderChanged.store(true, std::memory_order_release);
+}
+
+int Core::getConnectionLatency(juce::Uuid transmitter, juce::Uuid reciever)
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+    const Routing& routing = *mRouting.load(std::memory_order_relaxed);
+
+    // summed in the pass that delivers the bus, the latency of the whole
+    // path is that of the connection from the bus
+    auto busIt = routing.busRouteIndices.find(reciever);
+    if(busIt != routing.busRouteIndices.end())
+    {
+        for(const BusInput& input : routing.busRoutes[busIt->second].inputs)
+            if(input.transmitter == transmitter)
+                return input.parameters->on.getValue() ? 0 : -1;
+        return -1;
+    }
+
+    auto it = routing.routeIndices.find(reciever);
+    if(it == routing.routeIndices.end()) return -1;
+
+    for(const RouteEdge& edge : routing.routes[it->second].edges)
+        if(edge.transmitter == transmitter)
+            return edge.parameters->on.getValue() ? edge.delivery->latency.load() : -1;
+
+    return -1;
+}
+
+double Core::getLoopGain(juce::Uuid transmitter, juce::Uuid reciever)
+{
+    const juce::ScopedLock lock(mLoopLock);
+
+    const auto from = mGraphNodes.find(transmitter);
+    const auto to = mGraphNodes.find(reciever);
+    if(from == mGraphNodes.end() || to == mGraphNodes.end()
+       || !mGraph.isOnLoop(from->second, to->second))
+        return 0.0;
+
+    return mGraph.getLoopGain(mGraph.getComponent(from->second));
+}
+
+bool Core::isInFeedbackLoop(juce::Uuid transmitter, juce::Uuid reciever)
+{
+    const juce::ScopedLock lock(mLoopLock);
+
+    // connections into a bus are summed before anything is delivered
+    const auto it = mLoopEdges.find({ transmitter, reciever });
+    return it != mLoopEdges.end()
+        && !it->second.toBus
+        && mGraph.isOnLoop(it->second.from, it->second.to);
+}
+
+void Core::addPendingConnection(const juce::Uuid& owner, const ConnectionRecord& record)
+{
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    auto& pendingConnections = mPendingConnections[record.peer];
+
+    // restoring the same owner again replaces what it left before
+    for(PendingConnection& pending : pendingConnections)
+    {
+        if(pending.owner == owner)
+        {
+            pending.record = record;
+            return;
+        }
+    }
+
+    pendingConnections.push_back({ owner, record });
+}
+
+std::vector<ConnectionRecord> Core::getPendingConnectionsOf(const juce::Uuid& owner)
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+
+    std::vector<ConnectionRecord> records;
+    for(auto& pendingkv : mPendingConnections)
+        for(const PendingConnection& pending : pendingkv.second)
+            if(pending.owner == owner)
+                records.push_back(pending.record);
+    return records;
+}
+
+void Core::removePendingConnectionsOf(const juce::Uuid& owner)
+{
+    for(auto it = mPendingConnections.begin(); it != mPendingConnections.end();)
+    {
+        auto& pendingConnections = it->second;
+        pendingConnections.erase(std::remove_if(pendingConnections.begin(), pendingConnections.end(),
+                                                [&owner](const PendingConnection& pending)
+                                                { return pending.owner == owner; }),
+                                 pendingConnections.end());
+        it = pendingConnections.empty() ? mPendingConnections.erase(it) : std::next(it);
+    }
+}
+
+size_t Core::getNumberOfPendingConnections()
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+
+    size_t numberOfPendingConnections = 0;
+    for(auto& pendingkv : mPendingConnections)
+        numberOfPendingConnections += pendingkv.second.size();
+    return numberOfPendingConnections;
+}
+
+void Core::resolvePendingConnections(Instance* peer)
+{
+    const Mode mode = peer->getMode();
+    if(mode == Mode::bypass) return;
+
+    auto it = mPendingConnections.find(peer->getId());
+    if(it == mPendingConnections.end()) return;
+
+    // owners that are gone or not in the opposite mode anymore are dropped
+    for(const PendingConnection& pending : it->second)
+    {
+        ConnectionParameters* params = mode == Mode::transmit
+            ? createConnection({ peer->getId(), pending.owner })
+            : createConnection({ pending.owner, peer->getId() });
+        if(params == nullptr) continue;
+
+        pending.record.applyTo(*params);
+    }
+
+    mPendingConnections.erase(it);
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void Core::resolveRemotePendingConnections()
+{
+    for(auto it = mPendingConnections.begin(); it != mPendingConnections.end();)
+    {
+        if(!isRemoteTransmitter(it->first))
+        {
+            ++it;
+            continue;
+        }
+
+        for(const PendingConnection& pending : it->second)
+            if(ConnectionParameters* params = createConnection({ it->first, pending.owner }))
+                pending.record.applyTo(*params);
+
+        it = mPendingConnections.erase(it);
+        mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+void Core::checkSharedRoutingVersion()
+{
+    {
+        const juce::ScopedReadLock lock(mBufferOperation);
+        if(mSharedRouting == nullptr || mSharedRouting->getVersion() == mSharedRoutingVersion)
+            return;
+    }
+
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+        publishTransmitters();
+        resolveRemotePendingConnections();
+        rebuildRoutes();
+    }
+
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+    topologyChanged();
+}
+
+void Core::publishTransmitters()
+{
+    if(mSharedRouting == nullptr) return;
+
+    for(auto& instkv : mTransmitterInstances)
+    {
+        Buffer& buffer = *mBuffers[instkv.first];
+        if(buffer.sharedSlot < 0)
+            buffer.sharedSlot = mSharedRouting->publish(instkv.first, instkv.second->getName());
+    }
+}
+
+size_t Core::getNumberOfUnsharedTransmitters()
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+    if(mSharedRouting == nullptr) return 0;
+
+    size_t unshared = 0;
+    for(auto& instkv : mTransmitterInstances)
+        if(auto buffer = mBuffers.find(instkv.first);
+           buffer != mBuffers.end() && buffer->second->sharedSlot < 0)
+            unshared++;
+
+    return unshared;
+}
+
+juce::String Core::getSharedRoutingName(const juce::String& domain)
+{
+    return domain == defaultDomain
+        ? juce::String(defaultSharedRoutingName)
+        : juce::String(defaultSharedRoutingName) + "-" + domain;
+}
+
+bool Core::enableSharedRouting(const juce::String& requestedName)
+{
+    const juce::String name = requestedName.isEmpty() ? getSharedRoutingName(mDomainName)
+                                                      : requestedName;
+    if(mSharedRouting != nullptr && name == mSharedRoutingName) return true;
+    disableSharedRouting();
+
+    auto sharedRouting = SharedRouting::open(name);
+    if(sharedRouting == nullptr) return false;
+
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+        mSharedRouting = std::move(sharedRouting);
+        mSharedRoutingName = name;
+        publishTransmitters();
+
+        resolveRemotePendingConnections();
+        rebuildRoutes();
+    }
+
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+    topologyChanged();
+    return true;
+}
+
+void Core::disableSharedRouting()
+{
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+        if(mSharedRouting == nullptr) return;
+
+        // withdrawn once no audio thread writes to them anymore
+        std::vector<int>& withdrawnSlots = mRouting.load(std::memory_order_relaxed)->withdrawnSlots;
+        for(auto& bufferkv : mBuffers)
+        {
+            if(bufferkv.second->sharedSlot >= 0)
+                withdrawnSlots.push_back(bufferkv.second->sharedSlot);
+            bufferkv.second->sharedSlot = -1;
+        }
+
+        // connections to other processes stay, they come back with it. The
+        // segment is removed if no other process has it open.
+        mSharedRouting.reset();
+        mSharedRoutingName = {};
+        rebuildRoutes();
+    }
+
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+    topologyChanged();
+}
+
+Map<juce::String> Core::getRemoteTransmitters()
+{
+    Map<juce::String> transmitters;
+    if(mSharedRouting == nullptr) return transmitters;
+
+    for(const SharedRouting::Transmitter& transmitter : mSharedRouting->getTransmitters())
+        if(!mTransmitterInstances.contains(transmitter.id))
+            transmitters.emplace(transmitter.id, transmitter.name);
+
+    return transmitters;
+}
+
+bool Core::isRemoteTransmitter(const juce::Uuid& id)
+{
+    return mSharedRouting != nullptr
+        && !mTransmitterInstances.contains(id)
+        && mSharedRouting->findTransmitter(id) >= 0;
+}
+
+void Core::beginBulkLoad()
+{
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    if(mBulkLoadDepth++ == 0)
+        rebuildRoutes();
+}
+
+void Core::endBulkLoad()
+{
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+        jassert(mBulkLoadDepth > 0);
+        if(mBulkLoadDepth == 0 || --mBulkLoadDepth > 0) return;
+        rebuildRoutes();
+    }
+
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+    topologyChanged();
+}
+
+void Core::stateRestoreStarted()
+{
+    // silencing every reciever until the message thread runs is only fine
+    // before the session plays
+    if(isPlaying()) return;
+    if(mRestoringState.exchange(true)) return;
+
+    beginBulkLoad();
+    triggerAsyncUpdate();
+}
+
+bool Core::isPlaying() const
+{
+    const juce::uint32 lastPass = mLastPassTime.load(std::memory_order_relaxed);
+    return lastPass != 0 && juce::Time::getMillisecondCounter() - lastPass < playingTimeout;
+}
+
+void Core::handleAsyncUpdate()
+{
+    if(mRestoringState.exchange(false))
+        endBulkLoad();
+}
+
+void Core::timerCallback()
+{
+    checkSharedRoutingVersion();
+
+    // the order the host processes in or the gains changed, so may have the
+    // loops
+    bool orderChanged = mOrderChanged.exchange(false, std::memory_order_acq_rel);
+    {
+        const juce::ScopedReadLock lock(mBufferOperation);
+        const uint64_t orderSignature = getOrderSignature();
+        orderChanged = orderChanged || orderSignature != mOrderSignature;
+        mOrderSignature = orderSignature;
+    }
+    if(orderChanged)
+        updateHostLinks();
+    updateLoopGains();
+
+    // snapshots an audio thread still used when they were replaced
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    reclaimRoutings();
+}
+
+bool Core::checkForUuidMatch(const juce::Uuid& id)
+{
+    if(mBypassedInstances.contains(id)) return true;
+    if(mTransmitterInstances.contains(id)) return true;
+    if(mRecieverInstances.contains(id)) return true;
+    if(mBuses.contains(id)) return true;
+
+    return false;
+}
+
+juce::Uuid Core::addBus(const juce::String& name, juce::Uuid id)
+{
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    if(isBus(id)) return id;
+
+    while(checkForUuidMatch(id))
+        id = juce::Uuid{};
+
+    mBuses.emplace(id, name);
+    mBuffers.insert_or_assign(id, createBuffer());
+    topologyChanged();
+    return id;
+}
+
+void Core::removeBus(const juce::Uuid& id)
+{
+    {
+        const juce::ScopedWriteLock lock(mBufferOperation);
+        if(!isBus(id)) return;
+
+        removeConnectionsOf(id);
+        mBuses.erase(id);
+        mBuffers.erase(id);
+        rebuildRoutes();
+    }
+
+    mConnectionListVersion.fetch_add(1, std::memory_order_acq_rel);
+    topologyChanged();
+}
+
+ConnectionParameters* Core::getConnectionParameters(juce::Uuid transmitter, juce::Uuid reciever)
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+    auto it = mConnectionIndices.find({ transmitter, reciever });
+    if(it == mConnectionIndices.end()) return nullptr;
+    return mConnections[it->second].parameters;
+}
+
+ConnectionParameters* Core::getOrCreateConnectionParameters(juce::Uuid transmitter, juce::Uuid reciever)
+{
+    if(ConnectionParameters* params = getConnectionParameters(transmitter, reciever))
+        return params;
+
+    const juce::ScopedWriteLock lock(mBufferOperation);
+    return createConnection({ transmitter, reciever });
+}
+
+ConnectionParameters* Core::createConnection(const ConnectionKey& key)
+{
+    const bool fromBus = isBus(key.transmitter);
+    const bool toBus = isBus(key.reciever);
+    if(fromBus && toBus) return nullptr;
+    // buses are summed before the rings of other processes are read
+    const bool fromRemote = !fromBus && isRemoteTransmitter(key.transmitter);
+    if(fromRemote && toBus) return nullptr;
+    if(!fromBus && !fromRemote && !mTransmitterInstances.contains(key.transmitter)) return nullptr;
+    if(!toBus && !mRecieverInstances.contains(key.reciever)) return nullptr;
+
+    auto [it, isNew] = mConnectionIndices.try_emplace(key, mConnections.size());
+    if(!isNew) return mConnections[it->second].parameters;
+
+    mConnections.push_back({ key, mParameterStore.allocate() });
+
+    // editors may hold a nullptr for this pair
+    topologyChanged();
+    return mConnections.back().parameters;
+}
+
+void Core::removeConnectionsOf(const juce::Uuid& id)
+{
+    // the message thread must not touch the parameters once they are released
+    const juce::ScopedLock loopLock(mLoopLock);
+
+    for(size_t index = mConnections.size(); index-- > 0;)
+    {
+        const ConnectionKey key = mConnections[index].key;
+        if(key.transmitter != id && key.reciever != id) continue;
+
+        mLoopEdges.erase(key);
+        // the routes the audio threads use may still point to them
+        mRouting.load(std::memory_order_relaxed)->releasedParameters.push_back(mConnections[index].parameters);
+        mConnectionIndices.erase(key);
+
+        // the last one takes its place
+        if(index + 1 != mConnections.size())
+        {
+            mConnections[index] = mConnections.back();
+            mConnectionIndices[mConnections[index].key] = index;
+        }
+        mConnections.pop_back();
+    }
+}
+
+Instance* Core::findInstanceById(juce::Uuid id)
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+    for(auto* instancelist : {&mBypassedInstances, &mTransmitterInstances, &mRecieverInstances})
+    {
+        auto it = instancelist->find(id);
+        if(it != instancelist->end())
+            return it->second;
+    }
+    return nullptr;
+}
+
+std::vector<std::pair<juce::Uuid, InstanceStatistics::Snapshot>> Core::getInstanceStatistics()
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+    std::vector<std::pair<juce::Uuid, InstanceStatistics::Snapshot>> statistics;
+    statistics.reserve(mBypassedInstances.size()
+                       + mTransmitterInstances.size()
+                       + mRecieverInstances.size());
+
+    for (auto* instanceList : {&mBypassedInstances, &mTransmitterInstances, &mRecieverInstances})
+        for (auto& instkv : *instanceList)
+            statistics.emplace_back(instkv.first, instkv.second->getStatistics());
+
+    return statistics;
+}
+
+std::vector<ConnectionStatistics> Core::getConnectionStatistics()
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+    std::vector<ConnectionStatistics> statistics;
+
+    for(const Connection& connection : mConnections)
+    {
+        const ConnectionCost& cost = connection.parameters->cost;
+        const uint64_t blocks = cost.blocks.load(std::memory_order_relaxed);
+        if(blocks == 0) continue;
+
+        statistics.push_back({ connection.key.transmitter, connection.key.reciever,
+                               cost.ticks.load(std::memory_order_relaxed),
+                               cost.samples.load(std::memory_order_relaxed), blocks });
+    }
+
+    return statistics;
+}
+
+juce::String Core::getNameOf(const juce::Uuid& id)
+{
+    const juce::ScopedReadLock lock(mBufferOperation);
+
+    for (auto* instanceList : {&mBypassedInstances, &mTransmitterInstances, &mRecieverInstances})
+        if(auto it = instanceList->find(id); it != instanceList->end())
+            return it->second->getName();
+
+    if(auto it = mBuses.find(id); it != mBuses.end())
+        return it->second;
+
+    if(mSharedRouting != nullptr)
+        for(const SharedRouting::Transmitter& transmitter : mSharedRouting->getTransmitters())
+            if(transmitter.id == id)
+                return transmitter.name;
+
+    return {};
+}
+
+void Core::resetStatistics()
+{
+    // the counters are atomics, only the maps are read
+    const juce::ScopedReadLock lock(mBufferOperation);
+    mStatistics.reset();
+
+    for(const Connection& connection : mConnections)
+        connection.parameters->cost.clear();
+
+    for (auto* instanceList : {&mBypassedInstances, &mTransmitterInstances, &mRecieverInstances})
+        for (auto& instkv : *instanceList)
+            instkv.second->resetStatistics();
 }
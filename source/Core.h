@@ -1,103 +1,697 @@
-/*  This class should do all routing for all instances
+/*  This class should do all routing for all instances of a routing domain
 */
 
 #pragma once
 
+#include <array>
 #include <vector>
 #include <tuple>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <unordered_set>
 #include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_events/juce_events.h>
 
-#include "CircularArray.h"
-#include "Singleton.h"
 #include "Instance.h"
 #include "ConnectionParameters.h"
+#include "ParameterStore.h"
+#include "InstanceState.h"
+#include "RoutingGraph.h"
+#include "PerformanceCounters.h"
+#include "MixKernels.h"
+#include "SharedRouting.h"
+#include "DriftCompensator.h"
+#include "PassPins.h"
 
 namespace patch
 {
-    // there are way better methods to do this, but atm im just trying to get
-    // it to work somehow
-    struct MCCBuffer
-    // Multi Channel Circular Buffer
+    template<class T> using Map = std::unordered_map<juce::Uuid, T>;
+
+    struct ConnectionKey
     {
-    public:
-        inline void setSize(int numberOfChannels, int numberOfSamples)
-        {
-            mNumberOfChannels = numberOfChannels;
-            mNumberOfSamples = numberOfSamples;
+        juce::Uuid transmitter;
+        juce::Uuid reciever;
 
-            buffers.clear();
-            buffers.reserve((size_t)numberOfChannels);
-            for(size_t i = 0; i < (size_t)numberOfChannels; i++)
-            {
-                auto channel = std::make_unique<CircularArray<float>>(numberOfSamples);
-                buffers.push_back(std::move(channel));
-                buffers.back()->reset();
-            }
-        }
+        bool operator==(const ConnectionKey&) const = default;
+    };
 
-        inline CircularArray<float>* getChannel(int channelNumber) const
+    struct ConnectionKeyHash
+    {
+        size_t operator()(const ConnectionKey& key) const
         {
-            if (channelNumber >= mNumberOfChannels) return nullptr;
-            if (channelNumber < 0) return nullptr;
-
-            return buffers[(size_t)channelNumber].get();
+            const size_t transmitter = std::hash<juce::Uuid>{}(key.transmitter);
+            return transmitter ^ (std::hash<juce::Uuid>{}(key.reciever) + 0x9e3779b9
+                                  + (transmitter << 6) + (transmitter >> 2));
         }
-
-        inline int getNumberOfChannels() const { return mNumberOfChannels; }
-        inline int getNumberOfSamples() const { return mNumberOfSamples; }
-
-    private:
-        std::vector<std::unique_ptr<CircularArray<float>>> buffers;
-        int mNumberOfChannels;
-        int mNumberOfSamples;
     };
 
-    template<class T> using Map = std::unordered_map<juce::Uuid, T>;
-    using ParameterVector = Map<std::unique_ptr<ConnectionParameters>>;
-    using ParameterMatrix = Map<ParameterVector>;
+    // One change to one connection, fields that are not set stay as they are.
+    struct ConnectionEdit
+    {
+        juce::Uuid transmitter;
+        juce::Uuid reciever;
+        std::optional<bool> on;
+        std::optional<float> gain;
+    };
 
-    class Core : public Singleton<Core>
+    class Core
+        : private juce::AsyncUpdater
+        , private juce::Timer
     {
     public:
+        // Unrelated sessions in the same process are kept apart in routing
+        // domains. Every domain is a Core of its own, with its own instances,
+        // connections, buffers and locks, and instances only ever see the ones
+        // in theirs. A domain exists while anything holds on to it: the first
+        // getDomain of a name creates it, it is destroyed with the last
+        // reference. Any thread.
+        static std::shared_ptr<Core> getDomain(const juce::String& name);
+        // the names of the domains that exist, in no particular order
+        static std::vector<juce::String> getDomainNames();
+        static constexpr const char* defaultDomain = "Default";
+        const juce::String& getDomainName() const { return mDomainName; }
+
+        Core(const Core&) = delete;
+        Core& operator=(const Core&) = delete;
+        ~Core() override;
+
         void registerInstance(Instance* ptr);
         void tryDeleteInstance(juce::Uuid id);
 
         void prepareToPlay(double sampleRate, int samplesPerBlock);
-        void processRouting(int incomingSize);
+        // Starts the epoch after the given one, unless another thread got to
+        // it first. Returns whether this call did. Without a quantum the
+        // block of the instance that starts it counts for the length of the
+        // pass, like the blocks that were sent.
+        bool processRouting(Instance& starter, int incomingSize, uint64_t epoch);
         void releaseResources();
         void instanceSwitchedMode(Instance* ptr, Mode previousMode);
+        void instanceRenamed(Instance* ptr);
+
+        // Routes in passes of at least this many samples instead of once per
+        // host block. Small host blocks are collected until there are enough,
+        // so routing costs the same as with larger ones, and the latency is
+        // about the quantum instead of the largest block the host announced.
+        // Nothing is delivered in the same block then. 0 routes once per host
+        // block. Changing it drops what is on its way.
+        void setRoutingQuantum(int numberOfSamples);
+        int getRoutingQuantum() const { return mQuantum.load(std::memory_order_relaxed); }
+        // Hosts render offline faster than real time, often on several threads
+        // at once. While any instance renders offline, see
+        // Instance::setNonRealtime, the instances wait for each other instead
+        // of the first one moving on: the next epoch starts once every
+        // instance that took part in the last one processed its block in the
+        // current one, and every connection delivers with one block of
+        // latency. What is rendered does not depend on the order or the
+        // threads then. An instance that does not show up within
+        // maxOfflineWait seconds is not waited for until it does again.
+        bool isOffline() const { return mOffline.load(std::memory_order_acquire); }
+        void instanceSwitchedRenderMode(Instance* ptr);
+        // Called by an instance that is about to start the epoch after the
+        // given one, without any lock held. Returns false if it gave up.
+        bool waitForEpoch(Instance& instance, uint64_t epoch);
+        static constexpr double maxOfflineWait = 0.1;
+
+        // Samples the buffers of transmitters and recievers have to hold.
+        int getRoutingBufferSize() const { return mMaxBufferSize + getRoutingQuantum(); }
+
+        // Changing the routing holds this for writing, the queries below and
+        // editors walking the instance maps hold it for reading. The audio
+        // threads never take it: they route with a snapshot of the routing
+        // that is replaced, not changed, see Routing.
+        const juce::ReadWriteLock& getRoutingLock() const { return mBufferOperation; }
 
-        void bufferForNextBlock(juce::Uuid id, juce::AudioBuffer<float>& buffer);
+        // Called by the instances with their blocks, without any lock held.
+        // Blocks in the precision Core does not route in are converted on the
+        // way. Both return the epoch the block was processed in.
+        template<typename SampleType>
+        uint64_t bufferForNextBlock(Instance& transmitter, juce::AudioBuffer<SampleType>& buffer);
+        // Adds what the reciever gets to its block. Mixes in what the last
+        // routing pass delivers, once, and the connections that deliver
+        // within the same block.
+        template<typename SampleType>
+        uint64_t recieveForThisBlock(Instance& reciever, juce::AudioBuffer<SampleType>& buffer);
 
         Map<Instance*>* getRecievers() {return &mRecieverInstances;}
         Map<Instance*>* getTransmitters() {return &mTransmitterInstances;}
+
+        // Buses are mixing points without a plugin behind them. Transmitters
+        // connect to a bus as if it was a reciever and recievers as if it was
+        // a transmitter, so a group of T transmitters feeding R recievers is
+        // mixed T + R times instead of T x R. The sum reaches the recievers
+        // with the same block of latency a direct connection has. Buses do not
+        // connect to each other.
+        // Returns the id of the bus, an existing bus with that id is kept.
+        juce::Uuid addBus(const juce::String& name, juce::Uuid id = {});
+        void removeBus(const juce::Uuid& id);
+        bool isBus(const juce::Uuid& id) const { return mBuses.contains(id); }
+        // by id, the name of every bus
+        const Map<juce::String>* getBuses() const { return &mBuses; }
+
+        // Lets the instances of this process route to those of other processes
+        // that enabled it with the same name, see SharedRouting. Transmitters
+        // of other processes show up in getRemoteTransmitters and recievers
+        // connect to them like to the ones of this process, the connection is
+        // kept on the side of the reciever. It has about two blocks of latency,
+        // the clocks of the processes drifting apart are compensated, see
+        // DriftCompensator. Returns false if there is no shared memory.
+        // Enabling it again with another name moves over. Without a name the
+        // domains of the same name in every process are connected, see
+        // getSharedRoutingName. It is off until enabled, the instances save
+        // whether it was on for their domain.
+        bool enableSharedRouting(const juce::String& name = {});
+        void disableSharedRouting();
+        bool isSharedRoutingEnabled() const { return mSharedRouting != nullptr; }
+        // Transmitters that did not get one of the slots of the segment, they
+        // are published as soon as other processes free some.
+        size_t getNumberOfUnsharedTransmitters();
+        static constexpr const char* defaultSharedRoutingName = "patch-routing";
+        static juce::String getSharedRoutingName(const juce::String& domain);
+        // by id, the name of every transmitter of another process
+        Map<juce::String> getRemoteTransmitters();
+        bool isRemoteTransmitter(const juce::Uuid& id);
+
+        // nullptr if the connection was never turned on or edited, it has the
+        // default parameters then
         ConnectionParameters* getConnectionParameters(juce::Uuid transmitter, juce::Uuid reciever);
+        // Creates the connection if needed. nullptr if either instance is not
+        // in the right mode.
+        ConnectionParameters* getOrCreateConnectionParameters(juce::Uuid transmitter, juce::Uuid reciever);
+        size_t getNumberOfConnections() const { return mConnections.size(); }
         Instance* findInstanceById(juce::Uuid id);
-        void updateConnectionList(Mode mode);
+
+        // Applies all edits, then rebuilds the routing and notifies the editors
+        // once. Unknown connections are ignored.
+        void applyConnectionEdits(const std::vector<ConnectionEdit>& edits);
+        // Has to be called after connection parameters were changed directly.
+        // Rebuilds the routing and notifies the editors.
+        void connectionsChanged();
+
+        // Blocks of latency the connection currently has, 0 if the transmitter
+        // has reliably been processed before the reciever on the same thread
+        // and the signal is handed over in the same block, 1 otherwise. -1 if
+        // the connection is off or does not exist. Connections into a bus add
+        // none.
+        int getConnectionLatency(juce::Uuid transmitter, juce::Uuid reciever);
+        // Whether the connection is part of a feedback loop, i.e. the
+        // reciever feeds back into the transmitter through other connections
+        // and the order the host processes the instances in.
+        bool isInFeedbackLoop(juce::Uuid transmitter, juce::Uuid reciever);
+
+        // Feedback is allowed, but a loop whose gain is above this grows until
+        // it saturates. The gain of a loop is the worst case of all the paths
+        // through it adding up in phase, see RoutingGraph::getLoopGain. The
+        // links of the host count with a gain of 1. The loops are kept up to
+        // date as connections change. Edited gains and changes to the order
+        // the host processes in are picked up on the message thread within
+        // pollInterval, without holding up the audio threads.
+        static constexpr double maxStableLoopGain = 1.0;
+        // of the loop the connection is on, 0 if it is on none
+        double getLoopGain(juce::Uuid transmitter, juce::Uuid reciever);
+        // of the worst loop there is, for the editors to poll
+        double getWorstLoopGain() const { return mWorstLoopGain.load(std::memory_order_relaxed); }
+        // While enabled, every connection on a loop above maxStableLoopGain
+        // gets its overdrive protection set to clip, so the loop stays within
+        // full scale. Once the loop is stable again, or when this is
+        // disabled, the protection it set is taken back.
+        void setLoopProtection(bool shouldProtect);
+        bool isLoopProtectionEnabled() const { return mLoopProtection.load(std::memory_order_relaxed); }
+
+        // Keeps a restored connection whose peer is not there yet. It is applied
+        // as soon as the peer switches to the mode opposite to the owner's,
+        // whatever order the host restores the instances in. The owner saves
+        // them again until then, they are dropped when the owner goes away.
+        void addPendingConnection(const juce::Uuid& owner, const ConnectionRecord& record);
+        std::vector<ConnectionRecord> getPendingConnectionsOf(const juce::Uuid& owner);
+        size_t getNumberOfPendingConnections();
+
+        // While a bulk load is active, adding instances and connections does not
+        // rebuild the routing, all recievers stay silent instead. The last
+        // endBulkLoad builds it once for everything that was loaded. Nests.
+        void beginBulkLoad();
+        void endBulkLoad();
+        bool isBulkLoading() const { return mBulkLoadDepth > 0; }
+        // Called by every Instance restoring its state. The first call of a
+        // session restore starts a bulk load that ends once the message thread
+        // gets to run again, i.e. after the host restored all the instances it
+        // restores in one go. While the domain is playing it is a preset change
+        // of a single instance instead, the others keep being routed.
+        void stateRestoreStarted();
+        // a routing pass ran within the last playingTimeout milliseconds
+        bool isPlaying() const;
+        static constexpr juce::uint32 playingTimeout = 500;
+        // Ends that bulk load right away and catches up with what the message
+        // thread polls, for when it is not going to run in between.
+        void finishStateRestore() { handleUpdateNowIfNeeded(); timerCallback(); }
+        // how often the message thread looks at what the audio threads flagged
+        static constexpr int pollInterval = 20;
+
+        // Editors poll these once per frame instead of being called back, so a
+        // burst of changes costs a single refresh and nothing UI-related ever
+        // runs under mBufferOperation.
+        // The connection list version changes whenever a connection is edited,
+        // the topology version whenever an instance is added, removed, renamed
+        // or switches mode, i.e. whenever cached instance lists or parameter
+        // pointers of the editors become invalid.
+        uint64_t getConnectionListVersion() const { return mConnectionListVersion.load(std::memory_order_acquire); }
+        uint64_t getTopologyVersion() const { return mTopologyVersion.load(std::memory_order_acquire); }
+        void topologyChanged() { mTopologyVersion.fetch_add(1, std::memory_order_acq_rel); }
+
+        // Every processRouting starts a new epoch.
+        uint64_t getEpoch() const { return mEpochState.load(std::memory_order_acquire) >> epochShift; }
+        CoreStatistics::Snapshot getStatistics() const { return mStatistics.getSnapshot(); }
+        std::vector<std::pair<juce::Uuid, InstanceStatistics::Snapshot>> getInstanceStatistics();
+        // of the connections that were mixed at least once
+        std::vector<ConnectionStatistics> getConnectionStatistics();
+        void resetStatistics();
+        // of an instance, bus or transmitter of another process, empty if unknown
+        juce::String getNameOf(const juce::Uuid& id);
 
     private:
+        explicit Core(const juce::String& domainName);
+
+        void handleAsyncUpdate() override;
+        void timerCallback() override;
+
         bool checkForUuidMatch(const juce::Uuid& id);
+        void updateOffline();
+
+        struct Routing;
+        struct Buffer;
+        struct RecieverState;
+        // How the blocks of a connection are mixed, unrolled for its number
+        // of channels. Picked when the routes are built.
+        struct BlockMixer;
+        static const BlockMixer& getBlockMixer(int numberOfChannels);
+        // Keeps the snapshot the instance routes with from being freed, see
+        // reclaimRoutings.
+        class ScopedRoutingPin;
+        // mBufferOperation has to be held for writing for these
+        void rebuildRoutes();
+        void publishRouting(std::unique_ptr<Routing> routing);
+        // frees the snapshots no instance routes with anymore
+        void reclaimRoutings();
+        // new buffers for every transmitter, bus and reciever, for a new size
+        void rebuildBuffers();
+        // brings mGraph to the routes, only what changed is searched again
+        void findFeedbackLoops();
+        // These take mLoopLock themselves.
+        // Moves the edges whose gain was edited, only their loops are
+        // measured again.
+        void updateLoopGains();
+        // Guesses the links of the host from the stamps of the last epoch,
+        // under mBufferOperation for reading while they are collected.
+        void updateHostLinks();
+        // mLoopLock has to be held
+        size_t getGraphNode(const juce::Uuid& id);
+        void protectLoops();
+        // of the order and threads of the last epoch, mBufferOperation has
+        // to be held
+        uint64_t getOrderSignature();
+        void resolvePendingConnections(Instance* peer);
+        void removePendingConnectionsOf(const juce::Uuid& owner);
+        std::shared_ptr<Buffer> createBuffer();
+        std::shared_ptr<RecieverState> createRecieverState();
+        ConnectionParameters* createConnection(const ConnectionKey& key);
+        void removeConnectionsOf(const juce::Uuid& id);
+        // polled on the message thread, the routes follow if another process
+        // published or withdrew a transmitter
+        void checkSharedRoutingVersion();
+        // gives the transmitters without a slot one, with the write lock held
+        void publishTransmitters();
+        void resolveRemotePendingConnections();
+
+        const juce::String mDomainName;
 
         Map<Instance*> mBypassedInstances;
         Map<Instance*> mRecieverInstances;
         Map<Instance*> mTransmitterInstances;
 
-        int mMaxBufferSize;
-        double mSampleRate;
-        int mTransitLength = 0;
+        int mMaxBufferSize = 0;
+        double mSampleRate = 0.0;
+        std::atomic<bool> mOffline = false;
+        std::atomic<int> mQuantum = 0;
+
+        // The epoch, whether it is closed and the samples of the longest
+        // block sent in it, in one word: epoch << epochShift | closed |
+        // samples. Transmitters add their blocks to an open epoch only.
+        // Starting the next one closes it first, so its length is final, and
+        // whoever finds it closed helps moving on, see advanceEpoch.
+        static constexpr int epochShift = 21;
+        static constexpr uint64_t epochClosed = 1ull << 20;
+        static constexpr uint64_t maxEpochSamples = epochClosed - 1;
+        alignas(cacheLineSize) std::atomic<uint64_t> mEpochState = 0;
+
+        // With a quantum the blocks of several epochs are collected, the
+        // epoch after the collection reached it delivers them. A collection
+        // is tagged with its first epoch plus one, 0 is none. What every
+        // epoch is part of is kept for long enough for the slowest reader,
+        // see EpochEntry, written once before anyone can be in the epoch.
+        struct EpochEntry;
+        static constexpr size_t epochHistorySize = 512;
+        std::array<std::atomic<uint64_t>, epochHistorySize> mEpochHistory {};
+        bool loadEpochEntry(uint64_t epoch, EpochEntry& entry) const;
+        void storeEpochEntry(uint64_t epoch, const EpochEntry& entry);
+
+        // What an epoch means for the blocks exchanged in it.
+        struct EpochView
+        {
+            uint64_t epoch = 0;
+            // where the blocks sent in it go
+            uint64_t collection = 0;
+            size_t offset = 0;
+            // the collection delivered last and how long it is
+            uint64_t pass = 0;
+            size_t passSamples = 0;
+        };
+        // false if the epoch is too long gone to tell
+        bool viewEpoch(uint64_t state, EpochView& view) const;
+        // Moves on from the closed epoch in state, unless another thread did.
+        // Returns whether this call did.
+        bool advanceEpoch(uint64_t state, const Routing& routing);
+        // whether every instance waited for processed a block in the epoch
+        bool isEpochComplete(const Routing& routing, uint64_t epoch) const;
+
+        // When an instance was processed last, positions count the calls
+        // Core saw. Only the instance itself writes its stamp. The last two
+        // epochs are kept, so the message thread finds the one before the
+        // current complete, see updateHostLinks. The epoch of an entry is
+        // stored last, whoever sees it sees the rest and, for a transmitter,
+        // the block it sent.
+        struct alignas(cacheLineSize) ProcessingStamp
+        {
+            struct Entry
+            {
+                std::atomic<uint64_t> epoch = 0;
+                std::atomic<uint64_t> position = 0;
+                std::atomic<juce::Thread::ThreadID> thread = nullptr;
+            };
+            std::array<Entry, 2> entries;
+
+            const Entry& of(uint64_t epoch) const { return entries[epoch & 1]; }
+            uint64_t getEpoch() const
+            {
+                return std::max(entries[0].epoch.load(std::memory_order_acquire),
+                                entries[1].epoch.load(std::memory_order_acquire));
+            }
+        };
+        void stamp(ProcessingStamp& processingStamp, uint64_t epoch);
+        alignas(cacheLineSize) std::atomic<uint64_t> mNextPosition = 0;
 
-        // first is DelayBuffer, second is TransmitBuffer
-        using Buffer = std::pair<MCCBuffer, juce::AudioBuffer<float>>;
-        // Belongs to Transmitter Instances
-        Map<Buffer> mBuffers;
+        // One collection of a transmitter or bus. The transmitter fills one
+        // while the recievers read the last one, so every source has a few
+        // that take turns. The state is the tag of the collection, its status
+        // and the samples written so far. A slot is only taken for another
+        // collection once no reciever may read what it holds, see PassPins.
+        struct TransitSlot
+        {
+            enum Status : uint64_t
+            {
+                reclaiming = 0,
+                // written to, for a bus being summed
+                open,
+                // a bus that was summed
+                done
+            };
+            std::atomic<uint64_t> state = 0;
+            // the tag before it was reclaiming, only for the transmitter
+            uint64_t previous = 0;
+            juce::AudioBuffer<RoutingSample> samples;
+        };
+        static constexpr size_t numberOfTransitSlots = 3;
+        // the samples a source has of a collection, the first available ones
+        struct Collected
+        {
+            const juce::AudioBuffer<RoutingSample>* samples = nullptr;
+            size_t available = 0;
+        };
+        static Collected findCollected(const Buffer& source, uint64_t collection);
+        // only the transmitter itself, nullptr if a reciever still reads
+        // the slot it would take
+        TransitSlot* openSlot(Buffer& buffer, uint64_t collection);
+
+        // Belongs to transmitter Instances and buses. Replaced with the size
+        // of the buffers, the snapshots hold on to theirs.
+        struct alignas(cacheLineSize) Buffer
+        {
+            ProcessingStamp stamp;
+            std::array<TransitSlot, numberOfTransitSlots> transit;
+            // where a transmitter is published with shared routing, -1 if
+            // not. The audio threads use the one of their snapshot.
+            int sharedSlot = -1;
+        };
+        Map<std::shared_ptr<Buffer>> mBuffers;
+
+        // Belongs to reciever Instances, only their audio thread writes it.
+        // Replaced with the size of the buffers like Buffer.
+        struct alignas(cacheLineSize) RecieverState
+        {
+            ProcessingStamp stamp;
+            // what the routing passes mix, read from position on
+            juce::AudioBuffer<RoutingSample> buffer;
+            int position = 0;
+            // the last pass mixed into buffer
+            uint64_t mixedPass = 0;
+            // the last epoch the latencies of its route were assigned in
+            uint64_t latencyEpoch = 0;
+            // buses this reciever sums for itself, see collectBus
+            juce::AudioBuffer<RoutingSample> scratch;
+            // of its connections, for CoreStatistics::sameBlockEdges
+            std::atomic<uint64_t> sameBlockEdges = 0;
+            // see PassPins, released with the state
+            PassPins* pins = nullptr;
+            size_t pin = PassPins::none;
 
-        // Map<juce::AudioBuffer<float>> mTransitBuffers;
-        // Map<MCCBuffer> mDelayBuffers;
+            ~RecieverState() { if(pins != nullptr) pins->release(pin); }
+        };
+        // before the states, they give their pins back
+        PassPins mPassPins;
+        Map<std::shared_ptr<RecieverState>> mRecieverStates;
 
-        // Matrix[Transmitter][Reciever]
-        ParameterMatrix mMatrix;
+        // Only connections that were turned on or edited exist, every other
+        // pair has the default parameters. Kept compact, the parameters live
+        // in mParameterStore.
+        struct Connection
+        {
+            ConnectionKey key;
+            ConnectionParameters* parameters;
+        };
+        std::vector<Connection> mConnections;
+        std::unordered_map<ConnectionKey, size_t, ConnectionKeyHash> mConnectionIndices;
+        ParameterStore mParameterStore;
+
+        // The matrix compiled into what the audio threads iterate, so they do
+        // no lookups. Only connections that were on at the time are listed,
+        // but on is still checked every block.
+        // How a connection is delivered. It goes to the same block once the
+        // transmitter came before the reciever in this many epochs in a row,
+        // and back to the pass as soon as it does not.
+        static constexpr uint32_t sameBlockHysteresis = 8;
+        // Only the thread of the reciever changes it, getConnectionLatency
+        // reads the latency from any. Carried over to the routes that
+        // replace the one it was made for, so editing one connection does
+        // not change how the others are delivered.
+        struct Delivery
+        {
+            // what happens to the block when switching latency, see mixEdge
+            enum class Transition { none, crossfade, fadeIn };
+
+            std::atomic<int> latency = 1;
+            uint32_t stableEpochs = 0;
+            // the last epoch whose block was read in the same block
+            uint64_t consumedEpoch = 0;
+            // the last epoch the transmitter came before the reciever in
+            uint64_t orderedEpoch = 0;
+            Transition transition = Transition::none;
+        };
+        // The transmitters of a bus are summed once per pass into a slot of
+        // the bus, by whichever of its recievers gets to it first, from there
+        // on the bus is read like any transmitter. It is never stamped, so
+        // its connections never deliver in the same block.
+        struct BusInput
+        {
+            juce::Uuid transmitter;
+            Buffer* source;
+            ConnectionParameters* parameters;
+            const BlockMixer* mixer;
+            int numberOfChannels;
+        };
+        struct BusRoute
+        {
+            Buffer* bus;
+            std::vector<BusInput> inputs;
+        };
+        struct RouteEdge
+        {
+            juce::Uuid transmitter;
+            Buffer* source;
+            // summed before it is read, nullptr for a transmitter
+            const BusRoute* bus;
+            ConnectionParameters* parameters;
+            const BlockMixer* mixer;
+            int numberOfChannels;
+            std::shared_ptr<Delivery> delivery;
+        };
+        // A connection from a transmitter of another process. Its blocks are
+        // read from the ring of the transmitter in the routing pass, always
+        // with latency. The other process runs on a clock of its own, the
+        // compensator keeps the ring about two blocks behind it. Carried over
+        // like Delivery while the size of the buffers stays.
+        struct RemoteState
+        {
+            uint64_t readPosition = SharedRouting::notStarted;
+            DriftCompensator<SharedRouting::numberOfChannels> compensator;
+            // keeps the transmitter writing its ring, see SharedRouting::attach
+            uint64_t attachment = 0;
+            int bufferSize = 0;
+        };
+        struct RemoteEdge
+        {
+            juce::Uuid transmitter;
+            int slot;
+            ConnectionParameters* parameters;
+            std::shared_ptr<RemoteState> state;
+        };
+        // Floating point sums depend on their order, so every reciever sums
+        // its sources in a fixed one and renders the same bits whatever order
+        // its connections were made or restored in: first the connections
+        // from other processes, then those with a block of latency, then those
+        // delivered in the same block, each of them by the id of the
+        // transmitter. The ids are saved with the instances. Buses sum their
+        // inputs by the id of the transmitter as well.
+        struct Route
+        {
+            juce::Uuid reciever;
+            RecieverState* state;
+            std::vector<RouteEdge> edges;
+            std::vector<RemoteEdge> remoteEdges;
+        };
 
-        juce::CriticalSection mBufferOperation;
+        // Everything the audio threads route with. A snapshot is never
+        // changed once it is published, rebuildRoutes publishes a new one and
+        // the old one is freed once no instance routes with it anymore.
+        struct Routing
+        {
+            struct Source
+            {
+                std::shared_ptr<Buffer> buffer;
+                int sharedSlot;
+                bool isBus;
+            };
+            Map<Source> sources;
+            Map<std::shared_ptr<RecieverState>> recievers;
+            std::vector<Route> routes;
+            Map<size_t> routeIndices;
+            std::vector<BusRoute> busRoutes;
+            Map<size_t> busRouteIndices;
+            std::shared_ptr<SharedRouting> sharedRouting;
+            uint64_t unroutedConnections = 0;
+
+            // Only the message thread. What the routes of this snapshot and
+            // those before it may still use, let go of once they are freed.
+            std::vector<ConnectionParameters*> releasedParameters;
+            std::vector<int> withdrawnSlots;
+        };
+        // never nullptr, mBufferOperation has to be held for writing to
+        // publish or free one
+        std::atomic<Routing*> mRouting = nullptr;
+        // oldest first
+        std::vector<std::unique_ptr<Routing>> mRetiredRoutings;
+
+        // For the audio thread of the reciever. The routing pass mixes the
+        // connections with a block of latency, the other call those that
+        // deliver in the same block.
+        void assignLatencies(const Route& route, RecieverState& state, uint64_t epoch);
+        void mixRoute(const Route& route, RecieverState& state, const EpochView& view, int latency,
+                      size_t numberOfSamples, bool measureReciever, LevelMeter& recieveLevel,
+                      uint64_t& activeEdges, uint64_t& silentSkips);
+        void mixRemoteEdges(const Route& route, const Routing& routing, RecieverState& state,
+                            size_t numberOfSamples, bool measureReciever, LevelMeter& recieveLevel,
+                            uint64_t& activeEdges, uint64_t& silentSkips);
+        template<bool measureReciever>
+        void mixEdge(const RouteEdge& edge, RecieverState& state, const EpochView& view,
+                     size_t numberOfSamples, LevelAccumulator& connectionLevel,
+                     LevelAccumulator& recieverLevel);
+        // The bus as the pass delivers it, summed into a slot of the bus by
+        // the first reciever that needs it, or into the scratch buffer of
+        // this one if it cannot take a slot.
+        Collected collectBus(const BusRoute& busRoute, RecieverState& state, const EpochView& view);
+
+        Map<juce::String> mBuses;
+
+        // the snapshots hold on to it as well, see Routing
+        std::shared_ptr<SharedRouting> mSharedRouting;
+        juce::String mSharedRoutingName;
+        // the registry version the routes were built for
+        std::atomic<uint64_t> mSharedRoutingVersion = 0;
+
+        // Everything about the loops is guarded by this one. It is taken
+        // after mBufferOperation, the message thread takes it on its own.
+        juce::CriticalSection mLoopLock;
+        // recievers and transmitters, edges are the connections plus the
+        // links the host has between them, see findFeedbackLoops. Every
+        // instance and bus keeps its node while it is there.
+        RoutingGraph mGraph;
+        Map<size_t> mGraphNodes;
+        std::vector<size_t> mFreeGraphNodes;
+        // the routed connections, with the gain mGraph has for them
+        struct LoopEdge
+        {
+            size_t from;
+            size_t to;
+            ConnectionParameters* parameters;
+            float gain;
+            bool toBus;
+        };
+        std::unordered_map<ConnectionKey, LoopEdge, ConnectionKeyHash> mLoopEdges;
+        // a reciever and the transmitter the host processes right after it
+        std::vector<std::pair<juce::Uuid, juce::Uuid>> mHostLinks;
+        std::atomic<double> mWorstLoopGain = 0.0;
+        std::atomic<bool> mLoopProtection = false;
+        // the connections set to clip by protectLoops
+        std::unordered_set<ConnectionKey, ConnectionKeyHash> mProtectedConnections;
+        // gains may have been edited since parameterSequence was last this
+        uint64_t mCheckedParameterSequence = 0;
+        // set by the audio threads when a connection fell back to the pass
+        // or its latency changed otherwise, the host links are guessed again
+        // on the message thread. So they are when the order of the last epoch
+        // differs from the one before, see getOrderSignature.
+        std::atomic<bool> mOrderChanged = false;
+        uint64_t mOrderSignature = 0;
+
+        // keyed by the peer that is not there yet
+        struct PendingConnection
+        {
+            juce::Uuid owner;
+            ConnectionRecord record;
+        };
+        Map<std::vector<PendingConnection>> mPendingConnections;
+
+        std::atomic<int> mBulkLoadDepth = 0;
+        std::atomic<bool> mRestoringState = false;
+        // of the last routing pass, 0 before the first one
+        std::atomic<juce::uint32> mLastPassTime = 0;
+
+        // see getRoutingLock
+        juce::ReadWriteLock mBufferOperation;
+
+        CoreStatistics mStatistics;
+        std::atomic<uint64_t> mTopologyVersion = 0;
+        std::atomic<uint64_t> mConnectionListVersion = 0;
+    };
+
+    class ScopedBulkLoad
+    {
+    public:
+        explicit ScopedBulkLoad(Core& core) : mCore(core) { mCore.beginBulkLoad(); }
+        ~ScopedBulkLoad() { mCore.endBulkLoad(); }
+
+        ScopedBulkLoad(const ScopedBulkLoad&) = delete;
+        ScopedBulkLoad& operator=(const ScopedBulkLoad&) = delete;
+
+    private:
+        Core& mCore;
     };
 
 }
@@ -0,0 +1,142 @@
+#pragma once
+
+/*  Keeps a connection between two endpoints with clocks of their own from
+    running dry or overflowing. Their sample rates are never exactly the same,
+    so whatever sits between them fills up or drains, slowly but without end.
+    The reader measures how much is waiting every block, and a PI loop turns
+    the distance from the target into a rate at which it reads: a little
+    faster while too much is waiting, a little slower while too little is.
+    The blocks are resampled to that rate on the way into the destination.
+    Not locked, one thread at a time.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <juce_core/juce_core.h>
+
+#include "MixKernels.h"
+
+namespace patch
+{
+
+template<size_t numberOfChannels>
+class DriftCompensator
+{
+public:
+    // How far the rate may be off, 0.2% is well beyond the drift of real
+    // clocks and a pitch change of about 3.5 cents.
+    static constexpr double maxCorrection = 0.002;
+    // in relative rate per relative fill error and per accumulated error
+    static constexpr double proportionalGain = 0.001;
+    static constexpr double integralGain = 0.000002;
+    // of the fill level, per block
+    static constexpr double smoothing = 0.02;
+
+    // Allocates for blocks of up to maxBlockSize, message thread. Keeps what
+    // is buffered if it still fits.
+    void prepare(size_t maxBlockSize)
+    {
+        if(maxBlockSize <= mMaxBlockSize) return;
+
+        mMaxBlockSize = maxBlockSize;
+        mCapacity = (size_t)std::ceil((double)maxBlockSize * (1.0 + maxCorrection)) + margin;
+        for(auto& channel : mInput)
+            channel.resize(mCapacity, 0);
+    }
+
+    // Forgets the rate and what is buffered, for when the reader starts over.
+    void reset()
+    {
+        mPosition = 1.0;
+        mBuffered = history;
+        mRatio = 1.0;
+        mIntegral = 0.0;
+        mSmoothedFill = -1.0;
+        for(auto& channel : mInput)
+            std::fill(channel.begin(), channel.end(), (RoutingSample)0);
+    }
+
+    // Updates the rate from how many samples are waiting, targetFill is where
+    // the reader wants to be. Returns how many samples to add with
+    // getInput/addedInput before mixing numberOfSamples.
+    size_t beginBlock(size_t fill, size_t targetFill, size_t numberOfSamples)
+    {
+        const double target = (double)juce::jmax<size_t>(targetFill, 1);
+        if(mSmoothedFill < 0.0)
+            mSmoothedFill = target;
+        mSmoothedFill += smoothing * ((double)fill - mSmoothedFill);
+
+        const double error = (mSmoothedFill - target) / target;
+        const double integralLimit = maxCorrection / integralGain;
+        mIntegral = juce::jlimit(-integralLimit, integralLimit, mIntegral + error);
+        mRatio = juce::jlimit(1.0 - maxCorrection, 1.0 + maxCorrection,
+                              1.0 + proportionalGain * error + integralGain * mIntegral);
+
+        numberOfSamples = juce::jmin(numberOfSamples, mMaxBlockSize);
+        mNumberOfSamples = numberOfSamples;
+        if(numberOfSamples == 0) return 0;
+
+        // the last position needs two samples after it
+        const size_t required = (size_t)(mPosition + (double)(numberOfSamples - 1) * mRatio) + 3;
+        return required > mBuffered ? juce::jmin(required, mCapacity) - mBuffered : 0;
+    }
+
+    // where the samples for this block go
+    RoutingSample* getInput(size_t channel) { return mInput[channel].data() + mBuffered; }
+
+    // What was missing stays silent.
+    void addedInput(size_t numberOfSamples, size_t numberOfSamplesRequested)
+    {
+        for(auto& channel : mInput)
+            std::fill(channel.begin() + (ptrdiff_t)(mBuffered + numberOfSamples),
+                      channel.begin() + (ptrdiff_t)(mBuffered + numberOfSamplesRequested),
+                      (RoutingSample)0);
+        mBuffered += numberOfSamplesRequested;
+    }
+
+    // Mixes the block at the current rate, see kernels::resampleChannelsAndMix.
+    template<bool measureDestination, bool clip = false>
+    void mixInto(const std::array<RoutingSample*, numberOfChannels>& destinations, float gain,
+                 LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+    {
+        std::array<const RoutingSample*, numberOfChannels> sources;
+        for(size_t ch = 0; ch < numberOfChannels; ch++)
+            sources[ch] = mInput[ch].data();
+
+        kernels::resampleChannelsAndMix<numberOfChannels, measureDestination, RoutingSample, clip>(
+            destinations, sources, mPosition, mRatio, gain, mNumberOfSamples, sourceLevel,
+            destinationLevel);
+
+        // keeps the sample before the next position and everything after it
+        const double end = mPosition + (double)mNumberOfSamples * mRatio;
+        const size_t consumed = juce::jmin((size_t)end - 1, mBuffered - history);
+        mPosition = end - (double)consumed;
+        mBuffered -= consumed;
+        for(auto& channel : mInput)
+            std::memmove(channel.data(), channel.data() + consumed, mBuffered * sizeof(RoutingSample));
+    }
+
+    double getRatio() const { return mRatio; }
+
+private:
+    // samples kept before the first position
+    static constexpr size_t history = 1;
+    // the two after the last position and rounding
+    static constexpr size_t margin = history + 4;
+
+    std::array<std::vector<RoutingSample>, numberOfChannels> mInput;
+    size_t mMaxBlockSize = 0;
+    size_t mCapacity = 0;
+    size_t mBuffered = history;
+    size_t mNumberOfSamples = 0;
+    // where the next block starts in mInput, at least 1
+    double mPosition = 1.0;
+    double mRatio = 1.0;
+    double mIntegral = 0.0;
+    double mSmoothedFill = -1.0;
+};
+
+} // namespace patch
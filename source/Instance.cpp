@@ -1,6 +1,7 @@
 #include "Instance.h"
 #include "Logger.h"
 #include "Core.h"
+#include "InstanceState.h"
 
 using namespace patch;
 
@@ -10,7 +11,7 @@ Instance::Instance()
     , fs(0)
     , mMode(Mode::bypass)
     , mPreviousMode(Mode::bypass)
-    , mCorePtr(Core::getInstance())
+    , mCorePtr(Core::getDomain(Core::defaultDomain))
     , id(juce::Uuid{})
 {
     mCorePtr->registerInstance(this);
@@ -18,19 +19,17 @@ Instance::Instance()
 
 Instance::~Instance() 
 {
-    juce::ScopedLock lock(mcs);
+    juce::ScopedLock lock(mProcessLock);
     mCorePtr->tryDeleteInstance(getId());
 }
 
 
 void Instance::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    juce::ScopedLock lock(mProcessLock);
     maxBufferSize = samplesPerBlock;
     fs = sampleRate;
     mCorePtr->prepareToPlay(sampleRate, samplesPerBlock);
-    
-    // only two-channels setups are supported in this version
-    mRecieveBuffer.setSize(2, maxBufferSize);
 }
 
 void Instance::releaseResources()
@@ -38,50 +37,80 @@ void Instance::releaseResources()
     mCorePtr->releaseResources();
 }
 
-void Instance::processBlock(juce::AudioBuffer<float>& buffer)
+template<typename SampleType>
+void Instance::processBlock(juce::AudioBuffer<SampleType>& buffer)
 {
-    juce::ScopedLock lock(mcs);
+    MY_TRACE_SCOPE_ID("Instance::processBlock", id);
+    juce::ScopedLock lock(mProcessLock);
+    ScopedDurationMeasurement measurement(mStatistics.processBlockDuration);
+
+    mStatistics.blocksProcessed.add();
+    mStatistics.samplesProcessed.add((uint64_t)buffer.getNumSamples());
 
-    if (fCoreState == hasNotFinished) 
+    // bypassed instances take no part in routing and never wait for it
+    if (mMode == Mode::bypass) return;
+
+    // This instance was processed in the current epoch already, so the host
+    // is at its next block. Whichever instance gets here first starts the
+    // next epoch.
+    const uint64_t processedEpoch = mProcessedEpoch.load(std::memory_order_acquire);
+    if (processedEpoch == mCorePtr->getEpoch())
     {
+        // rendering offline the others may not be done with this epoch yet,
+        // the next one waits for them
+        if (mCorePtr->isOffline())
+        {
+            ScopedDurationMeasurement waitMeasurement(mStatistics.epochWait);
+            mCorePtr->waitForEpoch(*this, processedEpoch);
+        }
+
         MY_LOG_INFO ("Inst {}: Calling Core =========================",
                      id);
-        mCorePtr->processRouting(buffer.getNumSamples());
+        if (mCorePtr->processRouting(*this, buffer.getNumSamples(), processedEpoch))
+            mStatistics.routingPassesTriggered.add();
     }
 
+    // the epoch the block was exchanged in, Core never waits for the others
+    uint64_t epoch = 0;
     if (mMode == Mode::transmit)
     {
         MY_LOG_INFO ("Inst {}: Sending buffer of size {}", 
                      id,
                      buffer.getNumSamples());
-        mCorePtr->bufferForNextBlock(getId(), buffer);
+        epoch = mCorePtr->bufferForNextBlock(*this, buffer);
     }
     else if (mMode == Mode::recieve)
     {
         MY_LOG_INFO ("Inst {}: Loading buffer of size {}", 
                      id,
                      buffer.getNumSamples());
-        for (int ch = 0; ch < 2; ch++)
-        {
-            buffer.addFrom(
-                ch,
-                0,
-                mRecieveBuffer.getReadPointer(ch),
-                buffer.getNumSamples()
-            );
-        }
+        epoch = mCorePtr->recieveForThisBlock(*this, buffer);
     }
-    
-    fCoreState = hasNotFinished;
+    else
+    {
+        epoch = mCorePtr->getEpoch();
+    }
+
+    if (mLastEpoch != 0 && epoch > mLastEpoch + 1)
+        mStatistics.missedEpochs.add(epoch - mLastEpoch - 1);
+    mLastEpoch = epoch;
+
+    mProcessedEpoch.store(epoch, std::memory_order_release);
 }
 
+template void Instance::processBlock(juce::AudioBuffer<float>&);
+template void Instance::processBlock(juce::AudioBuffer<double>&);
+
 void Instance::setMode(Mode mode)
 {
+    juce::ScopedLock lock(mProcessLock);
+
     mMode = mode;
     mCorePtr->instanceSwitchedMode(this, mPreviousMode);
     mPreviousMode = mMode;
 
-    mRecieveBuffer.clear();
+    // only this instance writes it otherwise, held off by mProcessLock
+    mRecieveLevel.clear();
 }
 
 void Instance::setId(InstanceAccessToken token, const juce::Uuid& uuid)
@@ -90,36 +119,103 @@ void Instance::setId(InstanceAccessToken token, const juce::Uuid& uuid)
     id = uuid;
 }
 
-void Instance::setStateInfo(juce::ValueTree info)
+void Instance::setState(const InstanceState& state)
 {
-    juce::ScopedLock lock(mcs);
+    // everything else is restored into the domain
+    setDomain(state.domain.value_or(Core::defaultDomain));
+    // only ever turned on here, turning it off is up to the editor
+    if(state.sharedRouting)
+        mCorePtr->enableSharedRouting();
 
-    Core::getInstance()->tryDeleteInstance(id);
-    const juce::Uuid nominalid(info.getProperty(id::uuid).toString());
-    id = nominalid;
-    Core::getInstance()->registerInstance(this);
-    if(id != nominalid) return; // uuid (preset) already used, connections are discarded
+    // hosts restore all instances of a session in a row, the routing is built
+    // once after the last one
+    mCorePtr->stateRestoreStarted();
+
+    juce::ScopedLock lock(mProcessLock);
+
+    mCorePtr->tryDeleteInstance(id);
+    id = state.id;
+    mCorePtr->registerInstance(this);
+    if(id != state.id) return; // uuid (preset) already used, connections are discarded
     
-    if(info.hasProperty(id::name))
-        mName = info.getProperty(id::name).toString();
+    if(state.name.has_value())
+        setName(state.name.value());
 
-    const Mode mode = static_cast<Mode>((int)info.getProperty(id::mode));
-    setMode(mode);
+    setMode(state.mode);
 
-    for(const juce::ValueTree& connection : info)
+    for(const BusRecord& bus : state.buses)
+        mCorePtr->addBus(bus.name, bus.id);
+
+    for(const ConnectionRecord& connection : state.connections)
     {
+        // earlier versions saved every pair
+        if(connection.isDefault()) continue;
+
         const juce::Uuid transmitterid = mMode == Mode::transmit 
             ? id
-            : connection.getProperty(id::uuid).toString();
+            : connection.peer;
         const juce::Uuid recieverid = mMode == Mode::recieve
             ? id
-            : connection.getProperty(id::uuid).toString();
+            : connection.peer;
+
+        ConnectionParameters* params = mCorePtr->getOrCreateConnectionParameters(transmitterid, recieverid);
+        if(params == nullptr)
+        {
+            // the peer has not been restored yet
+            mCorePtr->addPendingConnection(id, connection);
+            continue;
+        }
+
+        connection.applyTo(*params);
+    }
+
+    mCorePtr->connectionsChanged();
+}
+
+void Instance::setDomain(const juce::String& name)
+{
+    juce::ScopedLock lock(mProcessLock);
+    if(name == mCorePtr->getDomainName()) return;
+
+    const Mode mode = mMode;
+
+    // leaves as if it was deleted, which bypasses it. Shared routing is
+    // whatever the new domain has.
+    mCorePtr->tryDeleteInstance(id);
+    mCorePtr = Core::getDomain(name);
+    mCorePtr->registerInstance(this);
 
-        ConnectionParameters* params = Core::getInstance()->getConnectionParameters(transmitterid, recieverid);
-        if(params == nullptr) continue;
+    // epochs count in the domain they belong to
+    mProcessedEpoch.store(mCorePtr->getEpoch(), std::memory_order_release);
+    mLastEpoch = 0;
+    if(maxBufferSize > 0)
+        prepareToPlay(fs, maxBufferSize);
 
-        params->deserialize(connection);
+    setMode(mode);
+}
+
+juce::String Instance::getDomain() const
+{
+    return mCorePtr->getDomainName();
+}
+
+void Instance::setNonRealtime(bool isNonRealtime)
+{
+    juce::ScopedLock lock(mProcessLock);
+    if(isNonRealtime == mNonRealtime) return;
+
+    mNonRealtime = isNonRealtime;
+    mCorePtr->instanceSwitchedRenderMode(this);
+}
+
+void Instance::setName(juce::String name)
+{
+    {
+        // the editors of other instances read it
+        const juce::ScopedWriteLock routingLock(mCorePtr->getRoutingLock());
+        mName = name;
     }
+    mCorePtr->instanceRenamed(this);
 }
 
 juce::String Instance::getName() const
@@ -127,43 +223,75 @@ juce::String Instance::getName() const
     return mName.value_or<juce::String>(id.toString());
 }
 
-juce::ValueTree Instance::getStateInfo()
+InstanceState Instance::getState()
 {
-    juce::ScopedLock lock(mcs);
+    juce::ScopedLock lock(mProcessLock);
+
+    InstanceState state;
+    state.id = id;
+    state.mode = mMode;
+    state.name = mName;
+    if(mCorePtr->getDomainName() != Core::defaultDomain)
+        state.domain = mCorePtr->getDomainName();
+    state.sharedRouting = mCorePtr->isSharedRoutingEnabled();
 
-    juce::ValueTree info(id::stateInfo);
-    info.setProperty(id::uuid, id.toString(), nullptr);
-    info.setProperty(id::mode, (int)mMode, nullptr);
-    if(mName.has_value())
-        info.setProperty(id::name, mName.value(), nullptr);
+    // the maps change when other instances come, go or switch modes
+    const juce::ScopedReadLock routingLock(mCorePtr->getRoutingLock());
 
     if(mMode == Mode::transmit)
     {
-        Map<Instance*>* recievers = Core::getInstance()->getRecievers();
-        for(auto recieverkv : *recievers)
+        Map<Instance*>* recievers = mCorePtr->getRecievers();
+        state.connections.reserve(recievers->size());
+        for(auto& recieverkv : *recievers)
         {
             juce::Uuid recieverid = recieverkv.first;
-            ConnectionParameters* params = Core::getInstance()->getConnectionParameters(id, recieverid);
-            
-            juce::ValueTree paramTree = params->serialize();
-            paramTree.setProperty(id::uuid, recieverid.toString(), nullptr);
-            info.addChild(paramTree, -1, nullptr);
+            ConnectionParameters* params = mCorePtr->getConnectionParameters(id, recieverid);
+            if(params == nullptr) continue;
+
+            state.connections.push_back(ConnectionRecord::fromParameters(recieverid, *params));
         }
     }
 
     if(mMode == Mode::recieve)
     {
-        Map<Instance*>* transmitters = Core::getInstance()->getTransmitters();
-        for(auto transmitterkv : *transmitters)
+        Map<Instance*>* transmitters = mCorePtr->getTransmitters();
+        state.connections.reserve(transmitters->size());
+        for(auto& transmitterkv : *transmitters)
         {
             juce::Uuid transmitterid = transmitterkv.first;
-            ConnectionParameters* params = Core::getInstance()->getConnectionParameters(transmitterid, id);
+            ConnectionParameters* params = mCorePtr->getConnectionParameters(transmitterid, id);
+            if(params == nullptr) continue;
+
+            state.connections.push_back(ConnectionRecord::fromParameters(transmitterid, *params));
+        }
+
+        for(auto& transmitterkv : mCorePtr->getRemoteTransmitters())
+        {
+            ConnectionParameters* params = mCorePtr->getConnectionParameters(transmitterkv.first, id);
+            if(params == nullptr) continue;
 
-            juce::ValueTree paramTree = params->serialize();
-            paramTree.setProperty(id::uuid, transmitterid.toString(), nullptr);
-            info.addChild(paramTree, -1, nullptr);
+            state.connections.push_back(ConnectionRecord::fromParameters(transmitterkv.first, *params));
         }
     }
 
-    return info;
+    // the buses go with the connections, so they are there to restore them
+    if(mMode == Mode::transmit || mMode == Mode::recieve)
+    {
+        for(auto& buskv : *mCorePtr->getBuses())
+        {
+            ConnectionParameters* params = mMode == Mode::transmit
+                ? mCorePtr->getConnectionParameters(id, buskv.first)
+                : mCorePtr->getConnectionParameters(buskv.first, id);
+            if(params == nullptr) continue;
+
+            state.connections.push_back(ConnectionRecord::fromParameters(buskv.first, *params));
+            state.buses.push_back({ buskv.first, buskv.second });
+        }
+    }
+
+    // connections to peers that were not restored (yet) are kept for them
+    for(const ConnectionRecord& record : mCorePtr->getPendingConnectionsOf(id))
+        state.connections.push_back(record);
+
+    return state;
 }
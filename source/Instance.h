@@ -6,9 +6,10 @@
 #pragma once
 
 #include "juce_audio_basics/juce_audio_basics.h"
+#include <memory>
 
-#include "CircularArray.h"
 #include "ConnectionParameters.h"
+#include "PerformanceCounters.h"
 
 namespace patch
 {
@@ -20,13 +21,8 @@ namespace patch
         recieve
     };
 
-    enum BinarySateFlag : bool
-    {
-        hasFinished = true,
-        hasNotFinished = false
-    };
-
     class Core;
+    struct InstanceState;
 
     // This is a trick to provide access to the setId funciton for Core.
     // No other class should have access to that funciton and it should be called only rarely, in
@@ -46,38 +42,68 @@ namespace patch
         ~Instance();
 
         void prepareToPlay(double sampleRate, int samplesPerBlock);
-        void processBlock (juce::AudioBuffer<float>& buffer);
+        // Either precision, see DOUBLE_PRECISION_ROUTING.
+        template<typename SampleType>
+        void processBlock (juce::AudioBuffer<SampleType>& buffer);
         void releaseResources();
 
         void setMode(Mode mode);
-        void setCoreFinished() { fCoreState = hasFinished; }
         void setId(InstanceAccessToken token, const juce::Uuid& uuid);
-        void setName(juce::String name) {mName = name;}
-        void setStateInfo(juce::ValueTree info);
+        void setName(juce::String name);
+        // Set by the host while it renders offline, see Core::isOffline.
+        void setNonRealtime(bool isNonRealtime);
+        bool isNonRealtime() const { return mNonRealtime.load(std::memory_order_acquire); }
+        void setState(const InstanceState& state);
+        // Moves the instance to another routing domain, see Core::getDomain.
+        // It keeps its mode, its connections stay behind. Shared routing is
+        // whatever the domain it moves to has, see Core::enableSharedRouting.
+        void setDomain(const juce::String& name);
 
         Mode getMode() { return mMode; }
-        juce::AudioBuffer<float>* getRecieveBuffer() { return &mRecieveBuffer; }
+        // The Core of the domain the instance routes in. Holding on to it
+        // keeps the domain alive after the instance moved on.
+        std::shared_ptr<Core> getCore() const { return mCorePtr; }
+        juce::String getDomain() const;
+        // The last epoch of Core this instance processed a block in.
+        uint64_t getProcessedEpoch() const { return mProcessedEpoch.load(std::memory_order_acquire); }
+        LevelMeter& getRecieveLevel() { return mRecieveLevel; }
+        // The routes the audio thread of this instance uses while it is in
+        // Core, see Core::reclaimRoutings.
+        std::atomic<const void*>& getRoutingHazard(InstanceAccessToken) { return mRoutingHazard; }
         const juce::Uuid& getId() const { return id; }
         juce::String getName() const;
-        juce::ValueTree getStateInfo();
-
-        std::function<void()> updateConnectionList;
+        InstanceState getState();
+        InstanceStatistics::Snapshot getStatistics() const { return mStatistics.getSnapshot(); }
+        void resetStatistics() { mStatistics.reset(); }
 
     private:
         int maxBufferSize;
         double fs;
-        BinarySateFlag fCoreState = hasNotFinished;
 
-        Mode mMode;
+        // written under mProcessLock, read by the routing of other instances
+        std::atomic<Mode> mMode;
         Mode mPreviousMode;
+        std::atomic<bool> mNonRealtime = false;
 
-        juce::AudioBuffer<float> mRecieveBuffer;
-        Core* mCorePtr;
+        // written by the audio thread of this instance, read by every other one
+        alignas(cacheLineSize) std::atomic<uint64_t> mProcessedEpoch = 0;
+
+        alignas(cacheLineSize) std::atomic<const void*> mRoutingHazard = nullptr;
+
+        alignas(cacheLineSize) LevelMeter mRecieveLevel;
+        // keeps the domain alive, only replaced under mProcessLock
+        std::shared_ptr<Core> mCorePtr;
 
         juce::Uuid id;
         std::optional<juce::String> mName;
 
-        inline static juce::CriticalSection mcs = {};
+        InstanceStatistics mStatistics;
+        uint64_t mLastEpoch = 0;
+
+        // Held while processing a block and while the message thread changes
+        // the instance. Instances do not wait for each other, Core
+        // synchronises what they share.
+        juce::CriticalSection mProcessLock;
     };
 
 }
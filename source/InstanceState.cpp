@@ -0,0 +1,447 @@
+#include "InstanceState.h"
+
+#include <bit>
+#include <cstring>
+
+using namespace patch;
+
+/*  Binary layout, all numbers little endian
+
+    header, 32 bytes
+        char[4]     magic "PTCH"
+        uint16      version
+        uint16      flags, bit 0: a name follows the header,
+                    bit 1: buses follow the connection records,
+                    bit 2: a domain follows the buses,
+                    bit 3: the domain has shared routing on, since version 4
+        uint8[16]   uuid of the instance
+        int32       mode
+        uint32      number of connection records
+
+    name, only if flagged
+        uint32      number of bytes
+        char[]      utf8, not terminated
+
+    connection record, 28 bytes each
+        uint8[16]   uuid of the peer
+        float32     gain
+        int32       delay
+        uint8       flags, bit 0: on, bit 1: delay correction
+        uint8       overdrive protection
+        uint8[2]    reserved
+
+    buses, only if flagged, since version 2
+        uint32      number of buses
+        then for every bus
+        uint8[16]   uuid of the bus
+        uint32      number of bytes of the name
+        char[]      utf8, not terminated
+
+    domain, only if flagged, since version 3
+        uint32      number of bytes
+        char[]      utf8, not terminated
+*/
+
+namespace
+{
+    constexpr char magic[4] = { 'P', 'T', 'C', 'H' };
+    constexpr size_t headerSize = 32;
+    constexpr size_t recordSize = 28;
+    constexpr uint16_t hasNameFlag = 1 << 0;
+    constexpr uint16_t hasBusesFlag = 1 << 1;
+    constexpr uint16_t hasDomainFlag = 1 << 2;
+    constexpr uint16_t sharedRoutingFlag = 1 << 3;
+    constexpr uint8_t onFlag = 1 << 0;
+    constexpr uint8_t delayCorrectionFlag = 1 << 1;
+
+    class BinaryWriter
+    {
+    public:
+        explicit BinaryWriter(char* destination)
+            : mPosition(destination)
+        {}
+
+        template<typename type>
+        void write(type value)
+        {
+            if constexpr (std::is_same_v<type, float>)
+            {
+                write(std::bit_cast<uint32_t>(value));
+            }
+            else
+            {
+                value = juce::ByteOrder::swapIfBigEndian(value);
+                writeBytes(&value, sizeof(value));
+            }
+        }
+
+        void writeBytes(const void* data, size_t size)
+        {
+            std::memcpy(mPosition, data, size);
+            mPosition += size;
+        }
+
+    private:
+        char* mPosition;
+    };
+
+    // Reads past the end fail silently and leave isValid() false, so the
+    // caller only has to check once.
+    class BinaryReader
+    {
+    public:
+        BinaryReader(const void* data, size_t size)
+            : mPosition(static_cast<const char*>(data))
+            , mEnd(mPosition + size)
+        {}
+
+        template<typename type>
+        type read()
+        {
+            if constexpr (std::is_same_v<type, float>)
+            {
+                return std::bit_cast<float>(read<uint32_t>());
+            }
+            else
+            {
+                type value{};
+                readBytes(&value, sizeof(value));
+                return juce::ByteOrder::swapIfBigEndian(value);
+            }
+        }
+
+        void readBytes(void* data, size_t size)
+        {
+            if(!mValid || getRemaining() < size)
+            {
+                mValid = false;
+                std::memset(data, 0, size);
+                return;
+            }
+            std::memcpy(data, mPosition, size);
+            mPosition += size;
+        }
+
+        juce::Uuid readUuid()
+        {
+            juce::uint8 raw[16];
+            readBytes(raw, sizeof(raw));
+            return juce::Uuid(raw);
+        }
+
+        void skip(size_t size)
+        {
+            if(!mValid || getRemaining() < size) { mValid = false; return; }
+            mPosition += size;
+        }
+
+        const char* getPosition() const { return mPosition; }
+        size_t getRemaining() const { return (size_t)(mEnd - mPosition); }
+        bool isValid() const { return mValid; }
+
+    private:
+        const char* mPosition;
+        const char* mEnd;
+        bool mValid = true;
+    };
+
+    namespace id
+    {
+        using id = const juce::Identifier;
+
+        id stateInfo = "State Information";
+        id connection = "Connection Information";
+        id bus = "Bus Information";
+        id uuid = "UUID";
+        id mode = "Mode";
+        id name = "Name";
+        id domain = "Domain";
+        id sharedRouting = "Shared Routing";
+
+        id on = "Parameter On";
+        id gain = "Parameter Gain";
+        id delay = "Parameter Delay";
+        id delayCorr = "Parameter Delay Correction";
+        id prot = "Parameter Overdrive Protection";
+    }
+
+    Mode toMode(int value)
+    {
+        return value == (int)Mode::transmit || value == (int)Mode::recieve
+            ? static_cast<Mode>(value)
+            : Mode::bypass;
+    }
+
+    OverdriveProtection toProtection(int value)
+    {
+        return value == (int)OverdriveProtection::clip
+            ? OverdriveProtection::clip
+            : OverdriveProtection::off;
+    }
+}
+
+ConnectionRecord ConnectionRecord::fromParameters(const juce::Uuid& peer, const ConnectionParameters& parameters)
+{
+    ConnectionRecord record;
+    record.peer = peer;
+    record.on = parameters.on.getValue();
+    record.gain = parameters.gain.getValue();
+    record.delay = parameters.delay.getValue();
+    record.delayCorrection = parameters.delayCorrection.getValue();
+    record.protection = parameters.protection.getValue();
+    return record;
+}
+
+void ConnectionRecord::applyTo(ConnectionParameters& parameters) const
+{
+    parameters.on.setValue(on);
+    parameters.gain.setValue(gain);
+    parameters.delay.setValue(delay);
+    parameters.delayCorrection.setValue(delayCorrection);
+    parameters.protection.setValue(protection);
+}
+
+bool ConnectionRecord::isDefault() const
+{
+    const ConnectionRecord defaults;
+    return on == defaults.on
+        && gain == defaults.gain
+        && delay == defaults.delay
+        && delayCorrection == defaults.delayCorrection
+        && protection == defaults.protection;
+}
+
+void InstanceState::writeBinary(juce::MemoryBlock& destination) const
+{
+    const size_t nameSize = name.has_value() ? name->getNumBytesAsUTF8() : 0;
+    const size_t nameBlockSize = name.has_value() ? sizeof(uint32_t) + nameSize : 0;
+
+    size_t busBlockSize = 0;
+    if(!buses.empty())
+    {
+        busBlockSize = sizeof(uint32_t);
+        for(const BusRecord& bus : buses)
+            busBlockSize += 16 + sizeof(uint32_t) + bus.name.getNumBytesAsUTF8();
+    }
+
+    const size_t domainSize = domain.has_value() ? domain->getNumBytesAsUTF8() : 0;
+    const size_t domainBlockSize = domain.has_value() ? sizeof(uint32_t) + domainSize : 0;
+
+    // sized once, everything after is plain copies
+    destination.setSize(headerSize + nameBlockSize + connections.size() * recordSize + busBlockSize
+                        + domainBlockSize,
+                        false);
+    BinaryWriter writer(static_cast<char*>(destination.getData()));
+
+    writer.writeBytes(magic, sizeof(magic));
+    writer.write<uint16_t>(currentVersion);
+    writer.write<uint16_t>((name.has_value() ? hasNameFlag : 0)
+                           | (buses.empty() ? 0 : hasBusesFlag)
+                           | (domain.has_value() ? hasDomainFlag : 0)
+                           | (sharedRouting ? sharedRoutingFlag : 0));
+    writer.writeBytes(id.getRawData(), 16);
+    writer.write<int32_t>((int32_t)mode);
+    writer.write<uint32_t>((uint32_t)connections.size());
+
+    if(name.has_value())
+    {
+        writer.write<uint32_t>((uint32_t)nameSize);
+        writer.writeBytes(name->toRawUTF8(), nameSize);
+    }
+
+    for(const ConnectionRecord& record : connections)
+    {
+        const uint8_t flags = (record.on ? onFlag : 0)
+                            | (record.delayCorrection ? delayCorrectionFlag : 0);
+
+        writer.writeBytes(record.peer.getRawData(), 16);
+        writer.write<float>(record.gain);
+        writer.write<int32_t>(record.delay);
+        writer.write<uint8_t>(flags);
+        writer.write<uint8_t>((uint8_t)record.protection);
+        writer.write<uint16_t>(0);
+    }
+
+    if(!buses.empty())
+    {
+        writer.write<uint32_t>((uint32_t)buses.size());
+        for(const BusRecord& bus : buses)
+        {
+            const size_t busNameSize = bus.name.getNumBytesAsUTF8();
+            writer.writeBytes(bus.id.getRawData(), 16);
+            writer.write<uint32_t>((uint32_t)busNameSize);
+            writer.writeBytes(bus.name.toRawUTF8(), busNameSize);
+        }
+    }
+
+    if(domain.has_value())
+    {
+        writer.write<uint32_t>((uint32_t)domainSize);
+        writer.writeBytes(domain->toRawUTF8(), domainSize);
+    }
+}
+
+std::optional<InstanceState> InstanceState::read(const void* data, size_t sizeInBytes)
+{
+    if(sizeInBytes >= sizeof(magic) && std::memcmp(data, magic, sizeof(magic)) == 0)
+        return readBinary(data, sizeInBytes);
+
+    return readValueTree(data, sizeInBytes);
+}
+
+std::optional<InstanceState> InstanceState::readBinary(const void* data, size_t sizeInBytes)
+{
+    BinaryReader reader(data, sizeInBytes);
+
+    char header[sizeof(magic)];
+    reader.readBytes(header, sizeof(header));
+    const auto version = reader.read<uint16_t>();
+    const auto flags = reader.read<uint16_t>();
+
+    if(!reader.isValid() || std::memcmp(header, magic, sizeof(magic)) != 0) return std::nullopt;
+    if(version == 0 || version > currentVersion) return std::nullopt;
+
+    InstanceState state;
+    state.id = reader.readUuid();
+    state.mode = toMode(reader.read<int32_t>());
+    state.sharedRouting = flags & sharedRoutingFlag;
+    const auto numberOfConnections = reader.read<uint32_t>();
+
+    if(flags & hasNameFlag)
+    {
+        const auto nameSize = reader.read<uint32_t>();
+        const char* nameData = reader.getPosition();
+        reader.skip(nameSize);
+        if(reader.isValid())
+            state.name = juce::String::fromUTF8(nameData, (int)nameSize);
+    }
+
+    // checked up front, so a corrupt count cannot make us reserve gigabytes
+    if(!reader.isValid() || reader.getRemaining() / recordSize < numberOfConnections)
+        return std::nullopt;
+
+    state.connections.resize(numberOfConnections);
+    for(ConnectionRecord& record : state.connections)
+    {
+        record.peer = reader.readUuid();
+        record.gain = reader.read<float>();
+        record.delay = reader.read<int32_t>();
+        const auto recordFlags = reader.read<uint8_t>();
+        record.protection = toProtection(reader.read<uint8_t>());
+        reader.skip(2);
+
+        record.on = recordFlags & onFlag;
+        record.delayCorrection = recordFlags & delayCorrectionFlag;
+    }
+
+    if(flags & hasBusesFlag)
+    {
+        const auto numberOfBuses = reader.read<uint32_t>();
+
+        // every bus takes at least its uuid and the size of its name
+        if(!reader.isValid() || reader.getRemaining() / (16 + sizeof(uint32_t)) < numberOfBuses)
+            return std::nullopt;
+
+        state.buses.resize(numberOfBuses);
+        for(BusRecord& bus : state.buses)
+        {
+            bus.id = reader.readUuid();
+            const auto busNameSize = reader.read<uint32_t>();
+            const char* busNameData = reader.getPosition();
+            reader.skip(busNameSize);
+            if(reader.isValid())
+                bus.name = juce::String::fromUTF8(busNameData, (int)busNameSize);
+        }
+    }
+
+    if(flags & hasDomainFlag)
+    {
+        const auto domainSize = reader.read<uint32_t>();
+        const char* domainData = reader.getPosition();
+        reader.skip(domainSize);
+        if(reader.isValid())
+            state.domain = juce::String::fromUTF8(domainData, (int)domainSize);
+    }
+
+    if(!reader.isValid()) return std::nullopt;
+    return state;
+}
+
+std::optional<InstanceState> InstanceState::readValueTree(const void* data, size_t sizeInBytes)
+{
+    juce::MemoryInputStream input(data, sizeInBytes, false);
+    const juce::ValueTree info = juce::ValueTree::readFromStream(input);
+    if(!info.isValid() || info.getType() != id::stateInfo) return std::nullopt;
+
+    return fromValueTree(info);
+}
+
+juce::ValueTree InstanceState::toValueTree() const
+{
+    juce::ValueTree info(id::stateInfo);
+    info.setProperty(id::uuid, id.toString(), nullptr);
+    info.setProperty(id::mode, (int)mode, nullptr);
+    if(name.has_value())
+        info.setProperty(id::name, name.value(), nullptr);
+    if(domain.has_value())
+        info.setProperty(id::domain, domain.value(), nullptr);
+    if(sharedRouting)
+        info.setProperty(id::sharedRouting, true, nullptr);
+
+    for(const ConnectionRecord& record : connections)
+    {
+        juce::ValueTree connection(id::connection);
+        connection.setProperty(id::on, record.on, nullptr);
+        connection.setProperty(id::gain, record.gain, nullptr);
+        connection.setProperty(id::delay, record.delay, nullptr);
+        connection.setProperty(id::delayCorr, record.delayCorrection, nullptr);
+        connection.setProperty(id::prot, (int)record.protection, nullptr);
+        connection.setProperty(id::uuid, record.peer.toString(), nullptr);
+        info.addChild(connection, -1, nullptr);
+    }
+
+    for(const BusRecord& record : buses)
+    {
+        juce::ValueTree bus(id::bus);
+        bus.setProperty(id::uuid, record.id.toString(), nullptr);
+        bus.setProperty(id::name, record.name, nullptr);
+        info.addChild(bus, -1, nullptr);
+    }
+
+    return info;
+}
+
+InstanceState InstanceState::fromValueTree(const juce::ValueTree& info)
+{
+    InstanceState state;
+    state.id = juce::Uuid(info.getProperty(id::uuid).toString());
+    state.mode = toMode(info.getProperty(id::mode));
+    if(info.hasProperty(id::name))
+        state.name = info.getProperty(id::name).toString();
+    if(info.hasProperty(id::domain))
+        state.domain = info.getProperty(id::domain).toString();
+    state.sharedRouting = info.getProperty(id::sharedRouting);
+
+    state.connections.reserve((size_t)info.getNumChildren());
+    for(const juce::ValueTree& child : info)
+    {
+        if(child.getType() == id::bus)
+        {
+            state.buses.push_back({ juce::Uuid(child.getProperty(id::uuid).toString()),
+                                    child.getProperty(id::name).toString() });
+            continue;
+        }
+
+        const juce::ValueTree& connection = child;
+        ConnectionRecord record;
+        record.peer = juce::Uuid(connection.getProperty(id::uuid).toString());
+        record.on = connection.getProperty(id::on);
+        record.gain = connection.getProperty(id::gain);
+        record.delay = connection.getProperty(id::delay);
+        record.delayCorrection = connection.getProperty(id::delayCorr);
+        record.protection = toProtection(connection.getProperty(id::prot));
+        state.connections.push_back(record);
+    }
+
+    return state;
+}
@@ -0,0 +1,67 @@
+/*  Everything an Instance saves with the session. Written as a compact binary
+    chunk, see InstanceState.cpp for the layout. The ValueTree format of earlier
+    versions can still be read.
+*/
+
+#pragma once
+
+#include "juce_data_structures/juce_data_structures.h"
+#include <optional>
+#include <vector>
+
+#include "Instance.h"
+#include "ConnectionParameters.h"
+
+namespace patch
+{
+
+// The parameters of one connection, peer is the instance on the other end.
+struct ConnectionRecord
+{
+    juce::Uuid peer;
+    bool on = false;
+    float gain = 0.f;
+    int delay = 0;
+    bool delayCorrection = false;
+    OverdriveProtection protection = OverdriveProtection::off;
+
+    static ConnectionRecord fromParameters(const juce::Uuid& peer, const ConnectionParameters& parameters);
+    void applyTo(ConnectionParameters& parameters) const;
+    // Same as a connection that was never edited, nothing to restore.
+    bool isDefault() const;
+};
+
+// A bus the instance is connected to, saved with every instance connected
+// to it, so it is back before their connections are.
+struct BusRecord
+{
+    juce::Uuid id;
+    juce::String name;
+};
+
+struct InstanceState
+{
+    static constexpr uint16_t currentVersion = 4;
+
+    juce::Uuid id;
+    Mode mode = Mode::bypass;
+    std::optional<juce::String> name;
+    // the routing domain, nullopt for the default one
+    std::optional<juce::String> domain;
+    // whether the domain routes to other processes, see Core::enableSharedRouting
+    bool sharedRouting = false;
+    std::vector<ConnectionRecord> connections;
+    std::vector<BusRecord> buses;
+
+    void writeBinary(juce::MemoryBlock& destination) const;
+
+    // Either format, nullopt if the data is neither or from a newer version.
+    static std::optional<InstanceState> read(const void* data, size_t sizeInBytes);
+    static std::optional<InstanceState> readBinary(const void* data, size_t sizeInBytes);
+    static std::optional<InstanceState> readValueTree(const void* data, size_t sizeInBytes);
+
+    juce::ValueTree toValueTree() const;
+    static InstanceState fromValueTree(const juce::ValueTree& info);
+};
+
+} // namespace patch
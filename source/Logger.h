@@ -9,6 +9,7 @@
 #include <iostream>
 #include <juce_data_structures/juce_data_structures.h>
 #include "Singleton.h"
+#include "Tracer.h"
 
 #ifndef LOG_LEVEL
     /*
@@ -24,6 +25,15 @@
     #define LOG_NUM_DECIMALS 4
 #endif
 
+#ifndef TRACE_ENABLED
+    /*
+        0: Trace macros compile to nothing.
+        1: Trace macros are compiled in, but only record while the Tracer is
+           running. When it is not, a scope costs a single relaxed atomic load.
+    */
+    #define TRACE_ENABLED 1
+#endif
+
 namespace patch
 {
 
@@ -202,6 +212,21 @@ private:
     #define MY_LOG_INFO(MSG, ...)
 #endif
 
+#define MY_TRACE_JOIN_IMPL(A, B) A##B
+#define MY_TRACE_JOIN(A, B) MY_TRACE_JOIN_IMPL(A, B)
+
+// Should be used to mark a scope on the trace timeline, see Tracer.h. NAME has
+// to be a string literal, ID is the juce::Uuid of the instance involved.
+#if TRACE_ENABLED
+    #define MY_TRACE_SCOPE(NAME)                                                \
+        patch::ScopedTraceEvent MY_TRACE_JOIN(traceEvent, __COUNTER__)(NAME)
+    #define MY_TRACE_SCOPE_ID(NAME, ID)                                         \
+        patch::ScopedTraceEvent MY_TRACE_JOIN(traceEvent, __COUNTER__)(NAME, ID)
+#else
+    #define MY_TRACE_SCOPE(NAME)
+    #define MY_TRACE_SCOPE_ID(NAME, ID)
+#endif
+
 // Expect condition and return if false. Log msg provided in __VA_ARGS__
 #define EXPECT_OR_RETURN(COND, VALUE, MSG, ...) ENFORCE_SEMICOLON(              \
     if (!(COND))                                                                \
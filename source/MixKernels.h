@@ -0,0 +1,453 @@
+/*  Inner loops of the routing. Mixing and metering happen in the same pass, so
+    the levels shown in the editor cost no extra trip over the audio. Plain
+    loops are kept as the reference and as the fallback where no vector
+    instructions are available. Everything works on float and on double, and
+    on any number of channels at once, the channel loops are unrolled.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#ifndef DOUBLE_PRECISION_ROUTING
+    /*
+        0: Core routes in float. Blocks of hosts processing in double are
+           converted while they are copied in and out of Core.
+        1: Core routes in double, blocks in float are converted instead.
+    */
+    #define DOUBLE_PRECISION_ROUTING 0
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PATCH_USE_SSE 1
+    #include <emmintrin.h>
+#else
+    #define PATCH_USE_SSE 0
+#endif
+
+namespace patch
+{
+
+// What the buffers of Core hold.
+#if DOUBLE_PRECISION_ROUTING
+using RoutingSample = double;
+#else
+using RoutingSample = float;
+#endif
+
+// Collects level information over one or more calls of the kernels.
+struct LevelAccumulator
+{
+    float peak = 0.f;
+    float sumOfSquares = 0.f;
+    size_t numberOfSamples = 0;
+
+    float getRms() const
+    {
+        return numberOfSamples > 0
+            ? std::sqrt(sumOfSquares / (float)numberOfSamples)
+            : 0.f;
+    }
+};
+
+// Written by the audio thread once per block, polled by the editor.
+struct LevelMeter
+{
+    std::atomic<float> peak = 0.f;
+    std::atomic<float> rms = 0.f;
+
+    void publish(const LevelAccumulator& level)
+    {
+        peak.store(level.peak, std::memory_order_relaxed);
+        rms.store(level.getRms(), std::memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        peak.store(0.f, std::memory_order_relaxed);
+        rms.store(0.f, std::memory_order_relaxed);
+    }
+};
+
+namespace kernels
+{
+
+namespace detail
+{
+
+#if PATCH_USE_SSE
+// The vector instructions the kernels use, for either precision.
+template<typename SampleType>
+struct Simd
+{
+    static constexpr bool available = false;
+};
+
+template<>
+struct Simd<float>
+{
+    static constexpr bool available = true;
+    static constexpr size_t width = 4;
+    using Vector = __m128;
+
+    static Vector zero() { return _mm_setzero_ps(); }
+    static Vector broadcast(float value) { return _mm_set1_ps(value); }
+    static Vector load(const float* source) { return _mm_loadu_ps(source); }
+    static void store(float* destination, Vector value) { _mm_storeu_ps(destination, value); }
+    static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+    static Vector subtract(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+    static Vector multiply(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+    static Vector max(Vector a, Vector b) { return _mm_max_ps(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    static Vector abs(Vector value)
+    {
+        return _mm_and_ps(value, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+    }
+
+    static void reduce(Vector peak, Vector sumOfSquares, LevelAccumulator& level)
+    {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, peak);
+        level.peak = std::max({ level.peak, lanes[0], lanes[1], lanes[2], lanes[3] });
+        _mm_store_ps(lanes, sumOfSquares);
+        level.sumOfSquares += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+};
+
+template<>
+struct Simd<double>
+{
+    static constexpr bool available = true;
+    static constexpr size_t width = 2;
+    using Vector = __m128d;
+
+    static Vector zero() { return _mm_setzero_pd(); }
+    static Vector broadcast(double value) { return _mm_set1_pd(value); }
+    static Vector load(const double* source) { return _mm_loadu_pd(source); }
+    static void store(double* destination, Vector value) { _mm_storeu_pd(destination, value); }
+    static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+    static Vector subtract(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+    static Vector multiply(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+    static Vector max(Vector a, Vector b) { return _mm_max_pd(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm_min_pd(a, b); }
+    static Vector abs(Vector value)
+    {
+        return _mm_and_pd(value, _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffff)));
+    }
+
+    static void reduce(Vector peak, Vector sumOfSquares, LevelAccumulator& level)
+    {
+        alignas(16) double lanes[2];
+        _mm_store_pd(lanes, peak);
+        level.peak = std::max({ level.peak, (float)lanes[0], (float)lanes[1] });
+        _mm_store_pd(lanes, sumOfSquares);
+        level.sumOfSquares += (float)(lanes[0] + lanes[1]);
+    }
+};
+#endif
+
+// Calls function(channel) for every channel, unrolled.
+template<size_t numberOfChannels, typename Function>
+inline void forEachChannel(Function&& function)
+{
+    [&]<size_t... channel>(std::index_sequence<channel...>)
+    {
+        (function(channel), ...);
+    }(std::make_index_sequence<numberOfChannels>{});
+}
+
+template<bool measureDestination, typename SampleType>
+inline void mixSample(SampleType& destination, SampleType scaled,
+                      LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+{
+    const SampleType mixed = destination + scaled;
+    destination = mixed;
+
+    sourceLevel.peak = std::max(sourceLevel.peak, (float)std::abs(scaled));
+    sourceLevel.sumOfSquares += (float)(scaled * scaled);
+
+    if constexpr (measureDestination)
+    {
+        destinationLevel.peak = std::max(destinationLevel.peak, (float)std::abs(mixed));
+        destinationLevel.sumOfSquares += (float)(mixed * mixed);
+    }
+}
+
+// The scaled source limited to full scale with clip, see OverdriveProtection.
+template<bool clip, typename SampleType>
+inline SampleType limit(SampleType scaled)
+{
+    if constexpr (clip)
+        return std::clamp(scaled, (SampleType)-1, (SampleType)1);
+    else
+        return scaled;
+}
+
+// Cubic Hermite spline through x1 and x2 at fraction f, x0 and x3 give the
+// slopes. Exactly x1 at f = 0.
+template<typename SampleType>
+inline SampleType interpolate(SampleType x0, SampleType x1, SampleType x2, SampleType x3,
+                              SampleType f)
+{
+    const SampleType c1 = (SampleType)0.5 * (x2 - x0);
+    const SampleType c2 = x0 - (SampleType)2.5 * x1 + (SampleType)2 * x2 - (SampleType)0.5 * x3;
+    const SampleType c3 = (SampleType)0.5 * (x3 - x0) + (SampleType)1.5 * (x1 - x2);
+    return ((c3 * f + c2) * f + c1) * f + x1;
+}
+
+} // namespace detail
+
+/*  destinations[ch][i] += sources[ch][i] * gain
+    All channels in one pass over the samples. The level of the scaled sources
+    goes into sourceLevel. If measureDestination is set, the level of the
+    result goes into destinationLevel as well, use this for the last source
+    mixed into a buffer. Levels are over all channels. With clip the scaled
+    sources are limited to [-1, 1] before they are mixed, this and the kernels
+    below measure them after that.
+*/
+template<size_t numberOfChannels, bool measureDestination, typename SampleType, bool clip = false>
+inline void mixChannelsAndMeasure(const std::array<SampleType*, numberOfChannels>& destinations,
+                                  const std::array<const SampleType*, numberOfChannels>& sources,
+                                  std::type_identity_t<SampleType> gain, size_t numberOfSamples,
+                                  LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+{
+    size_t i = 0;
+
+#if PATCH_USE_SSE
+    using Simd = detail::Simd<SampleType>;
+    if constexpr (Simd::available)
+    {
+        const auto gainVector = Simd::broadcast(gain);
+        [[maybe_unused]] const auto fullScale = Simd::broadcast((SampleType)1);
+        [[maybe_unused]] const auto negativeFullScale = Simd::broadcast((SampleType)-1);
+        auto sourcePeak = Simd::zero();
+        auto sourceSum = Simd::zero();
+        auto destinationPeak = Simd::zero();
+        auto destinationSum = Simd::zero();
+
+        for (; i + Simd::width <= numberOfSamples; i += Simd::width)
+        {
+            detail::forEachChannel<numberOfChannels>([&](size_t ch)
+            {
+                auto scaled = Simd::multiply(Simd::load(sources[ch] + i), gainVector);
+                if constexpr (clip)
+                    scaled = Simd::min(Simd::max(scaled, negativeFullScale), fullScale);
+                const auto mixed = Simd::add(Simd::load(destinations[ch] + i), scaled);
+                Simd::store(destinations[ch] + i, mixed);
+
+                sourcePeak = Simd::max(sourcePeak, Simd::abs(scaled));
+                sourceSum = Simd::add(sourceSum, Simd::multiply(scaled, scaled));
+
+                if constexpr (measureDestination)
+                {
+                    destinationPeak = Simd::max(destinationPeak, Simd::abs(mixed));
+                    destinationSum = Simd::add(destinationSum, Simd::multiply(mixed, mixed));
+                }
+            });
+        }
+
+        Simd::reduce(sourcePeak, sourceSum, sourceLevel);
+        if constexpr (measureDestination)
+            Simd::reduce(destinationPeak, destinationSum, destinationLevel);
+    }
+#endif
+
+    for (; i < numberOfSamples; i++)
+    {
+        detail::forEachChannel<numberOfChannels>([&](size_t ch)
+        {
+            detail::mixSample<measureDestination>(destinations[ch][i],
+                                                  detail::limit<clip>(sources[ch][i] * gain),
+                                                  sourceLevel, destinationLevel);
+        });
+    }
+
+    sourceLevel.numberOfSamples += numberOfSamples * numberOfChannels;
+    if constexpr (measureDestination)
+        destinationLevel.numberOfSamples += numberOfSamples * numberOfChannels;
+}
+
+/*  destinations[ch][i] += sources[ch][i * sourceStride] * (gain + i * gainIncrement)
+    For fades and for reading backwards. Both are rare enough that the plain
+    loop does.
+*/
+template<size_t numberOfChannels, bool measureDestination, typename SampleType, bool clip = false>
+inline void mixChannelsAndMeasureRamp(const std::array<SampleType*, numberOfChannels>& destinations,
+                                      const std::array<const SampleType*, numberOfChannels>& sources,
+                                      ptrdiff_t sourceStride, std::type_identity_t<SampleType> gain,
+                                      std::type_identity_t<SampleType> gainIncrement,
+                                      size_t numberOfSamples, LevelAccumulator& sourceLevel,
+                                      LevelAccumulator& destinationLevel)
+{
+    for (size_t i = 0; i < numberOfSamples; i++)
+    {
+        const SampleType sampleGain = gain + (SampleType)i * gainIncrement;
+        detail::forEachChannel<numberOfChannels>([&](size_t ch)
+        {
+            detail::mixSample<measureDestination>(
+                destinations[ch][i],
+                detail::limit<clip>(sources[ch][(ptrdiff_t)i * sourceStride] * sampleGain),
+                sourceLevel, destinationLevel);
+        });
+    }
+
+    sourceLevel.numberOfSamples += numberOfSamples * numberOfChannels;
+    if constexpr (measureDestination)
+        destinationLevel.numberOfSamples += numberOfSamples * numberOfChannels;
+}
+
+// One channel of the above.
+template<bool measureDestination, typename SampleType>
+inline void mixAndMeasure(SampleType* destination, const SampleType* source,
+                          std::type_identity_t<SampleType> gain, size_t numberOfSamples,
+                          LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+{
+    mixChannelsAndMeasure<1, measureDestination, SampleType>({ destination }, { source }, gain,
+                                                             numberOfSamples, sourceLevel,
+                                                             destinationLevel);
+}
+
+template<bool measureDestination, typename SampleType>
+inline void mixAndMeasureRamp(SampleType* destination, const SampleType* source, ptrdiff_t sourceStride,
+                              std::type_identity_t<SampleType> gain,
+                              std::type_identity_t<SampleType> gainIncrement, size_t numberOfSamples,
+                              LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+{
+    mixChannelsAndMeasureRamp<1, measureDestination, SampleType>({ destination }, { source },
+                                                                 sourceStride, gain, gainIncrement,
+                                                                 numberOfSamples, sourceLevel,
+                                                                 destinationLevel);
+}
+
+/*  destinations[ch][i] += interpolated(sources[ch], position + i * step) * gain
+    Mixes while changing the rate, for connections between endpoints whose
+    clocks drift apart. Every position is interpolated from the four samples
+    around it, so sources[ch] has to hold one sample before the first
+    position and two after the last. Steps of 1 from a whole position copy
+    the samples exactly. The positions are shared by all channels, the
+    splines are evaluated for several samples at once.
+*/
+template<size_t numberOfChannels, bool measureDestination, typename SampleType, bool clip = false>
+inline void resampleChannelsAndMix(const std::array<SampleType*, numberOfChannels>& destinations,
+                                   const std::array<const SampleType*, numberOfChannels>& sources,
+                                   double position, double step,
+                                   std::type_identity_t<SampleType> gain, size_t numberOfSamples,
+                                   LevelAccumulator& sourceLevel, LevelAccumulator& destinationLevel)
+{
+    size_t i = 0;
+
+#if PATCH_USE_SSE
+    using Simd = detail::Simd<SampleType>;
+    if constexpr (Simd::available)
+    {
+        const auto gainVector = Simd::broadcast(gain);
+        [[maybe_unused]] const auto fullScale = Simd::broadcast((SampleType)1);
+        [[maybe_unused]] const auto negativeFullScale = Simd::broadcast((SampleType)-1);
+        const auto half = Simd::broadcast((SampleType)0.5);
+        const auto oneAndHalf = Simd::broadcast((SampleType)1.5);
+        const auto two = Simd::broadcast((SampleType)2);
+        const auto twoAndHalf = Simd::broadcast((SampleType)2.5);
+        auto sourcePeak = Simd::zero();
+        auto sourceSum = Simd::zero();
+        auto destinationPeak = Simd::zero();
+        auto destinationSum = Simd::zero();
+
+        for (; i + Simd::width <= numberOfSamples; i += Simd::width)
+        {
+            size_t indices[Simd::width];
+            alignas(16) SampleType fractions[Simd::width];
+            for (size_t lane = 0; lane < Simd::width; lane++)
+            {
+                const double lanePosition = position + (double)(i + lane) * step;
+                indices[lane] = (size_t)lanePosition;
+                fractions[lane] = (SampleType)(lanePosition - (double)indices[lane]);
+            }
+            const auto f = Simd::load(fractions);
+
+            detail::forEachChannel<numberOfChannels>([&](size_t ch)
+            {
+                // the four neighbours of every lane, the only part done lane by lane
+                alignas(16) SampleType x[4][Simd::width];
+                for (size_t lane = 0; lane < Simd::width; lane++)
+                    for (size_t tap = 0; tap < 4; tap++)
+                        x[tap][lane] = sources[ch][indices[lane] + tap - 1];
+
+                const auto x0 = Simd::load(x[0]);
+                const auto x1 = Simd::load(x[1]);
+                const auto x2 = Simd::load(x[2]);
+                const auto x3 = Simd::load(x[3]);
+                const auto c1 = Simd::multiply(half, Simd::subtract(x2, x0));
+                const auto c2 = Simd::subtract(Simd::add(Simd::subtract(x0, Simd::multiply(twoAndHalf, x1)),
+                                                         Simd::multiply(two, x2)),
+                                               Simd::multiply(half, x3));
+                const auto c3 = Simd::add(Simd::multiply(half, Simd::subtract(x3, x0)),
+                                          Simd::multiply(oneAndHalf, Simd::subtract(x1, x2)));
+                const auto interpolated = Simd::add(
+                    Simd::multiply(Simd::add(Simd::multiply(Simd::add(Simd::multiply(c3, f), c2), f), c1), f),
+                    x1);
+
+                auto scaled = Simd::multiply(interpolated, gainVector);
+                if constexpr (clip)
+                    scaled = Simd::min(Simd::max(scaled, negativeFullScale), fullScale);
+                const auto mixed = Simd::add(Simd::load(destinations[ch] + i), scaled);
+                Simd::store(destinations[ch] + i, mixed);
+
+                sourcePeak = Simd::max(sourcePeak, Simd::abs(scaled));
+                sourceSum = Simd::add(sourceSum, Simd::multiply(scaled, scaled));
+
+                if constexpr (measureDestination)
+                {
+                    destinationPeak = Simd::max(destinationPeak, Simd::abs(mixed));
+                    destinationSum = Simd::add(destinationSum, Simd::multiply(mixed, mixed));
+                }
+            });
+        }
+
+        Simd::reduce(sourcePeak, sourceSum, sourceLevel);
+        if constexpr (measureDestination)
+            Simd::reduce(destinationPeak, destinationSum, destinationLevel);
+    }
+#endif
+
+    for (; i < numberOfSamples; i++)
+    {
+        const double samplePosition = position + (double)i * step;
+        const size_t index = (size_t)samplePosition;
+        const SampleType fraction = (SampleType)(samplePosition - (double)index);
+
+        detail::forEachChannel<numberOfChannels>([&](size_t ch)
+        {
+            const SampleType* source = sources[ch] + index;
+            const SampleType interpolated = detail::interpolate(source[-1], source[0], source[1],
+                                                                source[2], fraction);
+            detail::mixSample<measureDestination>(destinations[ch][i],
+                                                  detail::limit<clip>(interpolated * gain),
+                                                  sourceLevel, destinationLevel);
+        });
+    }
+
+    sourceLevel.numberOfSamples += numberOfSamples * numberOfChannels;
+    if constexpr (measureDestination)
+        destinationLevel.numberOfSamples += numberOfSamples * numberOfChannels;
+}
+
+/*  destination[i] += source[i], from one precision to the other
+    Where blocks enter and leave Core in a precision it does not route in. The
+    conversion happens in the copy that is made anyway.
+*/
+template<typename DestinationType, typename SourceType>
+inline void addConverted(DestinationType* destination, const SourceType* source, size_t numberOfSamples)
+{
+    for (size_t i = 0; i < numberOfSamples; i++)
+        destination[i] += (DestinationType)source[i];
+}
+
+} // namespace kernels
+
+} // namespace patch
@@ -0,0 +1,248 @@
+#pragma once
+#include "juce_gui_basics/juce_gui_basics.h"
+#include <vector>
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include "ConnectionParameters.h"
+
+/*  Widgets are kept in sync with an AtomicParameter by polling it, the
+    parameter itself knows nothing about them. Changes made on the widget are
+    written to the parameter right away, changes made anywhere else show up
+    with the next update(). Everything in here belongs to the message thread.
+*/
+
+namespace patch
+{
+
+
+// PatchToggleButton
+
+class PatchToggleButton
+{
+public:
+    PatchToggleButton()
+    {
+        button.onClick = [this]()
+        {
+            for(auto& callback : callbacks)
+            {
+                callback();
+            }
+        };
+
+        addCallback([this]()
+        {
+            for(auto listener : listeners)
+            {
+                listener->toggleStateChanged(this);
+            }
+        });
+    }
+
+    ~PatchToggleButton()
+    {
+        button.onStateChange = nullptr;
+        removeAllListeners();
+    }
+
+    void addCallback(std::function<void()> callback)
+    {
+        callbacks.emplace_back(callback);
+    }
+
+    bool getState() { return button.getToggleState(); }
+
+    void setState(bool state, juce::NotificationType sendNotifications) 
+    { 
+        button.setToggleState(state, sendNotifications); 
+    }
+
+    // DO NOT MESS WITH onStateChange FROM OUTSIDE THIS CLASS
+    juce::ToggleButton button;
+
+    class Listener
+    {
+    public:
+        virtual void toggleStateChanged(PatchToggleButton* emitter) = 0;
+    };
+
+    void addListener(Listener* listenerToAdd)
+    {
+        const auto it = std::find(listeners.begin(), listeners.end(), listenerToAdd);
+        if(it != listeners.end()) return; // already added 
+        listeners.push_back(listenerToAdd);
+    }
+
+    void removeListener(Listener* listenerToRemove)
+    {
+        const auto it = std::find(listeners.begin(), listeners.end(), listenerToRemove);
+        if(it == listeners.end()) return; // listener not found
+        listeners.erase(it);
+    }
+
+private:
+    void removeAllListeners()
+    {
+        listeners.clear();
+    }
+
+    std::vector<Listener*> listeners;
+    std::vector<std::function<void()>> callbacks;
+};
+
+// ToggleAttachment
+
+class ToggleAttachment : private PatchToggleButton::Listener
+{
+public:
+    explicit ToggleAttachment(PatchToggleButton& buttonToAttach)
+        : button(buttonToAttach)
+    {
+        button.addListener(this);
+    }
+
+    ~ToggleAttachment()
+    {
+        button.removeListener(this);
+    }
+
+    // nullptr detaches, the connection the parameter belongs to if any
+    void attach(AtomicParameter<bool>* parameterToAttach, ConnectionHandle owner = {})
+    {
+        parameter = parameterToAttach;
+        connection = owner;
+        update();
+    }
+
+    void update()
+    {
+        if(!isAttached()) return;
+        if(button.getState() != parameter->getValue())
+            button.setState(parameter->getValue(), juce::dontSendNotification);
+    }
+
+private:
+    void toggleStateChanged(PatchToggleButton* emitter) override
+    {
+        if(isAttached())
+            parameter->setValue(emitter->getState());
+    }
+
+    // a released connection detaches, its slot may hold another one by now
+    bool isAttached()
+    {
+        if(connection.isReleased()) parameter = nullptr;
+        return parameter != nullptr;
+    }
+
+    PatchToggleButton& button;
+    AtomicParameter<bool>* parameter = nullptr;
+    ConnectionHandle connection;
+};
+
+// SliderAttachment
+
+template<typename type = float>
+    requires std::is_floating_point_v<type>
+class SliderAttachment : private juce::Slider::Listener
+{
+public:
+    explicit SliderAttachment(juce::Slider& sliderToAttach)
+        : slider(sliderToAttach)
+    {
+        slider.addListener(this);
+    }
+
+    ~SliderAttachment() override
+    {
+        slider.removeListener(this);
+    }
+
+    // nullptr detaches, the connection the parameter belongs to if any
+    void attach(AtomicParameter<type>* parameterToAttach, ConnectionHandle owner = {})
+    {
+        parameter = parameterToAttach;
+        connection = owner;
+        update();
+    }
+
+    void update()
+    {
+        if(!isAttached()) return;
+        const double value = (double)parameter->getValue();
+        if(slider.getValue() != value)
+            slider.setValue(value, juce::dontSendNotification);
+    }
+
+private:
+    void sliderValueChanged(juce::Slider* emitter) override
+    {
+        if(isAttached())
+            parameter->setValue((type)emitter->getValue());
+    }
+
+    bool isAttached()
+    {
+        if(connection.isReleased()) parameter = nullptr;
+        return parameter != nullptr;
+    }
+
+    juce::Slider& slider;
+    AtomicParameter<type>* parameter = nullptr;
+    ConnectionHandle connection;
+};
+
+// ComboBoxAttachment
+
+template<typename Enum>
+    requires std::is_enum_v<Enum>
+class ComboBoxAttachment : private juce::ComboBox::Listener
+{
+public:
+    explicit ComboBoxAttachment(juce::ComboBox& comboBoxToAttach)
+        : comboBox(comboBoxToAttach)
+    {
+        comboBox.addListener(this);
+    }
+
+    ~ComboBoxAttachment() override
+    {
+        comboBox.removeListener(this);
+    }
+
+    // nullptr detaches, the connection the parameter belongs to if any
+    void attach(AtomicParameter<Enum>* parameterToAttach, ConnectionHandle owner = {})
+    {
+        parameter = parameterToAttach;
+        connection = owner;
+        update();
+    }
+
+    void update()
+    {
+        if(!isAttached()) return;
+        const int id = (int)parameter->getValue();
+        if(comboBox.getSelectedId() != id)
+            comboBox.setSelectedId(id, juce::dontSendNotification);
+    }
+
+private:
+    void comboBoxChanged(juce::ComboBox* comboBoxThatHasChanged) override
+    {
+        if(isAttached())
+            parameter->setValue((Enum)comboBoxThatHasChanged->getSelectedId());
+    }
+
+    bool isAttached()
+    {
+        if(connection.isReleased()) parameter = nullptr;
+        return parameter != nullptr;
+    }
+
+    juce::ComboBox& comboBox;
+    AtomicParameter<Enum>* parameter = nullptr;
+    ConnectionHandle connection;
+};
+
+} // namespace patch
@@ -0,0 +1,68 @@
+#pragma once
+
+/*  Owns the ConnectionParameters of Core. They are kept in fixed size chunks,
+    so neighbouring connections share cache lines and a pointer handed out
+    stays valid until it is released, no matter how many connections are added
+    after it.
+*/
+
+#include <memory>
+#include <vector>
+
+#include "ConnectionParameters.h"
+
+namespace patch
+{
+
+class ParameterStore
+{
+public:
+    static constexpr size_t chunkSize = 64;
+
+    // The returned parameters are at their defaults.
+    ConnectionParameters* allocate()
+    {
+        if(mFree.empty())
+        {
+            mChunks.push_back(std::make_unique<ConnectionParameters[]>(chunkSize));
+            ConnectionParameters* chunk = mChunks.back().get();
+            for(size_t i = chunkSize; i-- > 0;)
+                mFree.push_back(chunk + i);
+        }
+
+        ConnectionParameters* parameters = mFree.back();
+        mFree.pop_back();
+        mNumberOfAllocated++;
+        return parameters;
+    }
+
+    // Anything still holding the pointer must not use it anymore, the slot is
+    // handed out again by the next allocate. Holders that cannot know in time
+    // keep a ConnectionHandle.
+    void release(ConnectionParameters* parameters)
+    {
+        if(parameters == nullptr) return;
+
+        parameters->generation.fetch_add(1, std::memory_order_acq_rel);
+        parameters->on.setValue(false);
+        parameters->gain.setValue(0.f);
+        parameters->delay.setValue(0);
+        parameters->delayCorrection.setValue(false);
+        parameters->protection.setValue(OverdriveProtection::off);
+        parameters->level.clear();
+        parameters->cost.clear();
+
+        mFree.push_back(parameters);
+        mNumberOfAllocated--;
+    }
+
+    size_t getNumberOfAllocated() const { return mNumberOfAllocated; }
+    size_t getCapacity() const { return mChunks.size() * chunkSize; }
+
+private:
+    std::vector<std::unique_ptr<ConnectionParameters[]>> mChunks;
+    std::vector<ConnectionParameters*> mFree;
+    size_t mNumberOfAllocated = 0;
+};
+
+} // namespace patch
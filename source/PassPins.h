@@ -0,0 +1,93 @@
+#pragma once
+
+/*  What the recievers of a Core are reading. Every reciever has a pin, it
+    holds the tag of the oldest collection of blocks it may read while it
+    mixes, see Core::TransitSlot. A transit slot is only taken for another
+    collection once no pin is at or below the one it held. Pins are kept in
+    fixed size chunks that are never freed, so the audio threads scan them
+    without a lock while the message thread hands out more.
+*/
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "PerformanceCounters.h"
+
+namespace patch
+{
+
+class PassPins
+{
+public:
+    static constexpr size_t chunkSize = 64;
+    static constexpr size_t maxNumberOfChunks = 64;
+    // what allocate returns once every pin is taken
+    static constexpr size_t none = ~(size_t)0;
+    static constexpr uint64_t unpinned = ~(uint64_t)0;
+
+    // The message thread, with the routing lock held for writing. The pin is
+    // counted before anything that uses it is published.
+    size_t allocate()
+    {
+        if(mFree.empty())
+        {
+            const size_t chunk = mNumberOfPins.load(std::memory_order_relaxed) / chunkSize;
+            if(chunk == maxNumberOfChunks) return none;
+
+            mChunks[chunk] = std::make_unique<Pin[]>(chunkSize);
+            for(size_t i = chunkSize; i-- > 0;)
+                mFree.push_back(chunk * chunkSize + i);
+            mNumberOfPins.store((chunk + 1) * chunkSize, std::memory_order_release);
+        }
+
+        const size_t index = mFree.back();
+        mFree.pop_back();
+        return index;
+    }
+
+    // Once nothing reads with it anymore.
+    void release(size_t index)
+    {
+        if(index == none) return;
+
+        unpin(index);
+        mFree.push_back(index);
+    }
+
+    // Before the reader looks at which slot holds what, so a writer that
+    // reclaims a slot either sees the pin or the reader sees the slot taken.
+    void pin(size_t index, uint64_t tag) { at(index).store(tag, std::memory_order_seq_cst); }
+    void unpin(size_t index) { at(index).store(unpinned, std::memory_order_release); }
+
+    // After a slot was marked as reclaiming, whether any reader may still
+    // read what it held.
+    bool isAnyAtOrBelow(uint64_t tag) const
+    {
+        const size_t numberOfPins = mNumberOfPins.load(std::memory_order_acquire);
+        for(size_t index = 0; index < numberOfPins; index++)
+            if(at(index).load(std::memory_order_seq_cst) <= tag)
+                return true;
+
+        return false;
+    }
+
+private:
+    struct alignas(cacheLineSize) Pin
+    {
+        std::atomic<uint64_t> tag = unpinned;
+    };
+
+    std::atomic<uint64_t>& at(size_t index) const
+    {
+        return mChunks[index / chunkSize][index % chunkSize].tag;
+    }
+
+    std::array<std::unique_ptr<Pin[]>, maxNumberOfChunks> mChunks;
+    std::atomic<size_t> mNumberOfPins = 0;
+    std::vector<size_t> mFree;
+};
+
+} // namespace patch
@@ -0,0 +1,302 @@
+/*  Lock-free counters and histograms describing what routing costs. They are
+    written from the audio threads and read from the message thread through
+    value-type snapshots. Nothing in here locks or allocates, so it is safe to
+    record from inside processBlock.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <juce_core/juce_core.h>
+
+namespace patch
+{
+
+// Data written by different threads is kept at least this far apart, so they
+// do not keep taking the cache line away from each other.
+inline constexpr size_t cacheLineSize = 64;
+
+// DurationHistogram
+
+class DurationHistogram
+{
+public:
+    // bucket 0 holds everything below 1us, bucket n holds [2^(n-1), 2^n) us,
+    // the last bucket holds everything above that
+    static constexpr size_t numberOfBuckets = 18;
+
+    struct Snapshot
+    {
+        std::array<uint64_t, numberOfBuckets> buckets {};
+        uint64_t count = 0;
+        double totalSeconds = 0.0;
+        double maxSeconds = 0.0;
+        double lastSeconds = 0.0;
+
+        double getMeanSeconds() const
+        {
+            return count > 0 ? totalSeconds / (double)count : 0.0;
+        }
+
+        // Upper bound of the bucket that contains the given percentile.
+        double getPercentileSeconds(double percentile) const
+        {
+            if(count == 0) return 0.0;
+
+            const double target = (double)count * juce::jlimit(0.0, 1.0, percentile);
+            uint64_t accumulated = 0;
+            for(size_t i = 0; i < numberOfBuckets; i++)
+            {
+                accumulated += buckets[i];
+                if((double)accumulated >= target)
+                    return i + 1 < numberOfBuckets
+                        ? (double)(1ull << i) * 1.0e-6
+                        : maxSeconds;
+            }
+            return maxSeconds;
+        }
+    };
+
+    void record(juce::int64 ticks)
+    {
+        if(ticks < 0) ticks = 0;
+
+        const auto micros = (uint64_t)((ticks * 1000000) / ticksPerSecond());
+        size_t bucket = 0;
+        while(bucket + 1 < numberOfBuckets && (1ull << bucket) <= micros)
+            bucket++;
+
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+        lastTicks.store(ticks, std::memory_order_relaxed);
+
+        auto previousMax = maxTicks.load(std::memory_order_relaxed);
+        while(ticks > previousMax
+              && !maxTicks.compare_exchange_weak(previousMax, ticks, std::memory_order_relaxed))
+        {}
+    }
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        for(size_t i = 0; i < numberOfBuckets; i++)
+            snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        snapshot.count = count.load(std::memory_order_relaxed);
+        snapshot.totalSeconds = toSeconds(totalTicks.load(std::memory_order_relaxed));
+        snapshot.maxSeconds = toSeconds(maxTicks.load(std::memory_order_relaxed));
+        snapshot.lastSeconds = toSeconds(lastTicks.load(std::memory_order_relaxed));
+        return snapshot;
+    }
+
+    void reset()
+    {
+        for(auto& bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        totalTicks.store(0, std::memory_order_relaxed);
+        maxTicks.store(0, std::memory_order_relaxed);
+        lastTicks.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static juce::int64 ticksPerSecond()
+    {
+        static const juce::int64 value = juce::Time::getHighResolutionTicksPerSecond();
+        return value;
+    }
+
+    static double toSeconds(juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks);
+    }
+
+    std::array<std::atomic<uint64_t>, numberOfBuckets> buckets {};
+    std::atomic<uint64_t> count = 0;
+    std::atomic<juce::int64> totalTicks = 0;
+    std::atomic<juce::int64> maxTicks = 0;
+    std::atomic<juce::int64> lastTicks = 0;
+};
+
+// ScopedDurationMeasurement
+
+// Records the lifetime of the object into the histogram.
+class ScopedDurationMeasurement
+{
+public:
+    explicit ScopedDurationMeasurement(DurationHistogram& histogramToRecordInto)
+        : histogram(histogramToRecordInto)
+        , start(juce::Time::getHighResolutionTicks())
+    {}
+
+    ~ScopedDurationMeasurement()
+    {
+        histogram.record(juce::Time::getHighResolutionTicks() - start);
+    }
+
+private:
+    DurationHistogram& histogram;
+    const juce::int64 start;
+};
+
+// Counter
+
+// Padded to a cache line of its own, the counters of Core are added to from
+// every audio thread.
+class alignas(cacheLineSize) Counter
+{
+public:
+    void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    void set(uint64_t newValue) { value.store(newValue, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    void reset() { set(0); }
+
+private:
+    std::atomic<uint64_t> value = 0;
+};
+
+/*  InstanceStatistics
+    Kept by every Instance. Missed epochs are routing passes of Core that ran
+    without this instance processing a block in between. Epoch wait is the time
+    it spent waiting for the others before starting an epoch, which it only
+    does while rendering offline, see Core::isOffline.
+*/
+struct InstanceStatistics
+{
+    DurationHistogram processBlockDuration;
+    DurationHistogram epochWait;
+    Counter blocksProcessed;
+    Counter samplesProcessed;
+    Counter routingPassesTriggered;
+    Counter missedEpochs;
+
+    struct Snapshot
+    {
+        DurationHistogram::Snapshot processBlockDuration;
+        DurationHistogram::Snapshot epochWait;
+        uint64_t blocksProcessed = 0;
+        uint64_t samplesProcessed = 0;
+        uint64_t routingPassesTriggered = 0;
+        uint64_t missedEpochs = 0;
+    };
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.processBlockDuration = processBlockDuration.getSnapshot();
+        snapshot.epochWait = epochWait.getSnapshot();
+        snapshot.blocksProcessed = blocksProcessed.get();
+        snapshot.samplesProcessed = samplesProcessed.get();
+        snapshot.routingPassesTriggered = routingPassesTriggered.get();
+        snapshot.missedEpochs = missedEpochs.get();
+        return snapshot;
+    }
+
+    void reset()
+    {
+        processBlockDuration.reset();
+        epochWait.reset();
+        blocksProcessed.reset();
+        samplesProcessed.reset();
+        routingPassesTriggered.reset();
+        missedEpochs.reset();
+    }
+};
+
+/*  ConnectionStatistics
+    What mixing one connection cost since the statistics were reset, see
+    ConnectionCost.
+*/
+struct ConnectionStatistics
+{
+    juce::Uuid transmitter;
+    juce::Uuid reciever;
+    uint64_t ticks = 0;
+    uint64_t samples = 0;
+    uint64_t blocks = 0;
+
+    double getMeanSeconds() const
+    {
+        return blocks > 0
+                   ? juce::Time::highResolutionTicksToSeconds((juce::int64)ticks) / (double)blocks
+                   : 0.0;
+    }
+};
+
+/*  CoreStatistics
+    Kept by Core. Active edges is the number of connections that were on in
+    the last routing pass, silent skips count connections that were skipped
+    because they were off. Late epochs count instances that did not process a
+    block between two routing passes. Same block edges is the number of
+    connections delivered without latency, order violations count blocks in
+    which one of them found its transmitter not processed yet. Underruns and
+    overruns count connections to other processes that ran dry or fell too
+    far behind despite the drift compensation, each of them is a click.
+    Offline timeouts count routing passes of an offline render that started
+    without an instance that did not process its block in time.
+*/
+struct CoreStatistics
+{
+    DurationHistogram processRoutingDuration;
+    Counter routingPasses;
+    Counter samplesRouted;
+    Counter activeEdges;
+    Counter silentSkips;
+    Counter lateEpochs;
+    Counter sameBlockEdges;
+    Counter orderViolations;
+    Counter underruns;
+    Counter overruns;
+    Counter offlineTimeouts;
+
+    struct Snapshot
+    {
+        DurationHistogram::Snapshot processRoutingDuration;
+        uint64_t routingPasses = 0;
+        uint64_t samplesRouted = 0;
+        uint64_t activeEdges = 0;
+        uint64_t silentSkips = 0;
+        uint64_t lateEpochs = 0;
+        uint64_t sameBlockEdges = 0;
+        uint64_t orderViolations = 0;
+        uint64_t underruns = 0;
+        uint64_t overruns = 0;
+        uint64_t offlineTimeouts = 0;
+    };
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.processRoutingDuration = processRoutingDuration.getSnapshot();
+        snapshot.routingPasses = routingPasses.get();
+        snapshot.samplesRouted = samplesRouted.get();
+        snapshot.activeEdges = activeEdges.get();
+        snapshot.silentSkips = silentSkips.get();
+        snapshot.lateEpochs = lateEpochs.get();
+        snapshot.sameBlockEdges = sameBlockEdges.get();
+        snapshot.orderViolations = orderViolations.get();
+        snapshot.underruns = underruns.get();
+        snapshot.overruns = overruns.get();
+        snapshot.offlineTimeouts = offlineTimeouts.get();
+        return snapshot;
+    }
+
+    void reset()
+    {
+        processRoutingDuration.reset();
+        routingPasses.reset();
+        samplesRouted.reset();
+        activeEdges.reset();
+        silentSkips.reset();
+        lateEpochs.reset();
+        sameBlockEdges.reset();
+        orderViolations.reset();
+        underruns.reset();
+        overruns.reset();
+        offlineTimeouts.reset();
+    }
+};
+
+} // namespace patch
@@ -1,42 +1,54 @@
 #include "PluginEditor.h"
+#include "Logger.h"
 
 using namespace patch;
 
+namespace
+{
+    // Peak as a line, rms as a filled bar, on a -60..0 dB scale.
+    void drawLevelMeter(juce::Graphics& g, juce::Rectangle<int> area, float peak, float rms)
+    {
+        const auto toProportion = [](float gain)
+        {
+            const float decibels = juce::Decibels::gainToDecibels(gain, -60.f);
+            return juce::jlimit(0.f, 1.f, (decibels + 60.f) / 60.f);
+        };
+
+        g.setColour(juce::Colours::darkgrey);
+        g.fillRect(area);
+
+        const int rmsWidth = (int)((float)area.getWidth() * toProportion(rms));
+        g.setColour(peak >= 1.f ? juce::Colours::red : juce::Colours::limegreen);
+        g.fillRect(area.withWidth(rmsWidth));
+
+        const int peakX = area.getX() + (int)((float)area.getWidth() * toProportion(peak));
+        g.setColour(juce::Colours::white);
+        g.drawVerticalLine(juce::jmin(peakX, area.getRight() - 1),
+                           (float)area.getY(), (float)area.getBottom());
+    }
+}
+
 InstanceListModel::InstanceListModel(juce::Uuid instanceId)
     : id(instanceId)
+    , mode(Mode::bypass)
+    , mCore(nullptr)
+    , mInstanceList(nullptr)
 {}
 
 int InstanceListModel::getNumRows()
 {
-    if(mInstanceList)
-        return (int)mInstanceList->size();
-    else
-        return 0;
+    refreshRows();
+    return (int)mRows.size();
 }
 
 void InstanceListModel::paintListBoxItem 
 (int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
 {
-    if(rowNumber < 0 || rowNumber > getNumRows()) return;
+    refreshRows();
+    if(rowNumber < 0 || rowNumber >= (int)mRows.size()) return;
 
-    auto iter = mInstanceList->begin();
-    std::advance(iter, rowNumber);
-    const juce::String elementName = iter->second->getName();
-
-    ConnectionParameters* parameters = nullptr;
-    Core* core = Core::getInstance();
-    switch (mode)
-    {
-        case Mode::transmit :
-            parameters = core->getConnectionParameters(id, iter->first);
-            break;
-        case Mode::recieve :
-            parameters = core->getConnectionParameters(iter->first, id);
-            break;
-        case Mode::bypass :
-        default :
-            return;
-    }
+    const Row& row = mRows[(size_t)rowNumber];
+    ConnectionParameters* parameters = row.parameters.get();
 
     const bool isConnected = parameters 
         ? parameters->on.getValue()
@@ -44,7 +56,7 @@ void InstanceListModel::paintListBoxItem
 
     juce::Colour backgroundColor = isConnected 
         ? juce::Colours::lightgreen
-        : juce::Colours::lightblue;
+        : row.isBus ? juce::Colours::lightyellow : juce::Colours::lightblue;
 
     if(rowIsSelected)
         backgroundColor = backgroundColor.brighter();
@@ -53,32 +65,103 @@ void InstanceListModel::paintListBoxItem
     g.fillAll();
 
     auto textArea = juce::Rectangle<int>{0, 0, width, height}.reduced(8, 0);
+    if(isConnected && parameters)
+    {
+        auto meterArea = textArea.removeFromRight(juce::jmin(80, width / 3));
+        drawLevelMeter(g, meterArea.reduced(0, height / 3),
+                       parameters->level.peak.load(std::memory_order_relaxed),
+                       parameters->level.rms.load(std::memory_order_relaxed));
+    }
+
     g.setColour(juce::Colours::black);
-    g.drawFittedText(elementName, textArea, juce::Justification::centredLeft, 1);
+    g.drawFittedText(row.name, textArea, juce::Justification::centredLeft, 1);
 }
 
 void InstanceListModel::listBoxItemClicked (int row, const juce::MouseEvent& event)
 {
     juce::ignoreUnused(event);
-    if(row < 0 || row > getNumRows()) return;
+    refreshRows();
+    if(row < 0 || row >= (int)mRows.size()) return;
 
     if(onInstanceSelected)
-    {
-        auto iter = mInstanceList->begin();
-        std::advance(iter, row);
-        onInstanceSelected(iter->first);
-    }
+        onInstanceSelected(mRows[(size_t)row].id);
 }
 
 
 void InstanceListModel::setMode(patch::Mode instanceMode)
 {
     mode = instanceMode;
+    mRowsVersion = invalidVersion;
 }
 
-void InstanceListModel::setInstanceList(patch::Map<patch::Instance*>* instanceListPtr)
+void InstanceListModel::setInstanceList(patch::Core* core, patch::Map<patch::Instance*>* instanceListPtr)
 {
+    mCore = core;
     mInstanceList = instanceListPtr;
+    mRowsVersion = invalidVersion;
+}
+
+bool InstanceListModel::hasConnectedRows()
+{
+    refreshRows();
+    return std::any_of(mRows.begin(), mRows.end(), [](const Row& row)
+    {
+        const ConnectionParameters* parameters = row.parameters.get();
+        return parameters != nullptr && parameters->on.getValue();
+    });
+}
+
+bool InstanceListModel::refreshRows()
+{
+    Core* core = mCore;
+    if(core == nullptr) return false;
+    const uint64_t version = core->getTopologyVersion();
+    if(version == mRowsVersion) return false;
+
+    mRowsVersion = version;
+    mRows.clear();
+
+    if(mInstanceList == nullptr || mode == Mode::bypass) return true;
+
+    {
+        // the maps belong to Core, instances may come and go meanwhile
+        const juce::ScopedReadLock lock(core->getRoutingLock());
+
+        mRows.reserve(mInstanceList->size() + core->getBuses()->size());
+        for(auto& instkv : *mInstanceList)
+        {
+            ConnectionParameters* parameters = mode == Mode::transmit
+                ? core->getConnectionParameters(id, instkv.first)
+                : core->getConnectionParameters(instkv.first, id);
+
+            mRows.push_back({ instkv.second->getName(), instkv.first, parameters, false });
+        }
+
+        // transmitters of other processes, with shared routing
+        if(mode == Mode::recieve)
+            for(auto& transmitterkv : core->getRemoteTransmitters())
+                mRows.push_back({ transmitterkv.second + " (remote)", transmitterkv.first,
+                                  core->getConnectionParameters(transmitterkv.first, id), false });
+
+        for(auto& buskv : *core->getBuses())
+        {
+            ConnectionParameters* parameters = mode == Mode::transmit
+                ? core->getConnectionParameters(id, buskv.first)
+                : core->getConnectionParameters(buskv.first, id);
+
+            mRows.push_back({ buskv.second, buskv.first, parameters, true });
+        }
+    }
+
+    std::sort(mRows.begin(), mRows.end(), [](const Row& a, const Row& b)
+    {
+        if(a.isBus != b.isBus) return b.isBus;
+        const int order = a.name.compareNatural(b.name);
+        if(order != 0) return order < 0;
+        return a.id < b.id;
+    });
+
+    return true;
 }
 
 //==================================================================================================
@@ -86,6 +169,7 @@ void InstanceListModel::setInstanceList(patch::Map<patch::Instance*>* instanceLi
 PluginEditor::PluginEditor (PluginProcessor& p)
     : AudioProcessorEditor (&p)
     , processorRef (p)
+    , mCore(p.getEndPoint()->getCore())
     , mConnectionListBoxModel(processorRef.getEndPoint()->getId())
     , mConnectionParameters(nullptr)
 {
@@ -109,11 +193,18 @@ PluginEditor::PluginEditor (PluginProcessor& p)
     cNameLabel.onTextChange = [this]
     {
         processorRef.getEndPoint()->setName(cNameLabel.getText());
-        Mode mode = processorRef.getEndPoint()->getMode();
-        if(mode == Mode::transmit)
-            Core::getInstance()->updateConnectionList(Mode::recieve);
-        if(mode == Mode::recieve)
-            Core::getInstance()->updateConnectionList(Mode::transmit);
+    };
+
+    addAndMakeVisible(cDomainLabel);
+    cDomainLabel.setText(mCore->getDomainName(), juce::dontSendNotification);
+    cDomainLabel.setEditable(true);
+    cDomainLabel.setTooltip("Routing domain, instances only route to others in the same one");
+    cDomainLabel.onTextChange = [this]
+    {
+        const juce::String name = cDomainLabel.getText().trim();
+        processorRef.getEndPoint()->setDomain(name.isEmpty() ? juce::String(Core::defaultDomain)
+                                                             : name);
+        domainSwitched();
     };
 
     mConnectionListBoxModel.onInstanceSelected = [this](juce::Uuid otherInstanceId)
@@ -129,17 +220,20 @@ PluginEditor::PluginEditor (PluginProcessor& p)
     addAndMakeVisible(cGainSlider);
     cGainSlider.setRange(0.f, 1.f);
     cGainSlider.setNumDecimalPlacesToDisplay(2);
+    // the attachment comes first, without a connection it has nothing to
+    // write to yet
+    cGainSlider.onValueChange = [this]()
+    {
+        createAttachedConnection();
+    };
 
     addAndMakeVisible(cConnectionButton.button);
     cConnectionButton.addCallback([this]()
     {
-        updateInstanceList();
-        Mode mode = processorRef.getEndPoint()->getMode();
-        if(mode == Mode::transmit)
-            Core::getInstance()->updateConnectionList(Mode::recieve);
-        if(mode == Mode::recieve)
-            Core::getInstance()->updateConnectionList(Mode::transmit);
-        processorRef.getEndPoint()->getRecieveBuffer()->clear();
+        if(mConnectionParameters == nullptr)
+            createAttachedConnection();
+        else
+            mCore->connectionsChanged();
     });
     cConnectionButton.addCallback([this]()
     {
@@ -148,25 +242,116 @@ PluginEditor::PluginEditor (PluginProcessor& p)
     }
     );
 
-    processorRef.getEndPoint()->updateConnectionList = [this]()
+    addAndMakeVisible(cMatrixButton);
+    cMatrixButton.setButtonText("Matrix");
+    cMatrixButton.setClickingTogglesState(true);
+    cMatrixButton.onClick = [this]()
     {
-        updateInstanceList();
+        showMatrix(cMatrixButton.getToggleState());
+    };
+    addChildComponent(cMatrix);
+
+    addAndMakeVisible(cAddBusButton);
+    cAddBusButton.setButtonText("Add bus");
+    cAddBusButton.setTooltip("Sums its transmitters once for all of its recievers");
+    cAddBusButton.onClick = [this]()
+    {
+        mCore->addBus("Bus " + juce::String(mCore->getBuses()->size() + 1));
+    };
+
+    addAndMakeVisible(cRemoveBusButton);
+    cRemoveBusButton.setButtonText("Remove bus");
+    cRemoveBusButton.onClick = [this]()
+    {
+        mCore->removeBus(mAttachedInstanceId);
+    };
+
+    addAndMakeVisible(cQuantumComboBox);
+    for(size_t i = 0; i < std::size(routingQuanta); i++)
+        cQuantumComboBox.addItem(routingQuanta[i] == 0 ? juce::String("Per block")
+                                                       : juce::String(routingQuanta[i]) + " smp",
+                                 (int)i + 1);
+    cQuantumComboBox.setTooltip("Samples Core routes at once");
+    updateQuantumSelection();
+    cQuantumComboBox.onChange = [this]()
+    {
+        const int index = cQuantumComboBox.getSelectedId() - 1;
+        if(index >= 0 && index < (int)std::size(routingQuanta))
+            mCore->setRoutingQuantum(routingQuanta[index]);
+    };
+
+    addAndMakeVisible(cLoopProtectionButton);
+    cLoopProtectionButton.setButtonText("Protect");
+    cLoopProtectionButton.setTooltip("Clips the connections of feedback loops with a gain above 1");
+    cLoopProtectionButton.setClickingTogglesState(true);
+    cLoopProtectionButton.onClick = [this]()
+    {
+        mCore->setLoopProtection(cLoopProtectionButton.getToggleState());
+    };
+
+    addAndMakeVisible(cSharedRoutingButton);
+    cSharedRoutingButton.setButtonText("Share");
+    cSharedRoutingButton.setTooltip("Routes to the same domain in other processes, for hosts that "
+                                    "run plugins in processes of their own");
+    cSharedRoutingButton.setClickingTogglesState(true);
+    cSharedRoutingButton.onClick = [this]()
+    {
+        if(!cSharedRoutingButton.getToggleState())
+            mCore->disableSharedRouting();
+        else if(!mCore->enableSharedRouting())
+            cSharedRoutingButton.setToggleState(false, juce::dontSendNotification);
     };
 
+    addChildComponent(cLoopWarningLabel);
+    cLoopWarningLabel.setColour(juce::Label::textColourId, juce::Colours::orange);
+    cLoopWarningLabel.setJustificationType(juce::Justification::centredLeft);
+    updateLoopWarning();
+
+    addAndMakeVisible(cStatisticsLabel);
+    cStatisticsLabel.setJustificationType(juce::Justification::centredLeft);
+    cStatisticsLabel.setMinimumHorizontalScale(0.5f);
+    updateStatisticsReadout();
+    startTimerHz(meterRefreshRate);
+
+#if TRACE_ENABLED
+    addAndMakeVisible(cTraceButton);
+    cTraceButton.setButtonText("Trace");
+    cTraceButton.setClickingTogglesState(true);
+    cTraceButton.setToggleState(Tracer::isRecording(), juce::dontSendNotification);
+    cTraceButton.onClick = [this]()
+    {
+        auto* tracer = Tracer::getInstance();
+        if(!cTraceButton.getToggleState())
+        {
+            tracer->stop();
+            return;
+        }
+
+        auto folder = juce::File(PROJECT_ROOT_DIR).getChildFile("log");
+        if(!folder.isDirectory()) folder.createDirectory();
+        const auto file = folder.getNonexistentChildFile("trace-", ".json", false);
+        if(!tracer->start(file))
+            cTraceButton.setToggleState(Tracer::isRecording(), juce::dontSendNotification);
+    };
+#endif
+
     setSize (400, 300);
     setResizable(true, true);
 }
 
 PluginEditor::~PluginEditor()
 {
+    stopTimer();
     attachToParameters(juce::Uuid::null());
-    processorRef.getEndPoint()->updateConnectionList = nullptr;
 }
 
 
 void PluginEditor::paint (juce::Graphics& g)
 {
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+
+    if(processorRef.getEndPoint()->getMode() == Mode::recieve)
+        drawLevelMeter(g, mRecieveMeterArea, mRecievePeak, mRecieveRms);
 }
 
 void PluginEditor::resized()
@@ -174,11 +359,27 @@ void PluginEditor::resized()
     auto area = getBounds();
     auto topArea = area.removeFromTop(area.proportionOfHeight(0.07f));
     auto parameterArea = area.removeFromBottom(area.proportionOfHeight(0.1f));
-
-    cNameLabel.setBounds(topArea.removeFromLeft(area.proportionOfWidth(0.5f)));
+    auto statisticsArea = area.removeFromBottom(56);
+    auto loopWarningArea = area.removeFromBottom(20);
+    mRecieveMeterArea = area.removeFromBottom(8).reduced(8, 1);
+
+    cNameLabel.setBounds(topArea.removeFromLeft(area.proportionOfWidth(0.35f)));
+    cDomainLabel.setBounds(topArea.removeFromLeft(area.proportionOfWidth(0.15f)));
+    cMatrixButton.setBounds(topArea.removeFromRight(60).reduced(2));
+    cRemoveBusButton.setBounds(topArea.removeFromRight(80).reduced(2));
+    cAddBusButton.setBounds(topArea.removeFromRight(60).reduced(2));
     cModeSelectorComboBox.setBounds(topArea);
 
+    cMatrix.setBounds(area);
     cConnectionListBox.setBounds(area);
+#if TRACE_ENABLED
+    cTraceButton.setBounds(statisticsArea.removeFromRight(60).reduced(4));
+#endif
+    cQuantumComboBox.setBounds(statisticsArea.removeFromRight(90).reduced(4));
+    cLoopProtectionButton.setBounds(statisticsArea.removeFromRight(60).reduced(4));
+    cSharedRoutingButton.setBounds(statisticsArea.removeFromRight(60).reduced(4));
+    cStatisticsLabel.setBounds(statisticsArea);
+    cLoopWarningLabel.setBounds(loopWarningArea);
 
     cConnectionButton.button.setBounds(parameterArea.removeFromLeft(30));
     cGainSlider.setBounds(parameterArea);
@@ -188,7 +389,7 @@ void PluginEditor::modeSwitched()
 {
     auto mode = (Mode) cModeSelectorComboBox.getSelectedId(); 
     Map<Instance*>* instanceList;
-    auto* core = Core::getInstance();
+    auto* core = mCore.get();
 
     switch(mode)
     {
@@ -206,7 +407,8 @@ void PluginEditor::modeSwitched()
     processorRef.getEndPoint()->setMode(mode);
 
     mConnectionListBoxModel.setMode(mode);
-    mConnectionListBoxModel.setInstanceList(instanceList);
+    mConnectionListBoxModel.setInstanceList(core, instanceList);
+    cMatrix.setCore(core);
     cConnectionListBox.updateContent();
     cConnectionListBox.deselectAllRows();
     cConnectionListBox.repaint();
@@ -216,19 +418,31 @@ void PluginEditor::modeSwitched()
     cGainSlider.setEnabled(false);
 }
 
+void PluginEditor::domainSwitched()
+{
+    // the parameters attached to belong to the domain that is let go of
+    attachToParameters(juce::Uuid::null());
+
+    auto* instance = processorRef.getEndPoint();
+    mCore = instance->getCore();
+    cModeSelectorComboBox.setSelectedId((int)instance->getMode(), juce::dontSendNotification);
+    cNameLabel.setText(instance->getName(), juce::dontSendNotification);
+    cDomainLabel.setText(mCore->getDomainName(), juce::dontSendNotification);
+    mSeenTopologyVersion = mCore->getTopologyVersion();
+    mSeenConnectionListVersion = mCore->getConnectionListVersion();
+    updateQuantumSelection();
+    updateLoopWarning();
+    modeSwitched();
+}
+
 void PluginEditor::attachToParameters(juce::Uuid otherInstanceId)
 {
     cGainSlider.setEnabled(false);
 
-    if(mConnectionParameters)
-    {
-        mConnectionParameters->on.detachToggleButton(&cConnectionButton);
-        mConnectionParameters->gain.detachSlider(&cGainSlider);
-
-        // delay
-        // delayCorrection
-        // protection
-    }
+    mConnectionAttachment.attach(nullptr);
+    mGainAttachment.attach(nullptr);
+    mAttachedInstanceId = otherInstanceId;
+    updateBusButtons();
 
     if(otherInstanceId.isNull())
     {
@@ -240,17 +454,17 @@ void PluginEditor::attachToParameters(juce::Uuid otherInstanceId)
     Mode mode = instance->getMode();
     juce::Uuid id = instance->getId();
 
+    // selecting a row only looks, createAttachedConnection makes the
+    // connection once it is edited
     switch (mode)
     {
     case Mode::transmit :
         cGainSlider.setEnabled(true);
-        mConnectionParameters = Core::getInstance()
-            ->getConnectionParameters(id, otherInstanceId);
+        mConnectionParameters = mCore->getConnectionParameters(id, otherInstanceId);
         break;
     case Mode::recieve :
         cGainSlider.setEnabled(true);
-        mConnectionParameters = Core::getInstance()
-            ->getConnectionParameters(otherInstanceId, id);
+        mConnectionParameters = mCore->getConnectionParameters(otherInstanceId, id);
         break;
     case Mode::bypass :
     default:
@@ -259,17 +473,193 @@ void PluginEditor::attachToParameters(juce::Uuid otherInstanceId)
 
     if(mConnectionParameters)
     {
-        mConnectionParameters->on.attachToggleButton(&cConnectionButton);
-        mConnectionParameters->gain.attachSlider(&cGainSlider);
+        mConnectionAttachment.attach(&mConnectionParameters->on, mConnectionParameters);
+        mGainAttachment.attach(&mConnectionParameters->gain, mConnectionParameters);
 
         // delay
         // delayCompensation
         // protection
     }
+    else
+    {
+        // as a connection that was never made
+        cConnectionButton.setState(false, juce::dontSendNotification);
+        cGainSlider.setValue(0.0, juce::dontSendNotification);
+    }
+}
+
+void PluginEditor::createAttachedConnection()
+{
+    if(mConnectionParameters != nullptr || mAttachedInstanceId.isNull()) return;
+
+    auto* instance = processorRef.getEndPoint();
+    const juce::Uuid id = instance->getId();
+    switch (instance->getMode())
+    {
+    case Mode::transmit :
+        mConnectionParameters = mCore->getOrCreateConnectionParameters(id, mAttachedInstanceId);
+        break;
+    case Mode::recieve :
+        mConnectionParameters = mCore->getOrCreateConnectionParameters(mAttachedInstanceId, id);
+        break;
+    case Mode::bypass :
+    default:
+        return;
+    }
+    if(mConnectionParameters == nullptr) return;
+
+    // the widgets hold the edit that made the connection
+    mConnectionParameters->on.setValue(cConnectionButton.getState());
+    mConnectionParameters->gain.setValue((float)cGainSlider.getValue());
+    mConnectionAttachment.attach(&mConnectionParameters->on, mConnectionParameters);
+    mGainAttachment.attach(&mConnectionParameters->gain, mConnectionParameters);
+    mCore->connectionsChanged();
+}
+
+// Only the bus selected in the list can be removed.
+void PluginEditor::updateBusButtons()
+{
+    cRemoveBusButton.setEnabled(mCore->isBus(mAttachedInstanceId));
+}
+
+void PluginEditor::showMatrix(bool shouldShow)
+{
+    // the matrix takes the place of the list and the connection parameters
+    cMatrix.setVisible(shouldShow);
+    cConnectionListBox.setVisible(!shouldShow);
+    cConnectionButton.button.setVisible(!shouldShow);
+    cGainSlider.setVisible(!shouldShow);
 }
 
 void PluginEditor::updateInstanceList()
 {
+    // the connection may be gone, look its parameters up again
+    attachToParameters(mAttachedInstanceId);
+
     cConnectionListBox.updateContent();
     cConnectionListBox.repaint();
 }
+
+void PluginEditor::timerCallback()
+{
+    auto& level = processorRef.getEndPoint()->getRecieveLevel();
+    const float decay = 0.8f;
+    mRecievePeak = juce::jmax(level.peak.load(std::memory_order_relaxed), mRecievePeak * decay);
+    mRecieveRms = juce::jmax(level.rms.load(std::memory_order_relaxed), mRecieveRms * decay);
+    repaint(mRecieveMeterArea);
+
+    // the host may have restored the instance into another domain
+    if(processorRef.getEndPoint()->getCore() != mCore)
+        domainSwitched();
+
+    // at most one refresh per frame, however many changes happened since
+    auto* core = mCore.get();
+    const uint64_t topologyVersion = core->getTopologyVersion();
+    const uint64_t connectionListVersion = core->getConnectionListVersion();
+    if(topologyVersion != mSeenTopologyVersion)
+        updateInstanceList();
+    else if(connectionListVersion != mSeenConnectionListVersion
+            || mConnectionListBoxModel.hasConnectedRows())
+        cConnectionListBox.repaint();
+    mSeenTopologyVersion = topologyVersion;
+    mSeenConnectionListVersion = connectionListVersion;
+
+    // parameters may have been set from anywhere, the widgets follow here
+    const uint64_t parameterVersion = parameterSequence.load(std::memory_order_acquire);
+    if(parameterVersion != mSeenParameterSequence)
+    {
+        mConnectionAttachment.update();
+        mGainAttachment.update();
+        mSeenParameterSequence = parameterVersion;
+    }
+
+    // the readout would be unreadable at the meter rate
+    if(++mTimerTicks % (meterRefreshRate / 4) == 0)
+        updateStatisticsReadout();
+}
+
+void PluginEditor::updateStatisticsReadout()
+{
+    const auto toMicros = [](double seconds)
+    {
+        return juce::String(seconds * 1.0e6, 1);
+    };
+
+    const auto instance = processorRef.getEndPoint()->getStatistics();
+    const auto core = mCore->getStatistics();
+
+    juce::String text;
+    text << "Block " << toMicros(instance.processBlockDuration.getMeanSeconds())
+         << " / " << toMicros(instance.processBlockDuration.maxSeconds) << " us"
+         << "  wait " << toMicros(instance.epochWait.getMeanSeconds()) << " us"
+         << "  missed " << juce::String(instance.missedEpochs) << "\n"
+         << "Route " << toMicros(core.processRoutingDuration.getMeanSeconds())
+         << " / " << toMicros(core.processRoutingDuration.maxSeconds) << " us"
+         << "  edges " << juce::String(core.activeEdges)
+         << " (" << juce::String(core.sameBlockEdges) << " same block)"
+         << "  late " << juce::String(core.lateEpochs)
+         << "  xruns " << juce::String(core.underruns + core.overruns);
+
+    // the heaviest of the domain, to tell where the time goes
+    std::pair<juce::Uuid, double> heaviestInstance { juce::Uuid::null(), 0.0 };
+    for(const auto& [id, statistics] : mCore->getInstanceStatistics())
+        if(statistics.processBlockDuration.getMeanSeconds() > heaviestInstance.second)
+            heaviestInstance = { id, statistics.processBlockDuration.getMeanSeconds() };
+
+    const ConnectionStatistics* heaviestConnection = nullptr;
+    const auto connections = mCore->getConnectionStatistics();
+    for(const ConnectionStatistics& connection : connections)
+        if(heaviestConnection == nullptr
+           || connection.getMeanSeconds() > heaviestConnection->getMeanSeconds())
+            heaviestConnection = &connection;
+
+    text << "\nHeaviest ";
+    if(heaviestInstance.first.isNull())
+        text << "-";
+    else
+        text << mCore->getNameOf(heaviestInstance.first) << " "
+             << toMicros(heaviestInstance.second) << " us";
+    if(heaviestConnection != nullptr)
+        text << "  " << mCore->getNameOf(heaviestConnection->transmitter) << " > "
+             << mCore->getNameOf(heaviestConnection->reciever) << " "
+             << toMicros(heaviestConnection->getMeanSeconds()) << " us";
+
+    cStatisticsLabel.setText(text, juce::dontSendNotification);
+#if TRACE_ENABLED
+    cTraceButton.setToggleState(Tracer::isRecording(), juce::dontSendNotification);
+#endif
+    updateQuantumSelection();
+    updateLoopWarning();
+}
+
+// The loops of the whole domain, not only those of this instance, and the
+// transmitters that found no room in the shared routing segment.
+void PluginEditor::updateLoopWarning()
+{
+    const double loopGain = mCore->getWorstLoopGain();
+    const bool isProtected = mCore->isLoopProtectionEnabled();
+    cLoopProtectionButton.setToggleState(isProtected, juce::dontSendNotification);
+    cSharedRoutingButton.setToggleState(mCore->isSharedRoutingEnabled(), juce::dontSendNotification);
+
+    juce::String warning;
+    if(loopGain > Core::maxStableLoopGain)
+        warning << "Feedback loop with a gain of " << juce::String(loopGain, 2)
+                << (isProtected ? ", clipped" : ", it will blow up");
+
+    if(const size_t unshared = mCore->getNumberOfUnsharedTransmitters(); unshared > 0)
+        warning << (warning.isEmpty() ? "" : "  ") << juce::String(unshared)
+                << " transmitters not shared, all " << juce::String(SharedRouting::maxTransmitters)
+                << " slots are taken";
+
+    cLoopWarningLabel.setVisible(warning.isNotEmpty());
+    cLoopWarningLabel.setText(warning, juce::dontSendNotification);
+}
+
+// Any editor may change it, all of them show it.
+void PluginEditor::updateQuantumSelection()
+{
+    const int quantum = mCore->getRoutingQuantum();
+    for(size_t i = 0; i < std::size(routingQuanta); i++)
+        if(routingQuanta[i] == quantum)
+            cQuantumComboBox.setSelectedId((int)i + 1, juce::dontSendNotification);
+}
@@ -2,6 +2,8 @@
 
 #include "PluginProcessor.h"
 #include "Core.h"
+#include "RoutingMatrix.h"
+#include "ParameterAttachments.h"
 
 class InstanceListModel : public juce::ListBoxModel
 {
@@ -13,17 +15,42 @@ public:
     void listBoxItemClicked (int row, const juce::MouseEvent& event) override;
 
     void setMode(patch::Mode instanceMode);
-    void setInstanceList(patch::Map<patch::Instance*>* instanceListPtr);
+    // the list belongs to core, both have to outlive the model or the next call
+    void setInstanceList(patch::Core* core, patch::Map<patch::Instance*>* instanceListPtr);
+
+    // Rebuilds the rows if the topology of Core changed since the last call.
+    // Returns true if it did.
+    bool refreshRows();
+    // Connected rows show meters, which need repainting every frame.
+    bool hasConnectedRows();
 
     std::function<void(juce::Uuid)> onInstanceSelected;
 
 private:
+    struct Row
+    {
+        juce::String name;
+        juce::Uuid id;
+        patch::ConnectionHandle parameters;
+        bool isBus;
+    };
+
+    static constexpr uint64_t invalidVersion = ~(uint64_t)0;
+
     juce::Uuid id;
     patch::Mode mode;
+    patch::Core* mCore;
     patch::Map<patch::Instance*>* mInstanceList;
+
+    // sorted by name, the buses after the instances, only valid as long as
+    // the topology version matches
+    std::vector<Row> mRows;
+    uint64_t mRowsVersion = invalidVersion;
 };
 
-class PluginEditor final : public juce::AudioProcessorEditor
+class PluginEditor final 
+    : public juce::AudioProcessorEditor
+    , private juce::Timer
 {
 public:
     explicit PluginEditor (PluginProcessor&);
@@ -33,22 +60,62 @@ public:
     void resized() override;
     
     void modeSwitched();
+    // after the instance moved to another routing domain
+    void domainSwitched();
     void attachToParameters(juce::Uuid otherInstanceId);
     void updateInstanceList();
 
 private:
+    void showMatrix(bool shouldShow);
+    void updateBusButtons();
+    // for the row attached to, when its toggle or slider is edited
+    void createAttachedConnection();
+    void timerCallback() override;
+    void updateStatisticsReadout();
+    void updateLoopWarning();
+
     PluginProcessor& processorRef;
+    // the domain the editor shows, kept alive until it catches up with the
+    // instance moving on
+    std::shared_ptr<patch::Core> mCore;
 
     InstanceListModel mConnectionListBoxModel;
 
     juce::ComboBox cModeSelectorComboBox;
     juce::Label cNameLabel;
+    juce::Label cDomainLabel;
     juce::ListBox cConnectionListBox;
+    juce::Label cStatisticsLabel;
+    juce::TextButton cTraceButton;
+    juce::TextButton cMatrixButton;
+    juce::TextButton cAddBusButton;
+    juce::TextButton cRemoveBusButton;
+    juce::ComboBox cQuantumComboBox;
+    juce::TextButton cLoopProtectionButton;
+    juce::TextButton cSharedRoutingButton;
+    juce::Label cLoopWarningLabel;
+    patch::RoutingMatrix cMatrix;
 
     juce::Slider cGainSlider;
     patch::PatchToggleButton cConnectionButton;
 
     patch::ConnectionParameters* mConnectionParameters;
+    juce::Uuid mAttachedInstanceId;
+    patch::ToggleAttachment mConnectionAttachment { cConnectionButton };
+    patch::SliderAttachment<float> mGainAttachment { cGainSlider };
+    uint64_t mSeenParameterSequence = 0;
+
+    // item i of cQuantumComboBox has the id i + 1, 0 routes per host block
+    static constexpr int routingQuanta[] = { 0, 32, 64, 128, 256 };
+    void updateQuantumSelection();
+
+    static constexpr int meterRefreshRate = 30;
+    int mTimerTicks = 0;
+    uint64_t mSeenTopologyVersion = 0;
+    uint64_t mSeenConnectionListVersion = 0;
+    juce::Rectangle<int> mRecieveMeterArea;
+    float mRecievePeak = 0.f;
+    float mRecieveRms = 0.f;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginEditor)
 };
@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "InstanceState.h"
 #include "Logger.h"
 
 PluginProcessor::PluginProcessor()
@@ -25,6 +26,12 @@ void PluginProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     mEndpoint->prepareToPlay(sampleRate, samplesPerBlock);
 }
 
+void PluginProcessor::setNonRealtime (bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
+    mEndpoint->setNonRealtime(isNonRealtime);
+}
+
 void PluginProcessor::releaseResources()
 {
     mEndpoint->releaseResources();
@@ -49,6 +56,16 @@ void PluginProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     mEndpoint->processBlock(buffer);
 }
 
+void PluginProcessor::processBlock (juce::AudioBuffer<double>& buffer,
+                                    juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused (midiMessages);
+
+    juce::ScopedNoDenormals noDenormals;
+
+    mEndpoint->processBlock(buffer);
+}
+
 
 bool PluginProcessor::hasEditor() const { return true; }
 juce::AudioProcessorEditor* PluginProcessor::createEditor()
@@ -59,16 +76,16 @@ juce::AudioProcessorEditor* PluginProcessor::createEditor()
 
 void PluginProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    juce::MemoryOutputStream output(destData, false);
-    juce::ValueTree info = getEndPoint()->getStateInfo();
-    info.writeToStream(output);
+    getEndPoint()->getState().writeBinary(destData);
 }
 
 void PluginProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    juce::MemoryInputStream input(data, (size_t)sizeInBytes, false);
-    juce::ValueTree info = juce::ValueTree::readFromStream(input);
-    getEndPoint()->setStateInfo(info);
+    // sessions saved before the binary format are still ValueTrees
+    const auto state = patch::InstanceState::read(data, (size_t)sizeInBytes);
+    if(!state.has_value()) return;
+
+    getEndPoint()->setState(state.value());
 }
 
 
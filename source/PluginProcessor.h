@@ -13,6 +13,11 @@ public:
     void releaseResources() override;
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    // Blocks go to Core as they come, in either precision.
+    bool supportsDoublePrecisionProcessing() const override { return true; }
+    // Bounces are routed deterministically, see patch::Core::isOffline.
+    void setNonRealtime (bool isNonRealtime) noexcept override;
 
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
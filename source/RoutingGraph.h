@@ -0,0 +1,452 @@
+#pragma once
+
+/*  Directed graph over dense node indices. Core uses it to find the feedback
+    loops among the instances: an edge lies on a loop exactly if both of its
+    ends are in the same strongly connected component.
+    Once the components were found they are kept up to date as edges come and
+    go, only the part of the graph an edit touches is searched. Every edge has
+    a gain, from which the gain of every loop follows, see getLoopGain.
+*/
+
+#include <vector>
+#include <utility>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace patch
+{
+
+class RoutingGraph
+{
+public:
+    static constexpr size_t invalid = std::numeric_limits<size_t>::max();
+
+    struct Edge
+    {
+        size_t from;
+        size_t to;
+        float gain = 1.f;
+    };
+
+    // Removes all edges. Edges added after this are collected until
+    // findComponents is called, which is faster for building a whole graph.
+    void reset(size_t numberOfNodes)
+    {
+        mOutgoing.assign(numberOfNodes, {});
+        mIncoming.assign(numberOfNodes, {});
+        mComponents.assign(numberOfNodes, invalid);
+        mMembers.clear();
+        mLoopGains.clear();
+        mFreeComponents.clear();
+        mIsUpToDate = false;
+    }
+
+    // Adds nodes without edges, each of them a component of its own.
+    void resize(size_t numberOfNodes)
+    {
+        const size_t previous = getNumberOfNodes();
+        if(numberOfNodes <= previous) return;
+
+        mOutgoing.resize(numberOfNodes);
+        mIncoming.resize(numberOfNodes);
+        mComponents.resize(numberOfNodes, invalid);
+        if(mIsUpToDate)
+            for(size_t node = previous; node < numberOfNodes; node++)
+                assignComponent(node, createComponent());
+    }
+
+    // Adds the edge or changes its gain. An edge closing a loop merges the
+    // components along the loop.
+    void addEdge(size_t from, size_t to, float gain = 1.f);
+    // An edge inside a component may split it, only that component is
+    // searched again.
+    void removeEdge(size_t from, size_t to);
+    // Brings the edges to exactly these, only what differs is changed. Of
+    // edges given more than once the last one counts.
+    void setEdges(std::vector<Edge> edges);
+
+    // Tarjan's algorithm, iterative so long chains cannot overflow the stack.
+    // Has to be called after reset and the edges were added, before the
+    // queries below. From then on the edits keep the components up to date.
+    void findComponents();
+
+    size_t getNumberOfNodes() const { return mOutgoing.size(); }
+    size_t getNumberOfComponents() const { return mMembers.size() - mFreeComponents.size(); }
+    size_t getComponent(size_t node) const
+    {
+        return node < mComponents.size() ? mComponents[node] : invalid;
+    }
+
+    // Both ends in one component, i.e. the edge from -> to closes a loop.
+    bool isOnLoop(size_t from, size_t to) const
+    {
+        return from != to
+            && getComponent(from) != invalid
+            && getComponent(from) == getComponent(to);
+    }
+
+    // How much the loudest signal a component can carry grows with every
+    // edge it passes, when all paths through it add up in phase: the spectral
+    // radius of the magnitudes of its gains. Around a single loop that is the
+    // geometric mean of its gains, where loops share nodes it is more than
+    // that of any of them. Above 1 the loop grows without bound. 0 for nodes
+    // on no loop. Kept until an edit touches the component.
+    double getLoopGain(size_t component);
+
+private:
+    struct Arc
+    {
+        size_t node;
+        float gain;
+    };
+
+    std::vector<std::vector<Arc>> mOutgoing;
+    std::vector<std::vector<Arc>> mIncoming;
+    std::vector<size_t> mComponents;
+    // the nodes of every component, empty for the ids in mFreeComponents
+    std::vector<std::vector<size_t>> mMembers;
+    // by component, negative until it is asked for
+    std::vector<double> mLoopGains;
+    std::vector<size_t> mFreeComponents;
+    bool mIsUpToDate = true;
+
+    // scratch space, kept to avoid reallocating
+    std::vector<size_t> mIndex;
+    std::vector<size_t> mLowLink;
+    std::vector<bool> mOnStack;
+    std::vector<size_t> mStack;
+    std::vector<std::pair<size_t, size_t>> mCallStack;
+    std::vector<unsigned> mMarks;
+    unsigned mMark = 0;
+    std::vector<size_t> mSearch;
+    std::vector<size_t> mFound;
+    std::vector<double> mVector;
+    std::vector<double> mProduct;
+
+    size_t createComponent()
+    {
+        if(!mFreeComponents.empty())
+        {
+            const size_t component = mFreeComponents.back();
+            mFreeComponents.pop_back();
+            return component;
+        }
+
+        mMembers.emplace_back();
+        mLoopGains.push_back(-1.0);
+        return mMembers.size() - 1;
+    }
+
+    void assignComponent(size_t node, size_t component)
+    {
+        mComponents[node] = component;
+        mMembers[component].push_back(node);
+        mLoopGains[component] = -1.0;
+    }
+
+    void releaseComponent(size_t component)
+    {
+        mMembers[component].clear();
+        mLoopGains[component] = -1.0;
+        mFreeComponents.push_back(component);
+    }
+
+    // a new mark for the nodes of one search
+    unsigned nextMark()
+    {
+        if(mMarks.size() != mComponents.size() || ++mMark == 0)
+        {
+            mMarks.assign(mComponents.size(), 0);
+            mMark = 1;
+        }
+        return mMark;
+    }
+
+    // Tarjan from every one of the nodes, without leaving them if
+    // onlyAmongThem is set. Assigns them components anew.
+    void searchComponents(const std::vector<size_t>& nodes, bool onlyAmongThem);
+    void mergeAlong(size_t from, size_t to);
+    double findLoopGain(size_t component);
+};
+
+inline void RoutingGraph::addEdge(size_t from, size_t to, float gain)
+{
+    if(from >= getNumberOfNodes() || to >= getNumberOfNodes()) return;
+
+    for(Arc& arc : mOutgoing[from])
+    {
+        if(arc.node != to) continue;
+        if(arc.gain == gain) return;
+
+        arc.gain = gain;
+        for(Arc& reverse : mIncoming[to])
+            if(reverse.node == from)
+                reverse.gain = gain;
+        if(mIsUpToDate && getComponent(from) == getComponent(to))
+            mLoopGains[getComponent(from)] = -1.0;
+        return;
+    }
+
+    mOutgoing[from].push_back({ to, gain });
+    mIncoming[to].push_back({ from, gain });
+    if(!mIsUpToDate) return;
+
+    if(getComponent(from) == getComponent(to))
+        mLoopGains[getComponent(from)] = -1.0;
+    else
+        mergeAlong(from, to);
+}
+
+inline void RoutingGraph::removeEdge(size_t from, size_t to)
+{
+    if(from >= getNumberOfNodes() || to >= getNumberOfNodes()) return;
+
+    const auto isTo = [to](const Arc& arc) { return arc.node == to; };
+    const auto isFrom = [from](const Arc& arc) { return arc.node == from; };
+    auto& outgoing = mOutgoing[from];
+    const auto arc = std::find_if(outgoing.begin(), outgoing.end(), isTo);
+    if(arc == outgoing.end()) return;
+    outgoing.erase(arc);
+    auto& incoming = mIncoming[to];
+    incoming.erase(std::find_if(incoming.begin(), incoming.end(), isFrom));
+
+    if(!mIsUpToDate || getComponent(from) != getComponent(to)) return;
+
+    // the component may have fallen apart, it is searched again on its own
+    const size_t component = getComponent(from);
+    mFound = std::move(mMembers[component]);
+    releaseComponent(component);
+    searchComponents(mFound, true);
+}
+
+inline void RoutingGraph::setEdges(std::vector<Edge> edges)
+{
+    const auto byEnds = [](const Edge& a, const Edge& b)
+    {
+        return a.from != b.from ? a.from < b.from : a.to < b.to;
+    };
+    std::stable_sort(edges.begin(), edges.end(), byEnds);
+
+    // removed first, so nothing is merged only to be split again
+    std::vector<Edge> removed;
+    for(size_t from = 0; from < getNumberOfNodes(); from++)
+    {
+        for(const Arc& arc : mOutgoing[from])
+        {
+            const Edge edge{ from, arc.node };
+            if(!std::binary_search(edges.begin(), edges.end(), edge, byEnds))
+                removed.push_back(edge);
+        }
+    }
+    for(const Edge& edge : removed)
+        removeEdge(edge.from, edge.to);
+
+    for(const Edge& edge : edges)
+        addEdge(edge.from, edge.to, edge.gain);
+
+    if(!mIsUpToDate)
+        findComponents();
+}
+
+inline void RoutingGraph::findComponents()
+{
+    mComponents.assign(getNumberOfNodes(), invalid);
+    mMembers.clear();
+    mLoopGains.clear();
+    mFreeComponents.clear();
+
+    mSearch.resize(getNumberOfNodes());
+    for(size_t node = 0; node < mSearch.size(); node++)
+        mSearch[node] = node;
+    searchComponents(mSearch, false);
+    mIsUpToDate = true;
+}
+
+inline void RoutingGraph::searchComponents(const std::vector<size_t>& nodes, bool onlyAmongThem)
+{
+    mIndex.resize(getNumberOfNodes(), invalid);
+    mLowLink.resize(getNumberOfNodes(), 0);
+    mOnStack.resize(getNumberOfNodes(), false);
+    mStack.clear();
+    mCallStack.clear();
+
+    // marked, so the edges leaving them can be told apart
+    const unsigned mark = onlyAmongThem ? nextMark() : 0;
+    if(onlyAmongThem)
+        for(size_t node : nodes)
+            mMarks[node] = mark;
+
+    size_t nextIndex = 0;
+    const auto visit = [&](size_t node)
+    {
+        mIndex[node] = mLowLink[node] = nextIndex++;
+        mStack.push_back(node);
+        mOnStack[node] = true;
+        mCallStack.emplace_back(node, 0);
+    };
+
+    for(size_t root : nodes)
+    {
+        if(mIndex[root] != invalid) continue;
+        visit(root);
+
+        while(!mCallStack.empty())
+        {
+            const size_t node = mCallStack.back().first;
+            size_t& nextEdge = mCallStack.back().second;
+
+            if(nextEdge < mOutgoing[node].size())
+            {
+                const size_t target = mOutgoing[node][nextEdge++].node;
+                if(onlyAmongThem && mMarks[target] != mark)
+                    continue;
+                if(mIndex[target] == invalid)
+                    visit(target);
+                else if(mOnStack[target])
+                    mLowLink[node] = std::min(mLowLink[node], mIndex[target]);
+                continue;
+            }
+
+            if(mLowLink[node] == mIndex[node])
+            {
+                const size_t component = createComponent();
+                size_t member;
+                do
+                {
+                    member = mStack.back();
+                    mStack.pop_back();
+                    mOnStack[member] = false;
+                    assignComponent(member, component);
+                } while(member != node);
+            }
+
+            mCallStack.pop_back();
+            if(!mCallStack.empty())
+            {
+                const size_t parent = mCallStack.back().first;
+                mLowLink[parent] = std::min(mLowLink[parent], mLowLink[node]);
+            }
+        }
+    }
+
+    // ready for the next search without going over every node
+    for(size_t node : nodes)
+        mIndex[node] = invalid;
+}
+
+inline void RoutingGraph::mergeAlong(size_t from, size_t to)
+{
+    // both marks first, starting the marks over in between would lose the first
+    const unsigned reachable = nextMark();
+    const unsigned onLoop = nextMark();
+
+    // what the new edge leads to
+    mSearch.assign(1, to);
+    mMarks[to] = reachable;
+    for(size_t i = 0; i < mSearch.size(); i++)
+    {
+        for(const Arc& arc : mOutgoing[mSearch[i]])
+        {
+            if(mMarks[arc.node] == reachable) continue;
+            mMarks[arc.node] = reachable;
+            mSearch.push_back(arc.node);
+        }
+    }
+    if(mMarks[from] != reachable) return;
+
+    // of that, whatever leads back to where it starts is on a loop with it
+    mFound.assign(1, from);
+    mMarks[from] = onLoop;
+    for(size_t i = 0; i < mFound.size(); i++)
+    {
+        for(const Arc& arc : mIncoming[mFound[i]])
+        {
+            if(mMarks[arc.node] == onLoop) continue;
+            // only nodes reached above still hold that mark
+            if(mMarks[arc.node] != reachable) continue;
+            mMarks[arc.node] = onLoop;
+            mFound.push_back(arc.node);
+        }
+    }
+
+    const size_t target = getComponent(from);
+    for(size_t node : mFound)
+    {
+        const size_t component = getComponent(node);
+        if(component == target) continue;
+
+        for(size_t member : mMembers[component])
+            assignComponent(member, target);
+        releaseComponent(component);
+    }
+    mLoopGains[target] = -1.0;
+}
+
+inline double RoutingGraph::getLoopGain(size_t component)
+{
+    if(!mIsUpToDate || component >= mMembers.size() || mMembers[component].empty())
+        return 0.0;
+
+    if(mLoopGains[component] < 0.0)
+        mLoopGains[component] = findLoopGain(component);
+    return mLoopGains[component];
+}
+
+inline double RoutingGraph::findLoopGain(size_t component)
+{
+    const std::vector<size_t>& members = mMembers[component];
+    if(members.size() == 1)
+    {
+        // only a node feeding itself is a loop on its own
+        for(const Arc& arc : mOutgoing[members[0]])
+            if(arc.node == members[0])
+                return std::abs((double)arc.gain);
+        return 0.0;
+    }
+
+    // Power iteration on I + A, which unlike A converges for loops of any
+    // length. For a positive x, the ratios of (I + A) x to x enclose the
+    // spectral radius from both sides. The upper end is returned, so it may
+    // only ever overestimate.
+    static constexpr int maxIterations = 1000;
+    static constexpr double tolerance = 1.0e-9;
+
+    mIndex.resize(getNumberOfNodes(), invalid);
+    for(size_t i = 0; i < members.size(); i++)
+        mIndex[members[i]] = i;
+    mVector.assign(members.size(), 1.0);
+    mProduct.resize(members.size());
+
+    double upper = 0.0;
+    for(int iteration = 0; iteration < maxIterations; iteration++)
+    {
+        mProduct = mVector;
+        for(size_t i = 0; i < members.size(); i++)
+            for(const Arc& arc : mOutgoing[members[i]])
+                if(getComponent(arc.node) == component)
+                    mProduct[mIndex[arc.node]] += std::abs((double)arc.gain) * mVector[i];
+
+        double lower = std::numeric_limits<double>::max();
+        double largest = 0.0;
+        upper = 0.0;
+        for(size_t i = 0; i < members.size(); i++)
+        {
+            const double ratio = mProduct[i] / mVector[i];
+            lower = std::min(lower, ratio);
+            upper = std::max(upper, ratio);
+            largest = std::max(largest, mProduct[i]);
+        }
+
+        if(upper - lower <= tolerance * upper) break;
+        for(size_t i = 0; i < members.size(); i++)
+            mVector[i] = mProduct[i] / largest;
+    }
+
+    for(size_t member : members)
+        mIndex[member] = invalid;
+    return std::max(0.0, upper - 1.0);
+}
+
+} // namespace patch
@@ -0,0 +1,376 @@
+#include "RoutingMatrix.h"
+#include "Logger.h"
+
+using namespace patch;
+
+RoutingMatrix::Grid::Grid(RoutingMatrix& owner)
+    : mOwner(owner)
+{}
+
+void RoutingMatrix::Grid::paint(juce::Graphics& g)
+{
+    MY_TRACE_SCOPE("RoutingMatrix::paint");
+    mOwner.refresh();
+
+    g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+
+    const int rows = mOwner.getNumberOfRows();
+    const int columns = mOwner.getNumberOfColumns();
+    if(rows == 0 || columns == 0) return;
+
+    // only what intersects the clip region is drawn, a scrolled matrix of
+    // hundreds of instances costs no more than the visible part
+    const auto clip = g.getClipBounds();
+    const int firstRow = juce::jmax(0, (clip.getY() - columnHeaderHeight) / cellSize);
+    const int lastRow = juce::jmin(rows - 1, (clip.getBottom() - columnHeaderHeight) / cellSize);
+    const int firstColumn = juce::jmax(0, (clip.getX() - rowHeaderWidth) / cellSize);
+    const int lastColumn = juce::jmin(columns - 1, (clip.getRight() - rowHeaderWidth) / cellSize);
+
+    for(int row = firstRow; row <= lastRow; row++)
+    {
+        for(int column = firstColumn; column <= lastColumn; column++)
+        {
+            const auto bounds = mOwner.getCellBounds(row, column);
+            const size_t index = mOwner.getCellIndex(row, column);
+
+            if(!mOwner.canConnect(row, column))
+                continue;
+            // no parameters means the pair was never connected
+            ConnectionParameters* parameters = mOwner.mCells[index].get();
+            const bool isPending = mOwner.mPendingCells[index];
+            const bool isOn = isPending ? mOwner.mDragTarget
+                                        : parameters != nullptr && parameters->on.getValue();
+
+            g.setColour(isOn ? juce::Colours::lightgreen : juce::Colours::darkgrey);
+            g.fillRect(bounds.reduced(1));
+
+            if(isOn && !isPending && parameters != nullptr)
+            {
+                const float peak = parameters->level.peak.load(std::memory_order_relaxed);
+                const float decibels = juce::Decibels::gainToDecibels(peak, -60.f);
+                const float proportion = juce::jlimit(0.f, 1.f, (decibels + 60.f) / 60.f);
+                auto meter = bounds.reduced(3);
+                meter = meter.removeFromBottom((int)((float)meter.getHeight() * proportion));
+                g.setColour(peak >= 1.f ? juce::Colours::red : juce::Colours::green);
+                g.fillRect(meter);
+            }
+
+            if(mOwner.isSelected(row, column))
+            {
+                g.setColour(juce::Colours::yellow);
+                g.drawRect(bounds, 2);
+            }
+        }
+    }
+
+    g.setColour(juce::Colours::white);
+    for(int row = firstRow; row <= lastRow; row++)
+    {
+        const juce::Rectangle<int> header{ 0, columnHeaderHeight + row * cellSize,
+                                           rowHeaderWidth, cellSize };
+        g.drawFittedText(mOwner.mTransmitters[(size_t)row].name, header.reduced(4, 0),
+                         juce::Justification::centredLeft, 1);
+    }
+
+    for(int column = firstColumn; column <= lastColumn; column++)
+    {
+        const juce::Rectangle<int> header{ rowHeaderWidth + column * cellSize, 0,
+                                           cellSize, columnHeaderHeight };
+        g.drawFittedText(mOwner.mRecievers[(size_t)column].name, header.reduced(1, 2),
+                         juce::Justification::centred, 3, 0.5f);
+    }
+}
+
+void RoutingMatrix::Grid::mouseDown(const juce::MouseEvent& event)
+{
+    mOwner.refresh();
+    const auto cell = mOwner.getCellAt(event.getPosition());
+    if(!cell.has_value()) return;
+
+    if(event.mods.isShiftDown())
+    {
+        mOwner.mSelecting = true;
+        mOwner.mSelectionStart = cell;
+        mOwner.mSelectionEnd = cell;
+        repaint();
+        return;
+    }
+
+    ConnectionParameters* parameters = mOwner.getCell(cell->row, cell->column);
+
+    // the first cell decides whether this drag connects or disconnects
+    mOwner.mDragging = true;
+    mOwner.mDragTarget = !(parameters != nullptr && parameters->on.getValue());
+    mOwner.touchCell(*cell);
+}
+
+void RoutingMatrix::Grid::mouseDrag(const juce::MouseEvent& event)
+{
+    const auto cell = mOwner.getCellAt(event.getPosition());
+    if(!cell.has_value()) return;
+
+    if(mOwner.mSelecting)
+    {
+        mOwner.mSelectionEnd = cell;
+        repaint();
+    }
+    else if(mOwner.mDragging)
+    {
+        mOwner.touchCell(*cell);
+    }
+}
+
+void RoutingMatrix::Grid::mouseUp(const juce::MouseEvent& event)
+{
+    juce::ignoreUnused(event);
+    mOwner.mSelecting = false;
+
+    if(mOwner.mDragging)
+        mOwner.commitPendingEdits();
+}
+
+//==================================================================================================
+
+RoutingMatrix::RoutingMatrix()
+    : cGrid(*this)
+{
+    addAndMakeVisible(cViewport);
+    cViewport.setViewedComponent(&cGrid, false);
+    cViewport.setScrollBarsShown(true, true);
+
+    addAndMakeVisible(cGainSlider);
+    cGainSlider.setRange(0.f, 1.f);
+    cGainSlider.setNumDecimalPlacesToDisplay(2);
+    cGainSlider.setValue(1.f, juce::dontSendNotification);
+
+    addAndMakeVisible(cApplyGainButton);
+    cApplyGainButton.setButtonText("Apply gain");
+    cApplyGainButton.onClick = [this]()
+    {
+        applyGainToSelection();
+    };
+
+    addAndMakeVisible(cHintLabel);
+    cHintLabel.setText("Drag to connect, shift-drag to select", juce::dontSendNotification);
+    cHintLabel.setJustificationType(juce::Justification::centredLeft);
+    cHintLabel.setMinimumHorizontalScale(0.5f);
+}
+
+RoutingMatrix::~RoutingMatrix()
+{
+    stopTimer();
+}
+
+void RoutingMatrix::resized()
+{
+    auto area = getLocalBounds();
+    auto controlArea = area.removeFromBottom(30);
+
+    cViewport.setBounds(area);
+    cApplyGainButton.setBounds(controlArea.removeFromRight(90).reduced(2));
+    cGainSlider.setBounds(controlArea.removeFromRight(controlArea.proportionOfWidth(0.5f)));
+    cHintLabel.setBounds(controlArea);
+}
+
+void RoutingMatrix::visibilityChanged()
+{
+    // a hidden matrix neither polls nor repaints
+    if(isVisible())
+    {
+        refresh();
+        startTimerHz(30);
+    }
+    else
+    {
+        stopTimer();
+        cancelDrag();
+    }
+}
+
+void RoutingMatrix::timerCallback()
+{
+    if(refresh())
+    {
+        cGrid.repaint();
+        return;
+    }
+
+    // the meters change every block, but only what is in view needs repainting
+    cGrid.repaint(cViewport.getViewPositionX(), cViewport.getViewPositionY(),
+                  cViewport.getViewWidth(), cViewport.getViewHeight());
+}
+
+void RoutingMatrix::setCore(Core* core)
+{
+    mCore = core;
+    mVersion = invalidVersion;
+    cGrid.repaint();
+}
+
+bool RoutingMatrix::refresh()
+{
+    Core* core = mCore;
+    if(core == nullptr) return false;
+    const uint64_t version = core->getTopologyVersion();
+    if(version == mVersion) return false;
+
+    // the cells of a drag may be gone, the edits are dropped with them
+    cancelDrag();
+
+    mVersion = version;
+    mTransmitters.clear();
+    mRecievers.clear();
+
+    const auto collect = [core](Map<Instance*>* instanceList, std::vector<Line>& lines)
+    {
+        lines.reserve(instanceList->size() + core->getBuses()->size());
+        for(auto& instkv : *instanceList)
+            lines.push_back({ instkv.second->getName(), instkv.first, false });
+        for(auto& buskv : *core->getBuses())
+            lines.push_back({ buskv.second, buskv.first, true });
+
+        std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b)
+        {
+            if(a.isBus != b.isBus) return b.isBus;
+            const int order = a.name.compareNatural(b.name);
+            if(order != 0) return order < 0;
+            return a.id < b.id;
+        });
+    };
+
+    {
+        // the maps belong to Core, instances may come and go meanwhile
+        const juce::ScopedReadLock lock(core->getRoutingLock());
+        collect(core->getTransmitters(), mTransmitters);
+        collect(core->getRecievers(), mRecievers);
+
+        mCells.assign(mTransmitters.size() * mRecievers.size(), {});
+        for(int row = 0; row < getNumberOfRows(); row++)
+        {
+            for(int column = 0; column < getNumberOfColumns(); column++)
+            {
+                mCells[getCellIndex(row, column)] = core->getConnectionParameters(
+                    mTransmitters[(size_t)row].id, mRecievers[(size_t)column].id);
+            }
+        }
+    }
+    mPendingCells.assign(mCells.size(), false);
+
+    mSelectionStart.reset();
+    mSelectionEnd.reset();
+
+    cGrid.setSize(rowHeaderWidth + getNumberOfColumns() * cellSize,
+                  columnHeaderHeight + getNumberOfRows() * cellSize);
+
+    return true;
+}
+
+void RoutingMatrix::cancelDrag()
+{
+    mDragging = false;
+    mSelecting = false;
+    mPendingEdits.clear();
+    std::fill(mPendingCells.begin(), mPendingCells.end(), false);
+}
+
+void RoutingMatrix::commitPendingEdits()
+{
+    mDragging = false;
+    if(mPendingEdits.empty()) return;
+
+    // one rebuild of the routing for the whole drag
+    if(mCore != nullptr)
+        mCore->applyConnectionEdits(mPendingEdits);
+
+    mPendingEdits.clear();
+    std::fill(mPendingCells.begin(), mPendingCells.end(), false);
+    cGrid.repaint();
+}
+
+void RoutingMatrix::applyGainToSelection()
+{
+    refresh();
+    if(!mSelectionStart.has_value() || !mSelectionEnd.has_value()) return;
+
+    const float gain = (float)cGainSlider.getValue();
+    std::vector<ConnectionEdit> edits;
+
+    // only pairs that are connected, a gain alone does not make a connection
+    for(int row = 0; row < getNumberOfRows(); row++)
+    {
+        for(int column = 0; column < getNumberOfColumns(); column++)
+        {
+            if(!isSelected(row, column) || getCell(row, column) == nullptr) continue;
+            edits.push_back({ mTransmitters[(size_t)row].id, mRecievers[(size_t)column].id,
+                              std::nullopt, gain });
+        }
+    }
+
+    if(mCore != nullptr && !edits.empty())
+        mCore->applyConnectionEdits(edits);
+}
+
+size_t RoutingMatrix::getCellIndex(int row, int column) const
+{
+    return (size_t)row * mRecievers.size() + (size_t)column;
+}
+
+ConnectionParameters* RoutingMatrix::getCell(int row, int column) const
+{
+    if(row < 0 || row >= getNumberOfRows()) return nullptr;
+    if(column < 0 || column >= getNumberOfColumns()) return nullptr;
+    return mCells[getCellIndex(row, column)].get();
+}
+
+bool RoutingMatrix::canConnect(int row, int column) const
+{
+    return !(mTransmitters[(size_t)row].isBus && mRecievers[(size_t)column].isBus);
+}
+
+std::optional<RoutingMatrix::CellIndex> RoutingMatrix::getCellAt(juce::Point<int> position) const
+{
+    if(position.getX() < rowHeaderWidth || position.getY() < columnHeaderHeight)
+        return std::nullopt;
+
+    const int row = (position.getY() - columnHeaderHeight) / cellSize;
+    const int column = (position.getX() - rowHeaderWidth) / cellSize;
+    if(row >= getNumberOfRows() || column >= getNumberOfColumns())
+        return std::nullopt;
+
+    return CellIndex{ row, column };
+}
+
+juce::Rectangle<int> RoutingMatrix::getCellBounds(int row, int column) const
+{
+    return { rowHeaderWidth + column * cellSize, columnHeaderHeight + row * cellSize,
+             cellSize, cellSize };
+}
+
+bool RoutingMatrix::isSelected(int row, int column) const
+{
+    if(!mSelectionStart.has_value() || !mSelectionEnd.has_value()) return false;
+
+    const auto [firstRow, lastRow] = std::minmax(mSelectionStart->row, mSelectionEnd->row);
+    const auto [firstColumn, lastColumn] = std::minmax(mSelectionStart->column, mSelectionEnd->column);
+    return row >= firstRow && row <= lastRow && column >= firstColumn && column <= lastColumn;
+}
+
+void RoutingMatrix::touchCell(CellIndex cell)
+{
+    if(!canConnect(cell.row, cell.column)) return;
+
+    ConnectionParameters* parameters = getCell(cell.row, cell.column);
+    const bool isOn = parameters != nullptr && parameters->on.getValue();
+
+    const size_t index = getCellIndex(cell.row, cell.column);
+    if(mPendingCells[index]) return;
+    mPendingCells[index] = true;
+
+    if(isOn != mDragTarget)
+    {
+        mPendingEdits.push_back({ mTransmitters[(size_t)cell.row].id, mRecievers[(size_t)cell.column].id,
+                                  mDragTarget, std::nullopt });
+    }
+
+    cGrid.repaint(getCellBounds(cell.row, cell.column));
+}
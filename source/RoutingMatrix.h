@@ -0,0 +1,115 @@
+/*  Every transmitter against every reciever in one grid, transmitters are the
+    rows, recievers the columns. Only the cells in view are painted, so this
+    stays usable with hundreds of instances. Edits are collected while the
+    mouse is down and handed to Core as one batch on release.
+*/
+
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+#include <vector>
+#include <optional>
+
+#include "Core.h"
+
+namespace patch
+{
+
+class RoutingMatrix
+    : public juce::Component
+    , private juce::Timer
+{
+public:
+    RoutingMatrix();
+    ~RoutingMatrix() override;
+
+    // the domain whose instances are shown, has to outlive the matrix or
+    // the next call
+    void setCore(Core* core);
+
+    void resized() override;
+    void visibilityChanged() override;
+
+private:
+    // the scrolled content, headers are part of it
+    class Grid : public juce::Component
+    {
+    public:
+        explicit Grid(RoutingMatrix& owner);
+
+        void paint(juce::Graphics& g) override;
+        void mouseDown(const juce::MouseEvent& event) override;
+        void mouseDrag(const juce::MouseEvent& event) override;
+        void mouseUp(const juce::MouseEvent& event) override;
+
+    private:
+        RoutingMatrix& mOwner;
+    };
+
+    // a row or a column, buses are both and come after the instances
+    struct Line
+    {
+        juce::String name;
+        juce::Uuid id;
+        bool isBus;
+    };
+
+    struct CellIndex
+    {
+        int row;
+        int column;
+    };
+
+    static constexpr int cellSize = 24;
+    static constexpr int rowHeaderWidth = 120;
+    static constexpr int columnHeaderHeight = 48;
+    static constexpr uint64_t invalidVersion = ~(uint64_t)0;
+
+    void timerCallback() override;
+
+    // Rebuilds the snapshot if the topology of Core changed since the last call.
+    // Returns true if it did.
+    bool refresh();
+    void cancelDrag();
+    void commitPendingEdits();
+    void applyGainToSelection();
+
+    int getNumberOfRows() const { return (int)mTransmitters.size(); }
+    int getNumberOfColumns() const { return (int)mRecievers.size(); }
+    size_t getCellIndex(int row, int column) const;
+    ConnectionParameters* getCell(int row, int column) const;
+    // buses do not connect to each other
+    bool canConnect(int row, int column) const;
+    std::optional<CellIndex> getCellAt(juce::Point<int> position) const;
+    juce::Rectangle<int> getCellBounds(int row, int column) const;
+    bool isSelected(int row, int column) const;
+
+    // toggle drag, every cell passed gets switched to mDragTarget
+    void touchCell(CellIndex cell);
+
+    Grid cGrid;
+    juce::Viewport cViewport;
+    juce::Slider cGainSlider;
+    juce::TextButton cApplyGainButton;
+    juce::Label cHintLabel;
+
+    // sorted by name, only valid as long as the topology version matches
+    std::vector<Line> mTransmitters;
+    std::vector<Line> mRecievers;
+    std::vector<ConnectionHandle> mCells;
+    uint64_t mVersion = invalidVersion;
+    Core* mCore = nullptr;
+
+    std::vector<ConnectionEdit> mPendingEdits;
+    std::vector<bool> mPendingCells;
+    bool mDragging = false;
+    bool mSelecting = false;
+    bool mDragTarget = false;
+
+    std::optional<CellIndex> mSelectionStart;
+    std::optional<CellIndex> mSelectionEnd;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RoutingMatrix)
+};
+
+} // namespace patch
@@ -0,0 +1,417 @@
+#include "SharedRouting.h"
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <cstring>
+
+// POSIX shared memory, everywhere but on Windows
+#ifndef SHARED_ROUTING_AVAILABLE
+    #if defined(_WIN32)
+        #define SHARED_ROUTING_AVAILABLE 0
+    #else
+        #define SHARED_ROUTING_AVAILABLE 1
+    #endif
+#endif
+
+#if SHARED_ROUTING_AVAILABLE
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace patch;
+
+// Lives in the segment, which starts out zeroed. Zero is a valid state for
+// every member, so whoever maps it first does not have to initialise it.
+struct SharedRouting::Slot
+{
+    enum : uint32_t { free = 0, claimed = 1, active = 2 };
+
+    std::atomic<uint32_t> state;
+    std::atomic<int32_t> processId;
+    std::atomic<uint64_t> id[2];
+    std::atomic<char> name[maxNameLength + 1];
+    // the number of times the slot was published in the upper half, the
+    // readers attached since the last time in the lower one
+    alignas(cacheLineSize) std::atomic<uint64_t> readers;
+
+    // samples written since the slot was published
+    alignas(cacheLineSize) std::atomic<uint64_t> written;
+    // where the writer paused when nobody was attached, what is before it
+    // is stale
+    std::atomic<uint64_t> resumed;
+    // only touched by the writer
+    std::atomic<bool> isPaused;
+    alignas(cacheLineSize) RoutingSample samples[numberOfChannels][ringSize];
+};
+
+struct SharedRouting::Registry
+{
+    std::atomic<uint32_t> layout;
+    // SharedRouting objects that have it open, in any process
+    std::atomic<uint32_t> users;
+    alignas(cacheLineSize) std::atomic<uint64_t> version;
+    Slot slots[maxTransmitters];
+};
+
+namespace
+{
+    static_assert(std::atomic<uint32_t>::is_always_lock_free
+                  && std::atomic<uint64_t>::is_always_lock_free
+                  && std::atomic<char>::is_always_lock_free,
+                  "atomics in shared memory have to be lock-free");
+    static_assert((SharedRouting::ringSize & (SharedRouting::ringSize - 1)) == 0,
+                  "the ring size has to be a power of two");
+
+    // bumped whenever Registry changes, builds routing in another precision
+    // have rings of another layout as well
+    constexpr uint32_t layoutVersion = 0x50410000u | ((uint32_t)sizeof(RoutingSample) << 8) | 2u;
+
+    constexpr size_t ringMask = SharedRouting::ringSize - 1;
+    constexpr uint64_t readerMask = 0xffffffffu;
+
+    template<typename DestinationType, typename SourceType>
+    void copySamples(DestinationType* destination, const SourceType* source, size_t numberOfSamples)
+    {
+        if constexpr (std::is_same_v<DestinationType, SourceType>)
+            std::memcpy(destination, source, numberOfSamples * sizeof(SourceType));
+        else
+            for (size_t i = 0; i < numberOfSamples; i++)
+                destination[i] = static_cast<DestinationType>(source[i]);
+    }
+
+    bool isProcessAlive(int32_t processId)
+    {
+#if SHARED_ROUTING_AVAILABLE
+        return processId > 0 && (::kill(processId, 0) == 0 || errno == EPERM);
+#else
+        juce::ignoreUnused(processId);
+        return false;
+#endif
+    }
+
+    // names are only for display, a reader catching one halfway gets the
+    // rest with the next version
+    void storeName(std::atomic<char>* destination, const juce::String& name)
+    {
+        const std::string utf8 = name.toStdString().substr(0, SharedRouting::maxNameLength);
+        for(size_t i = 0; i <= SharedRouting::maxNameLength; i++)
+            destination[i].store(i < utf8.size() ? utf8[i] : '\0', std::memory_order_relaxed);
+    }
+
+    std::string toSegmentName(const juce::String& name)
+    {
+        return "/" + name.replaceCharacter('/', '_').toStdString();
+    }
+}
+
+std::unique_ptr<SharedRouting> SharedRouting::open(const juce::String& name)
+{
+#if SHARED_ROUTING_AVAILABLE
+    const std::string segmentName = toSegmentName(name);
+    const int descriptor = ::shm_open(segmentName.c_str(), O_CREAT | O_RDWR, 0600);
+    if(descriptor < 0) return nullptr;
+
+    // the first process sizes it, which zeroes it as well
+    struct stat status {};
+    bool isUsable = ::fstat(descriptor, &status) == 0;
+    if(isUsable && status.st_size == 0)
+        isUsable = ::ftruncate(descriptor, (off_t)sizeof(Registry)) == 0
+                   && ::fstat(descriptor, &status) == 0;
+    isUsable = isUsable && (size_t)status.st_size == sizeof(Registry);
+
+    void* memory = isUsable
+        ? ::mmap(nullptr, sizeof(Registry), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0)
+        : MAP_FAILED;
+    ::close(descriptor);
+    if(memory == MAP_FAILED) return nullptr;
+
+    auto* registry = static_cast<Registry*>(memory);
+    uint32_t layout = 0;
+    if(!registry->layout.compare_exchange_strong(layout, layoutVersion) && layout != layoutVersion)
+    {
+        ::munmap(memory, sizeof(Registry));
+        return nullptr;
+    }
+
+    registry->users.fetch_add(1, std::memory_order_acq_rel);
+    return std::unique_ptr<SharedRouting>(new SharedRouting(memory, sizeof(Registry), name));
+#else
+    juce::ignoreUnused(name);
+    return nullptr;
+#endif
+}
+
+void SharedRouting::remove(const juce::String& name)
+{
+#if SHARED_ROUTING_AVAILABLE
+    ::shm_unlink(toSegmentName(name).c_str());
+#else
+    juce::ignoreUnused(name);
+#endif
+}
+
+SharedRouting::SharedRouting(void* memory, size_t size, const juce::String& name)
+    : mRegistry(static_cast<Registry*>(memory))
+    , mSize(size)
+    , mName(name)
+#if SHARED_ROUTING_AVAILABLE
+    , mProcessId((int)::getpid())
+#else
+    , mProcessId(0)
+#endif
+{
+}
+
+SharedRouting::~SharedRouting()
+{
+    while(!mPublishedSlots.empty())
+        withdraw(mPublishedSlots.back());
+    while(!mAttachments.empty())
+        detach(mAttachments.back().first, mAttachments.back().second);
+
+    // a process opening it right now keeps what it mapped, the next one
+    // starts a segment of its own
+    const bool isLastUser = mRegistry->users.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+#if SHARED_ROUTING_AVAILABLE
+    ::munmap(mRegistry, mSize);
+#endif
+    if(isLastUser)
+        remove(mName);
+}
+
+int SharedRouting::publish(const juce::Uuid& id, const juce::String& name)
+{
+    for(size_t index = 0; index < maxTransmitters; index++)
+    {
+        Slot& slot = mRegistry->slots[index];
+
+        uint32_t state = slot.state.load(std::memory_order_acquire);
+        const bool isAbandoned = state == Slot::active
+                                 && !isProcessAlive(slot.processId.load(std::memory_order_relaxed));
+        if(state != Slot::free && !isAbandoned) continue;
+        if(!slot.state.compare_exchange_strong(state, Slot::claimed, std::memory_order_acq_rel))
+            continue;
+
+        uint64_t rawId[2];
+        std::memcpy(rawId, id.getRawData(), sizeof(rawId));
+        slot.id[0].store(rawId[0], std::memory_order_relaxed);
+        slot.id[1].store(rawId[1], std::memory_order_relaxed);
+        slot.processId.store(mProcessId, std::memory_order_relaxed);
+        slot.written.store(0, std::memory_order_relaxed);
+        slot.resumed.store(0, std::memory_order_relaxed);
+        slot.isPaused.store(false, std::memory_order_relaxed);
+        storeName(slot.name, name);
+
+        // attachments to whoever had the slot before end here
+        uint64_t readers = slot.readers.load(std::memory_order_relaxed);
+        while(!slot.readers.compare_exchange_weak(readers, ((readers >> 32) + 1) << 32,
+                                                  std::memory_order_acq_rel))
+        {}
+
+        slot.state.store(Slot::active, std::memory_order_release);
+
+        mRegistry->version.fetch_add(1, std::memory_order_acq_rel);
+        mPublishedSlots.push_back((int)index);
+        return (int)index;
+    }
+
+    return -1;
+}
+
+void SharedRouting::withdraw(int slot)
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return;
+
+    auto published = std::find(mPublishedSlots.begin(), mPublishedSlots.end(), slot);
+    if(published == mPublishedSlots.end()) return;
+    mPublishedSlots.erase(published);
+
+    mRegistry->slots[slot].state.store(Slot::free, std::memory_order_release);
+    mRegistry->version.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void SharedRouting::rename(int slot, const juce::String& name)
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return;
+
+    storeName(mRegistry->slots[slot].name, name);
+    mRegistry->version.fetch_add(1, std::memory_order_acq_rel);
+}
+
+std::vector<SharedRouting::Transmitter> SharedRouting::getTransmitters() const
+{
+    std::vector<Transmitter> transmitters;
+
+    for(size_t index = 0; index < maxTransmitters; index++)
+    {
+        const Slot& slot = mRegistry->slots[index];
+        if(slot.state.load(std::memory_order_acquire) != Slot::active) continue;
+
+        // processes that crashed never withdrew theirs
+        const int32_t processId = slot.processId.load(std::memory_order_relaxed);
+        if(!isProcessAlive(processId)) continue;
+
+        const uint64_t rawId[2] = { slot.id[0].load(std::memory_order_relaxed),
+                                    slot.id[1].load(std::memory_order_relaxed) };
+        std::string name;
+        for(size_t i = 0; i < maxNameLength; i++)
+        {
+            const char character = slot.name[i].load(std::memory_order_relaxed);
+            if(character == '\0') break;
+            name += character;
+        }
+
+        transmitters.push_back({ juce::Uuid(reinterpret_cast<const juce::uint8*>(rawId)),
+                                 juce::String::fromUTF8(name.data(), (int)name.size()), (int)index,
+                                 processId == mProcessId });
+    }
+
+    return transmitters;
+}
+
+int SharedRouting::findTransmitter(const juce::Uuid& id) const
+{
+    for(size_t index = 0; index < maxTransmitters; index++)
+        if(holds((int)index, id))
+            return (int)index;
+
+    return -1;
+}
+
+bool SharedRouting::holds(int slot, const juce::Uuid& id) const
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return false;
+
+    const Slot& source = mRegistry->slots[slot];
+    if(source.state.load(std::memory_order_acquire) != Slot::active) return false;
+
+    uint64_t rawId[2];
+    std::memcpy(rawId, id.getRawData(), sizeof(rawId));
+    return source.id[0].load(std::memory_order_relaxed) == rawId[0]
+        && source.id[1].load(std::memory_order_relaxed) == rawId[1];
+}
+
+uint64_t SharedRouting::getVersion() const
+{
+    return mRegistry->version.load(std::memory_order_acquire);
+}
+
+uint64_t SharedRouting::attach(int slot, const juce::Uuid& id)
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return 0;
+    Slot& target = mRegistry->slots[slot];
+
+    // the slot may be published again in between, which the exchange notices
+    uint64_t readers = target.readers.load(std::memory_order_acquire);
+    while(holds(slot, id))
+    {
+        if(target.readers.compare_exchange_weak(readers, readers + 1, std::memory_order_acq_rel))
+        {
+            const uint64_t attachment = readers >> 32;
+            mAttachments.emplace_back(slot, attachment);
+            return attachment;
+        }
+    }
+
+    return 0;
+}
+
+void SharedRouting::detach(int slot, uint64_t attachment)
+{
+    auto attached = std::find(mAttachments.begin(), mAttachments.end(),
+                              std::make_pair(slot, attachment));
+    if(attached == mAttachments.end()) return;
+    mAttachments.erase(attached);
+
+    Slot& target = mRegistry->slots[slot];
+    uint64_t readers = target.readers.load(std::memory_order_acquire);
+    while((readers >> 32) == attachment && (readers & readerMask) > 0
+          && !target.readers.compare_exchange_weak(readers, readers - 1, std::memory_order_acq_rel))
+    {}
+}
+
+bool SharedRouting::isAttached(int slot) const
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return false;
+    return (mRegistry->slots[slot].readers.load(std::memory_order_acquire) & readerMask) > 0;
+}
+
+template<typename SampleType>
+void SharedRouting::write(int slot, const SampleType* const* channels, size_t numberOfSamples)
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return;
+    Slot& target = mRegistry->slots[slot];
+
+    // nobody would read it, the samples of a session full of transmitters
+    // only cross when they are routed somewhere
+    if(!isAttached(slot))
+    {
+        // what is in the ring goes stale, readers attaching start after it
+        if(!target.isPaused.exchange(true, std::memory_order_relaxed))
+            target.resumed.store(target.written.load(std::memory_order_relaxed),
+                                 std::memory_order_release);
+        return;
+    }
+    target.isPaused.store(false, std::memory_order_relaxed);
+
+    // a block longer than the ring only leaves its end in it
+    const size_t skipped = numberOfSamples > ringSize ? numberOfSamples - ringSize : 0;
+    const uint64_t written = target.written.load(std::memory_order_relaxed) + skipped;
+    numberOfSamples -= skipped;
+
+    const size_t start = (size_t)(written & ringMask);
+    const size_t first = juce::jmin(numberOfSamples, ringSize - start);
+    for(size_t ch = 0; ch < numberOfChannels; ch++)
+    {
+        copySamples(target.samples[ch] + start, channels[ch] + skipped, first);
+        copySamples(target.samples[ch], channels[ch] + skipped + first, numberOfSamples - first);
+    }
+
+    // the samples are complete for whoever sees the new position
+    target.written.store(written + numberOfSamples, std::memory_order_release);
+}
+
+template void SharedRouting::write(int, const float* const*, size_t);
+template void SharedRouting::write(int, const double* const*, size_t);
+
+size_t SharedRouting::getFill(int slot, uint64_t readPosition) const
+{
+    if(slot < 0 || slot >= (int)maxTransmitters) return 0;
+
+    const uint64_t written = mRegistry->slots[slot].written.load(std::memory_order_acquire);
+    if(readPosition == notStarted || readPosition > written) return 0;
+    return (size_t)juce::jmin<uint64_t>(written - readPosition, ringSize);
+}
+
+size_t SharedRouting::read(int slot, uint64_t& readPosition, size_t numberOfSamples,
+                           Pieces& pieces) const
+{
+    pieces.size[0] = pieces.size[1] = 0;
+    if(slot < 0 || slot >= (int)maxTransmitters) return 0;
+    const Slot& source = mRegistry->slots[slot];
+
+    const uint64_t written = source.written.load(std::memory_order_acquire);
+    const uint64_t resumed = juce::jmin(source.resumed.load(std::memory_order_acquire), written);
+    if(readPosition == notStarted || readPosition > written || written - readPosition > maxLatency)
+        readPosition = written - juce::jmin<uint64_t>(written - resumed,
+                                                      juce::jmin(2 * numberOfSamples, maxLatency));
+
+    const size_t available = (size_t)juce::jmin<uint64_t>(numberOfSamples, written - readPosition);
+    const size_t start = (size_t)(readPosition & ringMask);
+    const size_t first = juce::jmin(available, ringSize - start);
+    for(size_t ch = 0; ch < numberOfChannels; ch++)
+    {
+        pieces.data[0][ch] = source.samples[ch] + start;
+        pieces.data[1][ch] = source.samples[ch];
+    }
+    pieces.size[0] = first;
+    pieces.size[1] = available - first;
+
+    readPosition += available;
+    return available;
+}
@@ -0,0 +1,127 @@
+/*  Routing between processes. Hosts that sandbox plugins run them in several
+    processes, every process has a Core of its own and transmitters in one
+    never reach recievers in another. Cores that enable shared routing map the
+    same POSIX shared memory segment. It holds a registry of the transmitters
+    of all those processes and a ring buffer for each of them: the transmitter
+    writes every block it sends into its ring, recievers in other processes
+    read from it at their own pace. Per block both sides only touch atomics
+    and samples, there are no system calls and no locks.
+    Every ring has one writer. Readers never write to it, so any number of
+    them can follow one transmitter, each keeps its own read position. They
+    attach to the slot first, rings nobody is attached to are not written.
+    The last process to close the segment removes its name.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+
+#include "MixKernels.h"
+
+namespace patch
+{
+
+class SharedRouting
+{
+public:
+    static constexpr size_t maxTransmitters = 64;
+    static constexpr size_t numberOfChannels = 2;
+    // per channel, a power of two
+    static constexpr size_t ringSize = 8192;
+    // A reader that falls further behind skips ahead, so a connection between
+    // processes never has more latency than this.
+    static constexpr size_t maxLatency = ringSize / 4;
+    static constexpr size_t maxNameLength = 63;
+    // read positions start here, the first read picks the actual position
+    static constexpr uint64_t notStarted = ~(uint64_t)0;
+
+    // Maps the segment, creating it if it does not exist yet. nullptr where
+    // there is no shared memory, or if the segment was created by a build with
+    // a different layout or routing precision.
+    static std::unique_ptr<SharedRouting> open(const juce::String& name);
+    // Removes the name, processes that mapped the segment keep using it.
+    static void remove(const juce::String& name);
+    // Withdraws and detaches everything of this one, the last one the segment
+    // was opened with removes it.
+    ~SharedRouting();
+
+    SharedRouting(const SharedRouting&) = delete;
+    SharedRouting& operator=(const SharedRouting&) = delete;
+
+    struct Transmitter
+    {
+        juce::Uuid id;
+        juce::String name;
+        int slot;
+        // published by this process
+        bool isLocal;
+    };
+
+    // Returns the slot of the transmitter, -1 if all slots are taken. Slots of
+    // processes that died without withdrawing are taken over.
+    int publish(const juce::Uuid& id, const juce::String& name);
+    // slots published through another SharedRouting are left alone
+    void withdraw(int slot);
+    void rename(int slot, const juce::String& name);
+    std::vector<Transmitter> getTransmitters() const;
+    // -1 if no process published it
+    int findTransmitter(const juce::Uuid& id) const;
+    // whether the slot still belongs to the transmitter, it may have been
+    // withdrawn and taken by another one since it was looked up
+    bool holds(int slot, const juce::Uuid& id) const;
+    // changes whenever a transmitter is published, renamed or withdrawn by
+    // any of the processes
+    uint64_t getVersion() const;
+
+    // Readers attach to the slot of the transmitter they read, the writer
+    // skips rings nobody is attached to. Returns what to detach with, 0 if
+    // the slot does not hold the transmitter. Attachments end with the
+    // transmitter withdrawing, detaching after that does nothing.
+    uint64_t attach(int slot, const juce::Uuid& id);
+    void detach(int slot, uint64_t attachment);
+    bool isAttached(int slot) const;
+
+    // Only from the process that published the slot, one thread at a time,
+    // any number of slots at once. Does nothing while no reader is attached.
+    template<typename SampleType>
+    void write(int slot, const SampleType* const* channels, size_t numberOfSamples);
+
+    // Samples written after readPosition, 0 for a reader that did not start.
+    size_t getFill(int slot, uint64_t readPosition) const;
+
+    // The ring wraps, so what is read comes in two pieces.
+    struct Pieces
+    {
+        std::array<const RoutingSample*, numberOfChannels> data[2];
+        size_t size[2];
+    };
+    // Points pieces at the next samples after readPosition, at most
+    // numberOfSamples of them, and moves readPosition past them. Returns how
+    // many there are, fewer if the writer did not get that far yet. A reader
+    // that starts or fell too far behind starts over two blocks behind the
+    // writer, which leaves room for the processes not being scheduled alike,
+    // but never before what the writer wrote since it last resumed.
+    size_t read(int slot, uint64_t& readPosition, size_t numberOfSamples, Pieces& pieces) const;
+
+private:
+    struct Slot;
+    struct Registry;
+
+    SharedRouting(void* memory, size_t size, const juce::String& name);
+
+    Registry* mRegistry;
+    size_t mSize;
+    juce::String mName;
+    int mProcessId;
+    // withdrawn when this is destroyed, so others stop listing them
+    std::vector<int> mPublishedSlots;
+    // slot and attachment, detached when this is destroyed
+    std::vector<std::pair<int, uint64_t>> mAttachments;
+};
+
+} // namespace patch
@@ -1,10 +1,13 @@
 /*  Inheritance-compatible base class for singleton design pattern. Derive a 
     class from this and use the same class as the template argument.
+    The instance is created by whichever thread asks for it first, any other
+    thread asking at the same time waits for it.
  */
 
 #pragma once
 
 #include <memory>
+#include <mutex>
 
 namespace patch
 {
@@ -19,10 +22,10 @@ namespace patch
 
         static Derived* getInstance()
         {
-            if (instance == nullptr)
+            std::call_once(created, []
             {
                 instance = std::unique_ptr<Derived>(new Derived());
-            }
+            });
 
             return instance.get();
         }
@@ -31,6 +34,7 @@ namespace patch
         Singleton() = default;
 
         inline static std::unique_ptr<Derived> instance = nullptr;
+        inline static std::once_flag created;
     };
 
 } // namespace norm
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "Tracer.h"
+
+using namespace patch;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+class Tracer::Writer : public juce::Thread
+{
+public:
+    Writer(Tracer& tracer, std::unique_ptr<juce::FileOutputStream> outputStream)
+        : juce::Thread("Patch Trace Writer")
+        , owner(tracer)
+        , stream(std::move(outputStream))
+    {}
+
+    void run() override
+    {
+        stream->writeText("[\n", false, false, nullptr);
+
+        while(!threadShouldExit())
+        {
+            wait(50);
+            owner.drain(*stream, firstEvent);
+        }
+
+        owner.drain(*stream, firstEvent);
+        stream->writeText("\n]\n", false, false, nullptr);
+        stream->flush();
+    }
+
+private:
+    Tracer& owner;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    bool firstEvent = true;
+};
+
+//==============================================================================
+
+Tracer::Tracer()
+    : mStartTicks(juce::Time::getHighResolutionTicks())
+{}
+
+Tracer::~Tracer()
+{
+    stop();
+
+    ThreadBuffer* buffer = mBuffers.exchange(nullptr);
+    while(buffer != nullptr)
+    {
+        ThreadBuffer* next = buffer->next;
+        delete buffer;
+        buffer = next;
+    }
+}
+
+bool Tracer::start(const juce::File& file)
+{
+    juce::ScopedLock lock(mWriterLock);
+
+    if(mWriter != nullptr) return false;
+
+    file.deleteFile();
+    auto stream = std::make_unique<juce::FileOutputStream>(file);
+    if(!stream->openedOk()) return false;
+
+    // throw away whatever was recorded before this session
+    for(ThreadBuffer* buffer = mBuffers.load(); buffer != nullptr; buffer = buffer->next)
+        buffer->readIndex.store(buffer->writeIndex.load(std::memory_order_acquire),
+                                std::memory_order_release);
+
+    // the audio threads take theirs with their first event, they must not
+    // allocate
+    for(; mNumberOfAllocatedBuffers < maxNumberOfThreads; mNumberOfAllocatedBuffers++)
+    {
+        auto* buffer = new ThreadBuffer();
+        buffer->next = mBuffers.load();
+        mBuffers.store(buffer, std::memory_order_release);
+    }
+
+    mWriter = std::make_unique<Writer>(*this, std::move(stream));
+    mWriter->startThread();
+    recording.store(true);
+    return true;
+}
+
+void Tracer::stop()
+{
+    juce::ScopedLock lock(mWriterLock);
+
+    recording.store(false);
+
+    if(mWriter == nullptr) return;
+
+    mWriter->stopThread(2000);
+    mWriter = nullptr;
+}
+
+namespace
+{
+    // Gives the buffer of a thread back when the thread exits. The events it
+    // left are written out all the same, they carry their thread.
+    struct ThreadBufferOwner
+    {
+        ~ThreadBufferOwner()
+        {
+            if(buffer != nullptr)
+                buffer->taken.store(false, std::memory_order_release);
+        }
+
+        Tracer::ThreadBuffer* buffer = nullptr;
+        int thread = 0;
+    };
+
+    thread_local ThreadBufferOwner threadBufferOwner;
+}
+
+void Tracer::record(const char* name, char phase, juce::uint64 id)
+{
+    ThreadBuffer* buffer = getBufferForThisThread();
+    if(buffer == nullptr
+       || !buffer->push({ name, juce::Time::getHighResolutionTicks(), id, phase,
+                          threadBufferOwner.thread }))
+        mDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+}
+
+juce::uint64 Tracer::idOf(const juce::Uuid& uuid)
+{
+    const juce::uint8* raw = uuid.getRawData();
+    juce::uint64 id = 0;
+    for(size_t i = 0; i < 8; i++)
+        id = (id << 8) | raw[i];
+    return id;
+}
+
+Tracer::ThreadBuffer* Tracer::getBufferForThisThread()
+{
+    // Taken from those start allocated, the first time a thread records an
+    // event. The buffers are never freed before the Tracer, the writer may
+    // still be reading them.
+    ThreadBufferOwner& owner = threadBufferOwner;
+    if(owner.buffer != nullptr) return owner.buffer;
+
+    for(ThreadBuffer* buffer = mBuffers.load(std::memory_order_acquire); buffer != nullptr;
+        buffer = buffer->next)
+    {
+        bool taken = false;
+        if(!buffer->taken.compare_exchange_strong(taken, true, std::memory_order_acquire)) continue;
+
+        owner.buffer = buffer;
+        if(owner.thread == 0)
+            owner.thread = ++mNumberOfThreads;
+        return buffer;
+    }
+
+    return nullptr;
+}
+
+void Tracer::drain(juce::OutputStream& stream, bool& firstEvent)
+{
+    const double ticksToMicros = 1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond();
+
+    for(ThreadBuffer* buffer = mBuffers.load(); buffer != nullptr; buffer = buffer->next)
+    {
+        juce::String json;
+        buffer->consume([&](const Event& event)
+        {
+            const double timestamp = (double)(event.ticks - mStartTicks) * ticksToMicros;
+
+            json << (firstEvent ? "" : ",\n")
+                 << "{\"name\":\"" << event.name << "\""
+                 << ",\"cat\":\"patch\""
+                 << ",\"ph\":\"" << juce::String::charToString(event.phase) << "\""
+                 << ",\"ts\":" << juce::String(timestamp, 3)
+                 << ",\"pid\":1"
+                 << ",\"tid\":" << juce::String(event.thread);
+            if(event.id != 0)
+                json << ",\"args\":{\"id\":\""
+                     << juce::String::toHexString((juce::int64)event.id).paddedLeft('0', 16)
+                     << "\"}";
+            json << "}";
+
+            firstEvent = false;
+        });
+
+        if(json.isNotEmpty())
+            stream.writeText(json, false, false, nullptr);
+    }
+}
@@ -0,0 +1,147 @@
+/*  Timeline tracing of routing events. Begin and end events are recorded into
+    per-thread lock-free ring buffers and a background thread writes them out
+    as Chrome trace JSON, which can be opened in Perfetto (ui.perfetto.dev) or
+    chrome://tracing.
+    Do not use this class directly, use the MY_TRACE_* macros in Logger.h, so
+    tracing can be compiled out with TRACE_ENABLED.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <memory>
+#include <juce_core/juce_core.h>
+#include "Singleton.h"
+
+namespace patch
+{
+
+class Tracer : public Singleton<Tracer>
+{
+    friend Singleton;
+
+public:
+    struct Event
+    {
+        const char* name;       // has to be a string literal
+        juce::int64 ticks;
+        juce::uint64 id;        // first 8 bytes of an instance id, 0 if none
+        char phase;             // 'B' begin, 'E' end
+        int thread = 0;         // numbered in the order threads first record
+    };
+
+    ~Tracer();
+
+    // Starts recording and writing events into the given file. Calling this
+    // while already recording switches nothing and returns false.
+    bool start(const juce::File& file);
+    // Stops recording, writes out what is left and closes the file.
+    void stop();
+
+    // This is all the disabled macros cost, keep it cheap.
+    static bool isRecording() { return recording.load(std::memory_order_relaxed); }
+
+    void record(const char* name, char phase, juce::uint64 id);
+
+    static juce::uint64 idOf(const juce::Uuid& uuid);
+    juce::uint64 getNumberOfDroppedEvents() const { return mDroppedEvents.load(std::memory_order_relaxed); }
+
+    // Single producer (the owning thread), single consumer (the writer).
+    struct ThreadBuffer
+    {
+        static constexpr size_t capacity = 1 << 13;
+
+        // false if it is full, the writer fell behind
+        bool push(const Event& event)
+        {
+            const size_t write = writeIndex.load(std::memory_order_relaxed);
+            if(write - readIndex.load(std::memory_order_acquire) >= capacity) return false;
+
+            events[write & (capacity - 1)] = event;
+            writeIndex.store(write + 1, std::memory_order_release);
+            return true;
+        }
+
+        // hands the events pushed so far to consumer, oldest first
+        template<typename Consumer>
+        void consume(Consumer&& consumer)
+        {
+            const size_t read = readIndex.load(std::memory_order_relaxed);
+            const size_t write = writeIndex.load(std::memory_order_acquire);
+            for(size_t i = read; i < write; i++)
+                consumer(events[i & (capacity - 1)]);
+            readIndex.store(write, std::memory_order_release);
+        }
+
+        std::array<Event, capacity> events;
+        std::atomic<size_t> writeIndex = 0;
+        std::atomic<size_t> readIndex = 0;
+        // by a thread that is still running, see getBufferForThisThread
+        std::atomic<bool> taken = false;
+        ThreadBuffer* next = nullptr;
+    };
+
+    // Buffers for this many threads are allocated by start. A thread gives its
+    // buffer back when it exits, the events of threads beyond that many
+    // running at once are dropped.
+    static constexpr int maxNumberOfThreads = 32;
+
+private:
+    Tracer();
+
+    class Writer;
+
+    // nullptr once every buffer is taken
+    ThreadBuffer* getBufferForThisThread();
+    void drain(juce::OutputStream& stream, bool& firstEvent);
+
+    inline static std::atomic<bool> recording = false;
+
+    // only ever grows, at the front
+    std::atomic<ThreadBuffer*> mBuffers = nullptr;
+    std::atomic<int> mNumberOfThreads = 0;
+    int mNumberOfAllocatedBuffers = 0;
+    std::atomic<juce::uint64> mDroppedEvents = 0;
+    juce::int64 mStartTicks = 0;
+
+    std::unique_ptr<Writer> mWriter;
+    juce::CriticalSection mWriterLock;
+};
+
+// ScopedTraceEvent
+
+class ScopedTraceEvent
+{
+public:
+    explicit ScopedTraceEvent(const char* eventName)
+        : name(eventName)
+        , active(Tracer::isRecording())
+        , id(0)
+    {
+        if(active)
+            Tracer::getInstance()->record(name, 'B', id);
+    }
+
+    ScopedTraceEvent(const char* eventName, const juce::Uuid& instanceId)
+        : name(eventName)
+        , active(Tracer::isRecording())
+        , id(active ? Tracer::idOf(instanceId) : 0)
+    {
+        if(active)
+            Tracer::getInstance()->record(name, 'B', id);
+    }
+
+    ~ScopedTraceEvent()
+    {
+        if(active)
+            Tracer::getInstance()->record(name, 'E', id);
+    }
+
+private:
+    const char* name;
+    const bool active;
+    const juce::uint64 id;
+};
+
+} // namespace patch
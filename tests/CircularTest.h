@@ -295,3 +295,57 @@ TEST(CircularTest, Reset)
     buffer.reset();
     EXPECT_FLOAT_EQ(buffer.getSum(), 0.f);
 }
+
+TEST(CircularTest, PushBlock)
+{
+    const int size = 7;
+    patch::CircularArray buffer(size);
+    patch::CircularArray reference(size);
+    auto rnd = randArray(size + 3);
+
+    for(int i = 0; i < 3; i++)
+    {
+        buffer.push(100.f);
+        reference.push(100.f);
+    }
+
+    buffer.push(rnd.get(), (size_t)size + 3);
+    for(int i = 0; i < size + 3; i++)
+    {
+        reference.push(rnd[i]);
+    }
+
+    for(ptrdiff_t i = 0; i < size; i++)
+    {
+        EXPECT_FLOAT_EQ(buffer[i], reference[i]);
+    }
+}
+
+TEST(CircularTest, Ranges)
+{
+    const int size = 9;
+    patch::CircularArray buffer(size);
+    auto rnd = randArray(size);
+
+    for(int i = 0; i < 4; i++)
+    {
+        buffer.push(0.f);
+    }
+
+    for(int i = 0; i < size; i++)
+    {
+        buffer.push(rnd[i]);
+    }
+
+    auto [first, second] = buffer.getRanges(2, 6);
+    EXPECT_EQ(first.size + second.size, 6u);
+
+    for(size_t i = 0; i < first.size; i++)
+    {
+        EXPECT_FLOAT_EQ(first.data[i], rnd[2 + (ptrdiff_t)i]);
+    }
+    for(size_t i = 0; i < second.size; i++)
+    {
+        EXPECT_FLOAT_EQ(second.data[i], rnd[2 + (ptrdiff_t)(first.size + i)]);
+    }
+}
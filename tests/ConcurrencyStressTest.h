@@ -0,0 +1,209 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <Core.h>
+#include <Instance.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace
+{
+    using StressClock = std::chrono::steady_clock;
+
+    constexpr const char* stressDomain = "Stress";
+    constexpr size_t numberOfAudioThreads = 3;
+    constexpr size_t instancesPerAudioThread = 4;
+    constexpr size_t numberOfChurnThreads = 2;
+    constexpr int blockSize = 64;
+
+    // PATCH_STRESS_SECONDS overrides it, longer runs for the sanitizer builds
+    double getStressSeconds()
+    {
+        const char* seconds = std::getenv("PATCH_STRESS_SECONDS");
+        if(seconds == nullptr) return 2.0;
+        return juce::jmax(0.1, std::atof(seconds));
+    }
+
+    // PATCH_STRESS_MAX_STALL_MS fails the test above it, 0 only reports the
+    // stall. Sanitizers and loaded machines stall for tens of milliseconds, so
+    // it is only set where the timing can be trusted.
+    double getMaxStallMs()
+    {
+        const char* milliseconds = std::getenv("PATCH_STRESS_MAX_STALL_MS");
+        return milliseconds == nullptr ? 0.0 : std::atof(milliseconds);
+    }
+
+    patch::Mode randomMode(std::mt19937& random)
+    {
+        return (patch::Mode)std::uniform_int_distribution<int>(1, 3)(random);
+    }
+
+    std::unique_ptr<patch::Instance> makeStressInstance(patch::Mode mode)
+    {
+        auto instance = std::make_unique<patch::Instance>();
+        instance->setDomain(stressDomain);
+        instance->prepareToPlay(48000, blockSize);
+        instance->setMode(mode);
+        return instance;
+    }
+
+    // The longest a single processBlock took on this thread
+    class AudioThread
+    {
+    public:
+        void run(const std::atomic<bool>& running)
+        {
+            juce::AudioBuffer<float> buffer(2, blockSize);
+            while(running.load(std::memory_order_acquire))
+            {
+                for(auto& instance : instances)
+                {
+                    for(int ch = 0; ch < 2; ch++)
+                        for(int i = 0; i < blockSize; i++)
+                            buffer.setSample(ch, i, 0.25f);
+
+                    const auto start = StressClock::now();
+                    instance->processBlock(buffer);
+                    maxStall = std::max(maxStall, StressClock::now() - start);
+                    blocks++;
+
+                    for(int i = 0; i < blockSize; i++)
+                        isFinite = isFinite && std::isfinite(buffer.getSample(0, i));
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        std::vector<std::unique_ptr<patch::Instance>> instances;
+        StressClock::duration maxStall{};
+        uint64_t blocks = 0;
+        bool isFinite = true;
+    };
+}
+
+//==============================================================================
+
+TEST(ConcurrencyStressTest, ModeSwitchesDuringProcessing)
+{
+    // Audio threads process their instances without pause while the others
+    // come and go, switch modes, are connected and restored, as hosts and
+    // editors do it on their own threads.
+    const auto core = patch::Core::getDomain(stressDomain);
+    const auto duration = std::chrono::duration<double>(getStressSeconds());
+
+    std::vector<AudioThread> audioThreads(numberOfAudioThreads);
+    std::vector<patch::Instance*> instances;
+    std::vector<juce::Uuid> ids;
+    std::mt19937 setupRandom(1);
+    for(auto& audioThread : audioThreads)
+        for(size_t i = 0; i < instancesPerAudioThread; i++)
+        {
+            audioThread.instances.push_back(makeStressInstance(randomMode(setupRandom)));
+            instances.push_back(audioThread.instances.back().get());
+            ids.push_back(instances.back()->getId());
+        }
+
+    std::atomic<bool> running = true;
+    std::vector<std::thread> threads;
+    for(auto& audioThread : audioThreads)
+        threads.emplace_back([&audioThread, &running]() { audioThread.run(running); });
+
+    std::atomic<uint64_t> churned = 0;
+    for(size_t churn = 0; churn < numberOfChurnThreads; churn++)
+        threads.emplace_back([&running, &churned, churn]()
+        {
+            std::mt19937 random((unsigned)(100 + churn));
+            juce::AudioBuffer<float> buffer(2, blockSize);
+            while(running.load(std::memory_order_acquire))
+            {
+                auto instance = makeStressInstance(randomMode(random));
+                for(int block = 0; block < 4; block++)
+                {
+                    buffer.clear();
+                    instance->processBlock(buffer);
+                }
+                instance->setMode(randomMode(random));
+                instance.reset();
+                churned++;
+            }
+        });
+
+    // the message thread, with the editors polling what they show
+    uint64_t edits = 0;
+    std::thread control([&]()
+    {
+        std::mt19937 random(7);
+        std::uniform_int_distribution<size_t> pick(0, instances.size() - 1);
+        std::uniform_int_distribution<int> action(0, 5);
+        while(running.load(std::memory_order_acquire))
+        {
+            patch::Instance& instance = *instances[pick(random)];
+            switch(action(random))
+            {
+                case 0:
+                    instance.setMode(randomMode(random));
+                    break;
+                case 1:
+                case 2:
+                    core->applyConnectionEdits({{ ids[pick(random)], ids[pick(random)],
+                                                  random() % 2 == 0,
+                                                  std::uniform_real_distribution<float>(0.f, 2.f)(random) }});
+                    break;
+                case 3:
+                    instance.setState(instance.getState());
+                    break;
+                case 4:
+                    instance.setName(juce::String((int)(random() % 100)));
+                    break;
+                default:
+                    core->getInstanceStatistics();
+                    core->getConnectionParameters(ids[pick(random)], ids[pick(random)]);
+                    core->findInstanceById(ids[pick(random)]);
+                    core->getConnectionLatency(ids[pick(random)], ids[pick(random)]);
+                    core->isInFeedbackLoop(ids[pick(random)], ids[pick(random)]);
+                    core->getWorstLoopGain();
+                    break;
+            }
+            core->finishStateRestore();
+            edits++;
+            std::this_thread::yield();
+        }
+    });
+
+    std::this_thread::sleep_for(duration);
+    running.store(false, std::memory_order_release);
+    control.join();
+    for(auto& thread : threads)
+        thread.join();
+    core->finishStateRestore();
+
+    StressClock::duration maxStall{};
+    uint64_t blocks = 0;
+    for(const auto& audioThread : audioThreads)
+    {
+        maxStall = std::max(maxStall, audioThread.maxStall);
+        blocks += audioThread.blocks;
+        EXPECT_TRUE(audioThread.isFinite);
+    }
+    const double maxStallMs = std::chrono::duration<double, std::milli>(maxStall).count();
+    std::cout << "[ STRESS   ] " << blocks << " blocks, " << churned.load() << " instances churned, "
+              << edits << " edits, longest processBlock " << maxStallMs << " ms" << std::endl;
+    RecordProperty("blocks", std::to_string(blocks));
+    RecordProperty("maxStallMicroseconds", std::to_string((int64_t)(maxStallMs * 1000.0)));
+
+    // the audio threads kept going, no block took longer than a few block
+    // periods where that is checked
+    EXPECT_GT(blocks, 0u);
+    EXPECT_GT(churned.load(), 0u);
+    if(const double maxStallLimitMs = getMaxStallMs(); maxStallLimitMs > 0.0)
+    {
+        EXPECT_LT(maxStallMs, maxStallLimitMs);
+    }
+}
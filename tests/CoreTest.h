@@ -0,0 +1,693 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <Core.h>
+#include <Instance.h>
+#include <memory>
+#include <thread>
+
+namespace
+{
+    // Runs one block through a transmitter sending a constant and returns what
+    // the reciever puts out on the left channel.
+    float processConstant(patch::Instance& transmitter, patch::Instance& reciever, float value,
+                          juce::AudioBuffer<float>* output = nullptr, bool recieverFirst = false)
+    {
+        juce::AudioBuffer<float> transmitted(2, 64);
+        juce::AudioBuffer<float> recieved(2, 64);
+        for(int ch = 0; ch < 2; ch++)
+            for(int i = 0; i < 64; i++)
+                transmitted.setSample(ch, i, value);
+        recieved.clear();
+
+        if(recieverFirst)
+        {
+            reciever.processBlock(recieved);
+            transmitter.processBlock(transmitted);
+        }
+        else
+        {
+            transmitter.processBlock(transmitted);
+            reciever.processBlock(recieved);
+        }
+
+        if(output != nullptr)
+            output->makeCopyOf(recieved);
+        return recieved.getSample(0, 63);
+    }
+}
+
+//==============================================================================
+
+TEST(CoreTest, BulkLoad)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+
+    {
+        patch::ScopedBulkLoad bulkLoad(*core);
+        EXPECT_TRUE(core->isBulkLoading());
+
+        transmitter.setMode(patch::Mode::transmit);
+        reciever.setMode(patch::Mode::recieve);
+        core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 0.5f }});
+
+        // nothing is routed until the load is done
+        processConstant(transmitter, reciever, 1.f);
+        EXPECT_EQ(processConstant(transmitter, reciever, 1.f), 0.f);
+    }
+
+    EXPECT_FALSE(core->isBulkLoading());
+    processConstant(transmitter, reciever, 1.f);
+    EXPECT_FLOAT_EQ(processConstant(transmitter, reciever, 1.f), 0.5f);
+}
+
+TEST(CoreTest, PendingConnections)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    const size_t pendingBefore = core->getNumberOfPendingConnections();
+
+    const juce::Uuid transmitterId;
+    const juce::Uuid recieverId;
+
+    patch::ConnectionRecord record;
+    record.on = true;
+    record.gain = 0.25f;
+
+    patch::InstanceState transmitterState;
+    transmitterState.id = transmitterId;
+    transmitterState.mode = patch::Mode::transmit;
+    record.peer = recieverId;
+    transmitterState.connections.push_back(record);
+
+    patch::InstanceState recieverState;
+    recieverState.id = recieverId;
+    recieverState.mode = patch::Mode::recieve;
+
+    // the transmitter comes first, its peer is not there yet
+    patch::Instance transmitter;
+    transmitter.setState(transmitterState);
+    EXPECT_EQ(core->getNumberOfPendingConnections(), pendingBefore + 1);
+
+    patch::Instance reciever;
+    reciever.setState(recieverState);
+    core->finishStateRestore();
+    EXPECT_EQ(core->getNumberOfPendingConnections(), pendingBefore);
+    EXPECT_FALSE(core->isBulkLoading());
+
+    auto* params = core->getConnectionParameters(transmitterId, recieverId);
+    ASSERT_NE(params, nullptr);
+    EXPECT_TRUE(params->on.getValue());
+    EXPECT_FLOAT_EQ(params->gain.getValue(), 0.25f);
+}
+
+TEST(CoreTest, PendingConnectionsAreSaved)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    const size_t pendingBefore = core->getNumberOfPendingConnections();
+
+    patch::ConnectionRecord record;
+    record.peer = juce::Uuid();
+    record.on = true;
+    record.gain = 0.75f;
+
+    patch::InstanceState state;
+    state.mode = patch::Mode::transmit;
+    state.connections.push_back(record);
+
+    {
+        // the peer is missing from the session, the connection is saved again
+        patch::Instance transmitter;
+        transmitter.setState(state);
+        core->finishStateRestore();
+        EXPECT_EQ(core->getNumberOfPendingConnections(), pendingBefore + 1);
+
+        const patch::InstanceState saved = transmitter.getState();
+        ASSERT_EQ(saved.connections.size(), 1u);
+        EXPECT_EQ(saved.connections[0].peer, record.peer);
+        EXPECT_FLOAT_EQ(saved.connections[0].gain, 0.75f);
+    }
+
+    // and dropped with its owner
+    EXPECT_EQ(core->getNumberOfPendingConnections(), pendingBefore);
+}
+
+TEST(CoreTest, PresetChangeWhilePlaying)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever, other;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 0.5f }});
+    processConstant(transmitter, reciever, 1.f);
+    processConstant(transmitter, reciever, 1.f);
+    EXPECT_TRUE(core->isPlaying());
+
+    // another instance loads a preset, the others keep being routed
+    patch::InstanceState state = other.getState();
+    state.mode = patch::Mode::transmit;
+    other.setState(state);
+    EXPECT_FALSE(core->isBulkLoading());
+    EXPECT_FLOAT_EQ(processConstant(transmitter, reciever, 1.f), 0.5f);
+    core->finishStateRestore();
+}
+
+TEST(CoreTest, SparseConnections)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    const size_t connectionsBefore = core->getNumberOfConnections();
+
+    std::vector<std::unique_ptr<patch::Instance>> transmitters, recievers;
+    for(int i = 0; i < 16; i++)
+    {
+        transmitters.push_back(std::make_unique<patch::Instance>());
+        transmitters.back()->setMode(patch::Mode::transmit);
+        recievers.push_back(std::make_unique<patch::Instance>());
+        recievers.back()->setMode(patch::Mode::recieve);
+    }
+
+    // pairs that were never touched cost nothing
+    EXPECT_EQ(core->getNumberOfConnections(), connectionsBefore);
+    EXPECT_EQ(core->getConnectionParameters(transmitters[0]->getId(), recievers[0]->getId()), nullptr);
+
+    core->applyConnectionEdits({{ transmitters[0]->getId(), recievers[1]->getId(), true, 1.f },
+                                { transmitters[2]->getId(), recievers[1]->getId(), true, 1.f },
+                                { transmitters[2]->getId(), recievers[3]->getId(), {}, 0.5f }});
+    EXPECT_EQ(core->getNumberOfConnections(), connectionsBefore + 3);
+    EXPECT_NE(core->getConnectionParameters(transmitters[2]->getId(), recievers[3]->getId()), nullptr);
+
+    // only a transmitter and a reciever can be connected
+    EXPECT_EQ(core->getOrCreateConnectionParameters(recievers[0]->getId(), transmitters[0]->getId()), nullptr);
+
+    // leaving a mode takes the connections with it, the others stay valid
+    transmitters[2]->setMode(patch::Mode::bypass);
+    EXPECT_EQ(core->getNumberOfConnections(), connectionsBefore + 1);
+    auto* params = core->getConnectionParameters(transmitters[0]->getId(), recievers[1]->getId());
+    ASSERT_NE(params, nullptr);
+    EXPECT_TRUE(params->on.getValue());
+
+    transmitters.clear();
+    recievers.clear();
+    EXPECT_EQ(core->getNumberOfConnections(), connectionsBefore);
+}
+
+TEST(CoreTest, Bus)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance first, second, left, right;
+    for(auto* instance : { &first, &second, &left, &right })
+        instance->prepareToPlay(48000, 64);
+    first.setMode(patch::Mode::transmit);
+    second.setMode(patch::Mode::transmit);
+    left.setMode(patch::Mode::recieve);
+    right.setMode(patch::Mode::recieve);
+
+    const juce::Uuid bus = core->addBus("Group");
+    EXPECT_TRUE(core->isBus(bus));
+    EXPECT_EQ(core->addBus("Again", bus), bus);
+
+    const size_t connectionsBefore = core->getNumberOfConnections();
+    core->applyConnectionEdits({{ first.getId(), bus, true, 0.5f },
+                                { second.getId(), bus, true, 0.25f },
+                                { bus, left.getId(), true, 1.f },
+                                { bus, right.getId(), true, 0.5f },
+                                { bus, bus, true, 1.f }});
+    EXPECT_EQ(core->getNumberOfConnections(), connectionsBefore + 4);
+
+    juce::AudioBuffer<float> firstBlock(2, 64), secondBlock(2, 64), leftBlock(2, 64), rightBlock(2, 64);
+    for(int block = 0; block < 16; block++)
+    {
+        for(int ch = 0; ch < 2; ch++)
+        {
+            for(int i = 0; i < 64; i++)
+            {
+                firstBlock.setSample(ch, i, 1.f);
+                secondBlock.setSample(ch, i, 2.f);
+            }
+        }
+        leftBlock.clear();
+        rightBlock.clear();
+
+        first.processBlock(firstBlock);
+        second.processBlock(secondBlock);
+        left.processBlock(leftBlock);
+        right.processBlock(rightBlock);
+    }
+
+    // summed once, a block late like any other connection
+    EXPECT_FLOAT_EQ(leftBlock.getSample(0, 63), 1.f);
+    EXPECT_FLOAT_EQ(rightBlock.getSample(1, 0), 0.5f);
+    EXPECT_EQ(core->getConnectionLatency(first.getId(), bus), 0);
+    EXPECT_EQ(core->getConnectionLatency(bus, left.getId()), 1);
+
+    core->removeBus(bus);
+    EXPECT_FALSE(core->isBus(bus));
+    EXPECT_EQ(core->getNumberOfConnections(), connectionsBefore);
+}
+
+TEST(CoreTest, DoublePrecision)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 0.5f }});
+
+    // a double transmitter and a float reciever share the routing
+    juce::AudioBuffer<double> transmitted(2, 64);
+    juce::AudioBuffer<float> recieved(2, 64);
+    for(int block = 0; block < 3; block++)
+    {
+        for(int ch = 0; ch < 2; ch++)
+            for(int i = 0; i < 64; i++)
+                transmitted.setSample(ch, i, 0.5);
+        recieved.clear();
+
+        transmitter.processBlock(transmitted);
+        reciever.processBlock(recieved);
+    }
+    EXPECT_FLOAT_EQ(recieved.getSample(0, 63), 0.25f);
+
+    // and the other way around
+    transmitter.setMode(patch::Mode::recieve);
+    reciever.setMode(patch::Mode::transmit);
+    core->applyConnectionEdits({{ reciever.getId(), transmitter.getId(), true, 1.f }});
+    for(int block = 0; block < 3; block++)
+    {
+        for(int ch = 0; ch < 2; ch++)
+            for(int i = 0; i < 64; i++)
+                recieved.setSample(ch, i, 0.75f);
+        transmitted.clear();
+
+        reciever.processBlock(recieved);
+        transmitter.processBlock(transmitted);
+    }
+    EXPECT_DOUBLE_EQ(transmitted.getSample(1, 0), 0.75);
+}
+
+TEST(CoreTest, ConnectionLatency)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 0.5f }});
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), 1);
+
+    // the transmitter is processed first, so once that was seen for long
+    // enough its block arrives in the same block
+    for(int block = 0; block < 16; block++)
+        processConstant(transmitter, reciever, 1.f);
+    EXPECT_FLOAT_EQ(processConstant(transmitter, reciever, 2.f), 1.f);
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), 0);
+    EXPECT_FALSE(core->isInFeedbackLoop(transmitter.getId(), reciever.getId()));
+
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), false, {} }});
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), -1);
+}
+
+TEST(CoreTest, FeedbackLoopKeepsLatency)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 1.f }});
+
+    // reciever right before transmitter on one thread, as if both sat on the
+    // same track and the connection fed the track back into itself
+    for(int block = 0; block < 3; block++)
+        processConstant(transmitter, reciever, 1.f, nullptr, true);
+    // the message thread guesses the links of the host from that
+    core->finishStateRestore();
+
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), {}, 0.5f }});
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), 1);
+    EXPECT_TRUE(core->isInFeedbackLoop(transmitter.getId(), reciever.getId()));
+}
+
+TEST(CoreTest, LoopProtection)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 0.5f }});
+    core->setLoopProtection(true);
+
+    // the reciever feeds the transmitter through the host, see
+    // FeedbackLoopKeepsLatency
+    for(int block = 0; block < 3; block++)
+        processConstant(transmitter, reciever, 1.f, nullptr, true);
+    core->finishStateRestore();
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), {}, 4.f }});
+    auto* params = core->getConnectionParameters(transmitter.getId(), reciever.getId());
+    ASSERT_NE(params, nullptr);
+
+    // the host link counts with 1, so the loop grows by 2 with every link
+    EXPECT_NEAR(core->getLoopGain(transmitter.getId(), reciever.getId()), 2.0, 1.0e-6);
+    EXPECT_NEAR(core->getWorstLoopGain(), 2.0, 1.0e-6);
+    EXPECT_EQ(params->protection.getValue(), patch::OverdriveProtection::clip);
+
+    // what the connection delivers stays within full scale
+    float recieved = 0.f;
+    for(int block = 0; block < 4; block++)
+        recieved = processConstant(transmitter, reciever, 1.f, nullptr, true);
+    EXPECT_FLOAT_EQ(recieved, 1.f);
+
+    // a gain edited directly is picked up on the message thread
+    params->gain.setValue(0.25f);
+    processConstant(transmitter, reciever, 1.f, nullptr, true);
+    core->finishStateRestore();
+    EXPECT_NEAR(core->getWorstLoopGain(), 0.5, 1.0e-6);
+    EXPECT_EQ(params->protection.getValue(), patch::OverdriveProtection::off);
+
+    // protection set by hand is never taken back
+    params->protection.setValue(patch::OverdriveProtection::clip);
+    core->setLoopProtection(false);
+    EXPECT_EQ(params->protection.getValue(), patch::OverdriveProtection::clip);
+    params->protection.setValue(patch::OverdriveProtection::off);
+}
+
+TEST(CoreTest, OrderChangesWithoutSteps)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 1.f }});
+    const auto violationsBefore = core->getStatistics().orderViolations;
+
+    // settle, then switch to the same block, break the order once and
+    // switch back
+    std::vector<bool> recieverFirst(8, true);
+    recieverFirst.insert(recieverFirst.end(), 24, false);
+    recieverFirst.push_back(true);
+    recieverFirst.insert(recieverFirst.end(), 24, false);
+
+    juce::AudioBuffer<float> output(2, 64);
+    std::vector<float> samples;
+    for(bool first : recieverFirst)
+    {
+        processConstant(transmitter, reciever, 1.f, &output, first);
+        for(int i = 0; i < 64; i++)
+            samples.push_back(output.getSample(0, i));
+    }
+
+    EXPECT_EQ(core->getStatistics().orderViolations, violationsBefore + 1);
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), 0);
+
+    // a constant in gives a constant out, apart from short fades
+    const size_t settled = 4 * 64;
+    for(size_t i = settled + 1; i < samples.size(); i++)
+        EXPECT_NEAR(samples[i], samples[i - 1], 2.f / 64.f) << "at sample " << i;
+    EXPECT_FLOAT_EQ(samples.back(), 1.f);
+}
+
+TEST(CoreTest, RoutingQuantum)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 16);
+    reciever.prepareToPlay(48000, 16);
+    core->setRoutingQuantum(64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 1.f }});
+
+    // a ramp through blocks of 16 comes out as the same ramp one quantum
+    // later, routed once every four blocks
+    const uint64_t passesBefore = core->getStatistics().routingPasses;
+    const uint64_t routedBefore = core->getStatistics().samplesRouted;
+    juce::AudioBuffer<float> transmitted(2, 16);
+    juce::AudioBuffer<float> recieved(2, 16);
+    std::vector<float> output;
+    for(int block = 0; block < 16; block++)
+    {
+        for(int ch = 0; ch < 2; ch++)
+            for(int i = 0; i < 16; i++)
+                transmitted.setSample(ch, i, (float)(block * 16 + i + 1));
+        recieved.clear();
+
+        transmitter.processBlock(transmitted);
+        reciever.processBlock(recieved);
+        for(int i = 0; i < 16; i++)
+            output.push_back(recieved.getSample(0, i));
+    }
+
+    for(size_t i = 0; i < 64; i++)
+        EXPECT_EQ(output[i], 0.f);
+    for(size_t i = 64; i < output.size(); i++)
+        EXPECT_FLOAT_EQ(output[i], (float)(i - 64 + 1));
+
+    // the first block joins whatever epoch is running
+    EXPECT_GE(core->getStatistics().routingPasses - passesBefore, 15u);
+    EXPECT_LE(core->getStatistics().routingPasses - passesBefore, 16u);
+    EXPECT_EQ(core->getStatistics().samplesRouted - routedBefore, 3u * 2 * 64);
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), 1);
+
+    core->setRoutingQuantum(0);
+}
+
+TEST(CoreTest, ParallelPairs)
+{
+    // every pair on a thread of its own, as hosts with worker threads do it
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    constexpr size_t numberOfPairs = 4;
+    std::vector<std::unique_ptr<patch::Instance>> transmitters, recievers;
+    std::vector<patch::ConnectionEdit> edits;
+    for(size_t pair = 0; pair < numberOfPairs; pair++)
+    {
+        transmitters.push_back(std::make_unique<patch::Instance>());
+        recievers.push_back(std::make_unique<patch::Instance>());
+        transmitters.back()->prepareToPlay(48000, 64);
+        recievers.back()->prepareToPlay(48000, 64);
+        transmitters.back()->setMode(patch::Mode::transmit);
+        recievers.back()->setMode(patch::Mode::recieve);
+        edits.push_back({ transmitters.back()->getId(), recievers.back()->getId(), true, 0.5f });
+    }
+    core->applyConnectionEdits(edits);
+
+    // with the recievers first every connection is delayed, a pair mixes its
+    // own connection and does not wait for the routing pass to mix the others
+    for(int block = 0; block < 4; block++)
+        for(size_t pair = 0; pair < numberOfPairs; pair++)
+            processConstant(*transmitters[pair], *recievers[pair], 1.f, nullptr, true);
+    const uint64_t routedBefore = core->getStatistics().samplesRouted;
+    for(int block = 0; block < 8; block++)
+        processConstant(*transmitters[0], *recievers[0], 1.f, nullptr, true);
+    EXPECT_EQ(core->getStatistics().samplesRouted - routedBefore, 8u * 2 * 64);
+
+    std::vector<float> largest(numberOfPairs, 0.f);
+    std::vector<float> smallest(numberOfPairs, 1.f);
+    std::vector<std::thread> threads;
+    for(size_t pair = 0; pair < numberOfPairs; pair++)
+    {
+        threads.emplace_back([&, pair]()
+        {
+            juce::AudioBuffer<float> output(2, 64);
+            for(int block = 0; block < 500; block++)
+            {
+                processConstant(*transmitters[pair], *recievers[pair], 1.f, &output);
+                for(int i = 0; i < 64; i++)
+                {
+                    largest[pair] = std::max(largest[pair], output.getSample(0, i));
+                    smallest[pair] = std::min(smallest[pair], output.getSample(0, i));
+                }
+            }
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+
+    // blocks may go missing while the threads overtake each other, but
+    // nothing may arrive twice or from another pair
+    for(size_t pair = 0; pair < numberOfPairs; pair++)
+    {
+        EXPECT_FLOAT_EQ(largest[pair], 0.5f);
+        EXPECT_GE(smallest[pair], 0.f);
+    }
+}
+
+TEST(CoreTest, OfflineRender)
+{
+    // a bounce on two threads, the transmitter running ahead as it pleases
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 1.f }});
+    processConstant(transmitter, reciever, 0.f);
+
+    transmitter.setNonRealtime(true);
+    EXPECT_TRUE(core->isOffline());
+    reciever.setNonRealtime(true);
+    const auto before = core->getStatistics();
+
+    constexpr int numberOfBlocks = 2000;
+    std::vector<float> recieved(numberOfBlocks, -1.f);
+    bool isConstant = true;
+    std::thread transmitting([&]()
+    {
+        juce::AudioBuffer<float> block(2, 64);
+        for(int b = 0; b < numberOfBlocks; b++)
+        {
+            for(int ch = 0; ch < 2; ch++)
+                for(int i = 0; i < 64; i++)
+                    block.setSample(ch, i, (float)(b + 1));
+            transmitter.processBlock(block);
+        }
+    });
+    std::thread recieving([&]()
+    {
+        juce::AudioBuffer<float> block(2, 64);
+        for(int b = 0; b < numberOfBlocks; b++)
+        {
+            block.clear();
+            reciever.processBlock(block);
+            recieved[(size_t)b] = block.getSample(0, 0);
+            for(int i = 0; i < 64; i++)
+                isConstant = isConstant && block.getSample(1, i) == recieved[(size_t)b];
+        }
+    });
+    transmitting.join();
+    recieving.join();
+
+    // every block arrives once and exactly one block later
+    int mismatches = 0;
+    for(int b = 0; b < numberOfBlocks; b++)
+        mismatches += recieved[(size_t)b] == (float)b ? 0 : 1;
+    EXPECT_EQ(mismatches, 0);
+    EXPECT_TRUE(isConstant);
+    EXPECT_EQ(core->getStatistics().offlineTimeouts, before.offlineTimeouts);
+    EXPECT_EQ(core->getConnectionLatency(transmitter.getId(), reciever.getId()), 1);
+
+    transmitter.setNonRealtime(false);
+    EXPECT_TRUE(core->isOffline());
+    reciever.setNonRealtime(false);
+    EXPECT_FALSE(core->isOffline());
+}
+
+TEST(CoreTest, Domains)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever, other;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    other.prepareToPlay(48000, 64);
+
+    // an instance in another domain sees nothing of this one
+    other.setDomain("Session B");
+    auto session = other.getCore();
+    EXPECT_NE(session, core);
+    EXPECT_EQ(patch::Core::getDomain("Session B"), session);
+    EXPECT_EQ(other.getDomain(), juce::String("Session B"));
+    other.setMode(patch::Mode::transmit);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    EXPECT_FALSE(core->getTransmitters()->contains(other.getId()));
+    EXPECT_TRUE(session->getTransmitters()->contains(other.getId()));
+    EXPECT_EQ(core->getOrCreateConnectionParameters(other.getId(), reciever.getId()), nullptr);
+
+    // the reciever follows, with its mode and without its connections
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 0.5f }});
+    reciever.setDomain("Session B");
+    EXPECT_EQ(reciever.getMode(), patch::Mode::recieve);
+    EXPECT_TRUE(session->getRecievers()->contains(reciever.getId()));
+    EXPECT_FALSE(core->getRecievers()->contains(reciever.getId()));
+    EXPECT_EQ(core->getConnectionParameters(transmitter.getId(), reciever.getId()), nullptr);
+
+    session->applyConnectionEdits({{ other.getId(), reciever.getId(), true, 0.25f }});
+    processConstant(other, reciever, 1.f);
+    EXPECT_FLOAT_EQ(processConstant(other, reciever, 1.f), 0.25f);
+
+    // the domain is saved and restored with the instance
+    const patch::InstanceState state = reciever.getState();
+    ASSERT_TRUE(state.domain.has_value());
+    EXPECT_EQ(state.domain.value(), juce::String("Session B"));
+    reciever.setDomain(patch::Core::defaultDomain);
+    EXPECT_FALSE(reciever.getState().domain.has_value());
+    reciever.setState(state);
+    session->finishStateRestore();
+    EXPECT_EQ(reciever.getCore(), session);
+    EXPECT_NE(session->getConnectionParameters(other.getId(), reciever.getId()), nullptr);
+
+    // gone with the last one holding on to it
+    const std::weak_ptr<patch::Core> weakSession = session;
+    other.setDomain(patch::Core::defaultDomain);
+    reciever.setDomain(patch::Core::defaultDomain);
+    EXPECT_FALSE(weakSession.expired());
+    session.reset();
+    EXPECT_TRUE(weakSession.expired());
+    const auto names = patch::Core::getDomainNames();
+    EXPECT_EQ(std::count(names.begin(), names.end(), juce::String("Session B")), 0);
+}
+
+TEST(CoreTest, DomainsFromManyThreads)
+{
+    // every thread gets the same Core, created once
+    constexpr size_t numberOfThreads = 8;
+    std::vector<std::shared_ptr<patch::Core>> cores(numberOfThreads);
+    std::vector<std::thread> threads;
+    for(size_t thread = 0; thread < numberOfThreads; thread++)
+        threads.emplace_back([&cores, thread]()
+        {
+            for(int i = 0; i < 1000; i++)
+                cores[thread] = patch::Core::getDomain("Threads");
+        });
+    for(auto& thread : threads)
+        thread.join();
+
+    for(const auto& core : cores)
+        EXPECT_EQ(core, cores.front());
+}
+
+TEST(CoreTest, ConnectionCost)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, 1.f }});
+    core->resetStatistics();
+
+    for(int block = 0; block < 4; block++)
+        processConstant(transmitter, reciever, 1.f);
+
+    const auto statistics = core->getConnectionStatistics();
+    const auto connection = std::find_if(statistics.begin(), statistics.end(),
+        [&](const patch::ConnectionStatistics& candidate)
+        {
+            return candidate.transmitter == transmitter.getId()
+                   && candidate.reciever == reciever.getId();
+        });
+    ASSERT_NE(connection, statistics.end());
+    EXPECT_EQ(connection->blocks, 4u);
+    EXPECT_EQ(connection->samples, 4u * 64);
+    EXPECT_GE(connection->getMeanSeconds(), 0.0);
+    EXPECT_EQ(core->getNameOf(reciever.getId()), reciever.getName());
+
+    // the cost starts over with the statistics
+    core->resetStatistics();
+    for(const auto& candidate : core->getConnectionStatistics())
+        EXPECT_FALSE(candidate.transmitter == transmitter.getId()
+                     && candidate.reciever == reciever.getId());
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <DriftCompensator.h>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    struct DriftRun
+    {
+        double finalRatio = 1.0;
+        size_t maxDeviation = 0;
+        size_t underruns = 0;
+        bool isContinuous = true;
+    };
+
+    // A writer at rate times the speed of the reader, both in blocks of 64,
+    // with a ring in between. The reader finds it two blocks ahead.
+    DriftRun runDrift(double rate, size_t numberOfBlocks)
+    {
+        constexpr size_t blockSize = 64;
+        constexpr size_t target = 2 * blockSize;
+        constexpr size_t ringSize = 8192;
+        std::vector<patch::RoutingSample> ring(ringSize);
+
+        patch::DriftCompensator<1> compensator;
+        compensator.prepare(blockSize);
+
+        DriftRun run;
+        uint64_t written = 0, read = 0;
+        double writtenExactly = (double)(target - blockSize);
+        const auto write = [&]()
+        {
+            for(; written < (uint64_t)writtenExactly; written++)
+                ring[written % ringSize] = 1;
+        };
+        write();
+
+        std::vector<patch::RoutingSample> output(blockSize);
+        for(size_t block = 0; block < numberOfBlocks; block++)
+        {
+            writtenExactly += (double)blockSize * rate;
+            write();
+
+            const size_t fill = (size_t)(written - read);
+            if(block > numberOfBlocks / 2)
+                run.maxDeviation = std::max(run.maxDeviation,
+                                            fill > target ? fill - target : target - fill);
+
+            const size_t required = compensator.beginBlock(fill, target, blockSize);
+            const size_t available = std::min(required, fill);
+            if(available < required)
+                run.underruns++;
+
+            patch::RoutingSample* input = compensator.getInput(0);
+            for(size_t i = 0; i < available; i++)
+                input[i] = ring[(read + i) % ringSize];
+            read += available;
+            compensator.addedInput(available, required);
+
+            std::fill(output.begin(), output.end(), (patch::RoutingSample)0);
+            patch::LevelAccumulator sourceLevel, destinationLevel;
+            compensator.mixInto<false>({ output.data() }, 1.f, sourceLevel, destinationLevel);
+
+            // a constant goes through unchanged, after the first sample
+            for(size_t i = block == 0 ? 1 : 0; i < blockSize; i++)
+                run.isContinuous = run.isContinuous && std::abs(output[i] - 1) < 1.0e-6;
+        }
+
+        run.finalRatio = compensator.getRatio();
+        return run;
+    }
+}
+
+//==============================================================================
+TEST(DriftCompensatorTest, SameClock)
+{
+    // only the two samples the spline looks ahead are off
+    const DriftRun run = runDrift(1.0, 20000);
+    EXPECT_EQ(run.underruns, 0u);
+    EXPECT_LE(run.maxDeviation, 2u);
+    EXPECT_NEAR(run.finalRatio, 1.0, 1.0e-6);
+    EXPECT_TRUE(run.isContinuous);
+}
+
+TEST(DriftCompensatorTest, FollowsDriftingClocks)
+{
+    for(const double rate : { 1.0005, 0.9995 })
+    {
+        const DriftRun run = runDrift(rate, 200000);
+        EXPECT_EQ(run.underruns, 0u);
+        EXPECT_LT(run.maxDeviation, 64u);
+        EXPECT_NEAR(run.finalRatio, rate, 5.0e-5);
+        EXPECT_TRUE(run.isContinuous);
+    }
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+/*  Renders fixed routing scenarios through Core and compares what the
+    recievers put out with golden outputs in tests/golden, bit for bit. Any
+    change to the kernels or to the order sources are summed in shows up here.
+    The golden files are raw little endian float32, the recievers one after
+    the other, each of them channel by channel. After a change that is meant
+    to change the output, run the tests with PATCH_UPDATE_GOLDEN=1 to render
+    them again. Builds that route in double compare against the same files
+    within the rounding of float, see goldenTolerance.
+*/
+
+#include <gtest/gtest.h>
+#include <Core.h>
+#include <Instance.h>
+#include <InstanceState.h>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+    constexpr const char* goldenDomain = "Golden";
+    constexpr int goldenBlockSizes[] = { 32, 64, 100 };
+    constexpr int goldenNumberOfBlocks = 16;
+
+    // the order sources are summed in depends on the ids, so they are fixed
+    juce::Uuid goldenId(juce::uint8 number)
+    {
+        juce::uint8 raw[16] = { 0x60 };
+        raw[15] = number;
+        return juce::Uuid(raw);
+    }
+
+    // Exactly representable and different for every transmitter, channel
+    // and sample, without any library function that could round differently.
+    float goldenSignal(int transmitter, int channel, int sample)
+    {
+        const int value = (sample * 7919 + transmitter * 104729 + channel * 31) % 2001;
+        return (float)(value - 1000) / 1024.f;
+    }
+
+    struct GoldenScenario
+    {
+        std::vector<std::unique_ptr<patch::Instance>> transmitters;
+        std::vector<std::unique_ptr<patch::Instance>> recievers;
+        std::shared_ptr<patch::Core> core;
+        bool recieversFirst = false;
+
+        GoldenScenario(int numberOfTransmitters, int numberOfRecievers, int blockSize)
+        {
+            juce::uint8 number = 1;
+            for(int i = 0; i < numberOfTransmitters + numberOfRecievers; i++)
+            {
+                const bool isTransmitter = i < numberOfTransmitters;
+                auto instance = std::make_unique<patch::Instance>();
+
+                patch::InstanceState state;
+                state.id = goldenId(number++);
+                state.mode = isTransmitter ? patch::Mode::transmit : patch::Mode::recieve;
+                state.domain = juce::String(goldenDomain);
+                instance->setState(state);
+                (isTransmitter ? transmitters : recievers).push_back(std::move(instance));
+            }
+
+            core = patch::Core::getDomain(goldenDomain);
+            core->finishStateRestore();
+            for(auto* instances : { &transmitters, &recievers })
+                for(auto& instance : *instances)
+                    instance->prepareToPlay(48000, blockSize);
+        }
+
+        void connect(patch::Instance& transmitter, patch::Instance& reciever, float gain)
+        {
+            core->applyConnectionEdits({{ transmitter.getId(), reciever.getId(), true, gain }});
+        }
+
+        // every reciever, channel after channel
+        std::vector<float> render(int blockSize)
+        {
+            std::vector<std::vector<float>> recieved(recievers.size() * 2);
+            juce::AudioBuffer<float> block(2, blockSize);
+
+            const auto processTransmitters = [&](int firstSample)
+            {
+                for(size_t t = 0; t < transmitters.size(); t++)
+                {
+                    for(int ch = 0; ch < 2; ch++)
+                        for(int i = 0; i < blockSize; i++)
+                            block.setSample(ch, i, goldenSignal((int)t, ch, firstSample + i));
+                    transmitters[t]->processBlock(block);
+                }
+            };
+            const auto processRecievers = [&]()
+            {
+                for(size_t r = 0; r < recievers.size(); r++)
+                {
+                    block.clear();
+                    recievers[r]->processBlock(block);
+                    for(int ch = 0; ch < 2; ch++)
+                        for(int i = 0; i < blockSize; i++)
+                            recieved[r * 2 + (size_t)ch].push_back(block.getSample(ch, i));
+                }
+            };
+
+            for(int b = 0; b < goldenNumberOfBlocks; b++)
+            {
+                if(recieversFirst)
+                    processRecievers();
+                processTransmitters(b * blockSize);
+                if(!recieversFirst)
+                    processRecievers();
+            }
+
+            std::vector<float> output;
+            for(const auto& channel : recieved)
+                output.insert(output.end(), channel.begin(), channel.end());
+            return output;
+        }
+    };
+
+    // float routing is the golden precision and has to match bit for bit,
+    // double routing rounds once where float rounds after every step
+    constexpr float goldenTolerance = std::is_same_v<patch::RoutingSample, float> ? 0.f : 1e-5f;
+
+    void expectGolden(const juce::String& name, const std::vector<float>& rendered)
+    {
+        const auto file = juce::File(PROJECT_ROOT_DIR).getChildFile("tests")
+                                                      .getChildFile("golden")
+                                                      .getChildFile(name + ".raw");
+        const size_t size = rendered.size() * sizeof(float);
+
+        if(juce::SystemStats::getEnvironmentVariable("PATCH_UPDATE_GOLDEN", {}).isNotEmpty())
+        {
+            if(goldenTolerance > 0.f) GTEST_SKIP() << "golden outputs are rendered with float routing";
+            EXPECT_TRUE(file.replaceWithData(rendered.data(), size));
+            return;
+        }
+
+        juce::MemoryBlock golden;
+        ASSERT_TRUE(file.loadFileAsData(golden))
+            << "no golden output " << name.toStdString() << ", render it with PATCH_UPDATE_GOLDEN=1";
+        ASSERT_EQ(golden.getSize(), size) << name.toStdString();
+
+        std::vector<float> expected(rendered.size());
+        std::memcpy(expected.data(), golden.getData(), size);
+        for(size_t i = 0; i < rendered.size(); i++)
+        {
+            if(std::memcmp(&expected[i], &rendered[i], sizeof(float)) == 0) continue;
+            if(std::abs(expected[i] - rendered[i]) <= goldenTolerance) continue;
+
+            ADD_FAILURE() << name.toStdString() << " differs first at sample " << i << ": " << rendered[i]
+                          << " instead of " << expected[i];
+            return;
+        }
+    }
+}
+
+//==============================================================================
+
+TEST(GoldenRoutingTest, Sum)
+{
+    // The transmitters come first on the same thread, so the connections
+    // cross over to the same block after a few blocks. They are made in
+    // different orders, the sum is the same bits.
+    for(bool reversed : { false, true })
+    {
+        for(int blockSize : goldenBlockSizes)
+        {
+            GoldenScenario scenario(3, 1, blockSize);
+            const float gains[] = { 0.3f, 0.7f, 0.45f };
+            for(int i = 0; i < 3; i++)
+            {
+                const int t = reversed ? 2 - i : i;
+                scenario.connect(*scenario.transmitters[(size_t)t], *scenario.recievers[0], gains[t]);
+            }
+
+            expectGolden("sum-" + juce::String(blockSize), scenario.render(blockSize));
+        }
+    }
+}
+
+TEST(GoldenRoutingTest, Delayed)
+{
+    // the reciever comes first, every block takes the delay buffers
+    for(int blockSize : goldenBlockSizes)
+    {
+        GoldenScenario scenario(2, 1, blockSize);
+        scenario.recieversFirst = true;
+        scenario.connect(*scenario.transmitters[0], *scenario.recievers[0], 0.9f);
+        scenario.connect(*scenario.transmitters[1], *scenario.recievers[0], 0.15f);
+
+        expectGolden("delayed-" + juce::String(blockSize), scenario.render(blockSize));
+    }
+}
+
+TEST(GoldenRoutingTest, Bus)
+{
+    for(int blockSize : goldenBlockSizes)
+    {
+        GoldenScenario scenario(2, 2, blockSize);
+        const juce::Uuid bus = scenario.core->addBus("Bus", goldenId(0x40));
+        auto& core = *scenario.core;
+        core.applyConnectionEdits({{ scenario.transmitters[0]->getId(), bus, true, 0.6f },
+                                   { scenario.transmitters[1]->getId(), bus, true, 0.35f },
+                                   { bus, scenario.recievers[0]->getId(), true, 0.8f },
+                                   { bus, scenario.recievers[1]->getId(), true, 0.25f },
+                                   { scenario.transmitters[0]->getId(),
+                                     scenario.recievers[1]->getId(), true, 0.5f }});
+
+        expectGolden("bus-" + juce::String(blockSize), scenario.render(blockSize));
+    }
+}
+
+TEST(GoldenRoutingTest, Quantum)
+{
+    for(int blockSize : goldenBlockSizes)
+    {
+        GoldenScenario scenario(3, 1, blockSize);
+        scenario.core->setRoutingQuantum(128);
+        scenario.connect(*scenario.transmitters[0], *scenario.recievers[0], 0.3f);
+        scenario.connect(*scenario.transmitters[1], *scenario.recievers[0], 0.7f);
+        scenario.connect(*scenario.transmitters[2], *scenario.recievers[0], 0.45f);
+
+        expectGolden("quantum-" + juce::String(blockSize), scenario.render(blockSize));
+    }
+}
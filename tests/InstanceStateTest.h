@@ -0,0 +1,150 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <InstanceState.h>
+
+namespace
+{
+    patch::InstanceState makeState(size_t numberOfConnections)
+    {
+        patch::InstanceState state;
+        state.mode = patch::Mode::transmit;
+        state.name = juce::String("Drums");
+
+        for(size_t i = 0; i < numberOfConnections; i++)
+        {
+            patch::ConnectionRecord record;
+            record.on = i % 2 == 0;
+            record.gain = (float)i / 10.f;
+            record.delay = (int)i;
+            record.delayCorrection = i % 3 == 0;
+            record.protection = i % 2 == 0
+                ? patch::OverdriveProtection::clip
+                : patch::OverdriveProtection::off;
+            state.connections.push_back(record);
+        }
+
+        return state;
+    }
+
+    void expectEqual(const patch::InstanceState& a, const patch::InstanceState& b)
+    {
+        EXPECT_EQ(a.id, b.id);
+        EXPECT_EQ(a.mode, b.mode);
+        EXPECT_EQ(a.name.has_value(), b.name.has_value());
+        if(a.name.has_value() && b.name.has_value())
+        {
+            EXPECT_EQ(a.name.value(), b.name.value());
+        }
+        EXPECT_EQ(a.domain.value_or(juce::String()), b.domain.value_or(juce::String()));
+        EXPECT_EQ(a.sharedRouting, b.sharedRouting);
+
+        ASSERT_EQ(a.buses.size(), b.buses.size());
+        for(size_t i = 0; i < a.buses.size(); i++)
+        {
+            EXPECT_EQ(a.buses[i].id, b.buses[i].id);
+            EXPECT_EQ(a.buses[i].name, b.buses[i].name);
+        }
+
+        ASSERT_EQ(a.connections.size(), b.connections.size());
+        for(size_t i = 0; i < a.connections.size(); i++)
+        {
+            EXPECT_EQ(a.connections[i].peer, b.connections[i].peer);
+            EXPECT_EQ(a.connections[i].on, b.connections[i].on);
+            EXPECT_EQ(a.connections[i].gain, b.connections[i].gain);
+            EXPECT_EQ(a.connections[i].delay, b.connections[i].delay);
+            EXPECT_EQ(a.connections[i].delayCorrection, b.connections[i].delayCorrection);
+            EXPECT_EQ(a.connections[i].protection, b.connections[i].protection);
+        }
+    }
+}
+
+//==============================================================================
+
+TEST(InstanceStateTest, BinaryRoundTrip)
+{
+    for(size_t size : {0u, 1u, 200u})
+    {
+        const auto state = makeState(size);
+
+        juce::MemoryBlock block;
+        state.writeBinary(block);
+        EXPECT_EQ(block.getSize(), 32u + 4u + 5u + size * 28u);
+
+        const auto read = patch::InstanceState::read(block.getData(), block.getSize());
+        ASSERT_TRUE(read.has_value());
+        expectEqual(state, read.value());
+    }
+}
+
+TEST(InstanceStateTest, Buses)
+{
+    auto state = makeState(2);
+    state.buses.push_back({ juce::Uuid(), "Drums" });
+    state.buses.push_back({ juce::Uuid(), juce::String() });
+    state.connections[0].peer = state.buses[0].id;
+
+    juce::MemoryBlock block;
+    state.writeBinary(block);
+    EXPECT_EQ(block.getSize(), 32u + 4u + 5u + 2u * 28u + 4u + 2u * 20u + 5u);
+
+    const auto read = patch::InstanceState::read(block.getData(), block.getSize());
+    ASSERT_TRUE(read.has_value());
+    expectEqual(state, read.value());
+
+    // the bus count would not fit
+    EXPECT_FALSE(patch::InstanceState::read(block.getData(), block.getSize() - 30).has_value());
+}
+
+TEST(InstanceStateTest, Domain)
+{
+    auto state = makeState(1);
+    state.domain = juce::String("Session B");
+    // a flag, it takes no room
+    state.sharedRouting = true;
+
+    juce::MemoryBlock block;
+    state.writeBinary(block);
+    EXPECT_EQ(block.getSize(), 32u + 4u + 5u + 28u + 4u + 9u);
+
+    const auto read = patch::InstanceState::read(block.getData(), block.getSize());
+    ASSERT_TRUE(read.has_value());
+    expectEqual(state, read.value());
+
+    // cut into the domain
+    EXPECT_FALSE(patch::InstanceState::read(block.getData(), block.getSize() - 1).has_value());
+}
+
+TEST(InstanceStateTest, ReadsValueTree)
+{
+    auto state = makeState(5);
+    state.buses.push_back({ juce::Uuid(), "Drums" });
+    state.domain = juce::String("Session B");
+    state.sharedRouting = true;
+
+    juce::MemoryOutputStream output;
+    state.toValueTree().writeToStream(output);
+
+    const auto read = patch::InstanceState::read(output.getData(), output.getDataSize());
+    ASSERT_TRUE(read.has_value());
+    expectEqual(state, read.value());
+}
+
+TEST(InstanceStateTest, RejectsBrokenData)
+{
+    auto state = makeState(3);
+    state.name.reset();
+
+    juce::MemoryBlock block;
+    state.writeBinary(block);
+
+    // cut into the last record
+    EXPECT_FALSE(patch::InstanceState::read(block.getData(), block.getSize() - 1).has_value());
+
+    // newer version
+    block[4] = (char)0xff;
+    EXPECT_FALSE(patch::InstanceState::read(block.getData(), block.getSize()).has_value());
+
+    EXPECT_FALSE(patch::InstanceState::read("garbage", 7).has_value());
+    EXPECT_FALSE(patch::InstanceState::read(nullptr, 0).has_value());
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <gtest/gtest.h>
+#include <MixKernels.h>
+
+namespace
+{
+    std::vector<float> randVector(size_t size)
+    {
+        std::vector<float> vector(size);
+        for(auto& sample : vector)
+        {
+            sample = (float)std::rand() / (float)RAND_MAX * 2.f - 1.f;
+        }
+        return vector;
+    }
+}
+
+//==============================================================================
+
+TEST(MixKernelsTest, MixMatchesReference)
+{
+    for(size_t size : {0u, 1u, 3u, 4u, 7u, 64u, 129u})
+    {
+        auto source = randVector(size);
+        auto destination = randVector(size);
+        auto expected = destination;
+        const float gain = 0.37f;
+
+        for(size_t i = 0; i < size; i++)
+        {
+            expected[i] += source[i] * gain;
+        }
+
+        patch::LevelAccumulator sourceLevel, destinationLevel;
+        patch::kernels::mixAndMeasure<false>(destination.data(), source.data(), gain, size,
+                                             sourceLevel, destinationLevel);
+
+        for(size_t i = 0; i < size; i++)
+        {
+            EXPECT_FLOAT_EQ(destination[i], expected[i]);
+        }
+        EXPECT_EQ(sourceLevel.numberOfSamples, size);
+        EXPECT_EQ(destinationLevel.numberOfSamples, 0u);
+    }
+}
+
+TEST(MixKernelsTest, MixDouble)
+{
+    for(size_t size : {0u, 1u, 2u, 5u, 64u})
+    {
+        const auto random = randVector(size);
+        std::vector<double> source(random.begin(), random.end());
+        std::vector<double> destination(size, 0.125);
+        auto expected = destination;
+        const double gain = 0.37;
+
+        for(size_t i = 0; i < size; i++)
+        {
+            expected[i] += source[i] * gain;
+        }
+
+        patch::LevelAccumulator sourceLevel, destinationLevel;
+        patch::kernels::mixAndMeasure<true>(destination.data(), source.data(), gain, size,
+                                            sourceLevel, destinationLevel);
+
+        // no float in between
+        for(size_t i = 0; i < size; i++)
+        {
+            EXPECT_DOUBLE_EQ(destination[i], expected[i]);
+        }
+        EXPECT_EQ(destinationLevel.numberOfSamples, size);
+    }
+}
+
+TEST(MixKernelsTest, ChannelsMatchSingleChannel)
+{
+    constexpr size_t numberOfChannels = 6;
+    const size_t size = 67;
+    const float gain = 0.8f;
+
+    for(const float increment : { 0.f, -0.01f })
+    {
+        std::vector<std::vector<float>> sources, destinations;
+        for(size_t ch = 0; ch < numberOfChannels; ch++)
+        {
+            sources.push_back(randVector(size));
+            destinations.push_back(randVector(size));
+        }
+        auto expected = destinations;
+
+        // one channel after the other
+        patch::LevelAccumulator expectedSource, expectedDestination;
+        for(size_t ch = 0; ch < numberOfChannels; ch++)
+            patch::kernels::mixAndMeasureRamp<true>(expected[ch].data(), sources[ch].data(), 1, gain,
+                                                    increment, size, expectedSource,
+                                                    expectedDestination);
+
+        std::array<float*, numberOfChannels> destinationPointers;
+        std::array<const float*, numberOfChannels> sourcePointers;
+        for(size_t ch = 0; ch < numberOfChannels; ch++)
+        {
+            destinationPointers[ch] = destinations[ch].data();
+            sourcePointers[ch] = sources[ch].data();
+        }
+
+        patch::LevelAccumulator sourceLevel, destinationLevel;
+        if(increment == 0.f)
+            patch::kernels::mixChannelsAndMeasure<numberOfChannels, true>(
+                destinationPointers, sourcePointers, gain, size, sourceLevel, destinationLevel);
+        else
+            patch::kernels::mixChannelsAndMeasureRamp<numberOfChannels, true>(
+                destinationPointers, sourcePointers, 1, gain, increment, size, sourceLevel,
+                destinationLevel);
+
+        for(size_t ch = 0; ch < numberOfChannels; ch++)
+            for(size_t i = 0; i < size; i++)
+                EXPECT_FLOAT_EQ(destinations[ch][i], expected[ch][i]);
+
+        EXPECT_EQ(sourceLevel.numberOfSamples, numberOfChannels * size);
+        EXPECT_FLOAT_EQ(sourceLevel.peak, expectedSource.peak);
+        EXPECT_FLOAT_EQ(destinationLevel.peak, expectedDestination.peak);
+        EXPECT_NEAR(destinationLevel.getRms(), expectedDestination.getRms(), 1.0e-5f);
+    }
+}
+
+TEST(MixKernelsTest, Levels)
+{
+    const size_t size = 37;
+    auto source = randVector(size);
+    std::vector<float> destination(size, 0.25f);
+    const float gain = 0.5f;
+
+    float sourcePeak = 0.f, sourceSum = 0.f, destinationPeak = 0.f, destinationSum = 0.f;
+    for(size_t i = 0; i < size; i++)
+    {
+        const float scaled = source[i] * gain;
+        const float mixed = destination[i] + scaled;
+        sourcePeak = std::max(sourcePeak, std::abs(scaled));
+        sourceSum += scaled * scaled;
+        destinationPeak = std::max(destinationPeak, std::abs(mixed));
+        destinationSum += mixed * mixed;
+    }
+
+    patch::LevelAccumulator sourceLevel, destinationLevel;
+    patch::kernels::mixAndMeasure<true>(destination.data(), source.data(), gain, size,
+                                        sourceLevel, destinationLevel);
+
+    EXPECT_FLOAT_EQ(sourceLevel.peak, sourcePeak);
+    EXPECT_NEAR(sourceLevel.getRms(), std::sqrt(sourceSum / (float)size), 1.0e-5f);
+    EXPECT_FLOAT_EQ(destinationLevel.peak, destinationPeak);
+    EXPECT_NEAR(destinationLevel.getRms(), std::sqrt(destinationSum / (float)size), 1.0e-5f);
+}
+
+TEST(MixKernelsTest, Clip)
+{
+    // vector and plain loop alike, the scaled source never exceeds full scale
+    for(size_t size : {3u, 8u, 37u})
+    {
+        auto left = randVector(size);
+        auto right = randVector(size);
+        std::vector<float> destinationLeft(size, 0.25f), destinationRight(size, 0.25f);
+        const float gain = 4.f;
+
+        patch::LevelAccumulator sourceLevel, destinationLevel;
+        patch::kernels::mixChannelsAndMeasure<2, true, float, true>(
+            { destinationLeft.data(), destinationRight.data() }, { left.data(), right.data() },
+            gain, size, sourceLevel, destinationLevel);
+
+        for(size_t i = 0; i < size; i++)
+        {
+            EXPECT_FLOAT_EQ(destinationLeft[i], 0.25f + std::clamp(left[i] * gain, -1.f, 1.f));
+            EXPECT_FLOAT_EQ(destinationRight[i], 0.25f + std::clamp(right[i] * gain, -1.f, 1.f));
+        }
+        EXPECT_LE(sourceLevel.peak, 1.f);
+    }
+}
+
+TEST(MixKernelsTest, Meter)
+{
+    patch::LevelAccumulator level;
+    level.peak = 0.5f;
+    level.sumOfSquares = 4.f;
+    level.numberOfSamples = 16;
+
+    patch::LevelMeter meter;
+    meter.publish(level);
+    EXPECT_FLOAT_EQ(meter.peak.load(), 0.5f);
+    EXPECT_FLOAT_EQ(meter.rms.load(), 0.5f);
+
+    meter.clear();
+    EXPECT_FLOAT_EQ(meter.peak.load(), 0.f);
+}
+
+TEST(MixKernelsTest, ResampleUnitStepCopies)
+{
+    constexpr size_t size = 37;
+    std::vector<float> source(size + 3), left(size, 0.5f), right(size, 0.f);
+    for(size_t i = 0; i < source.size(); i++)
+        source[i] = std::sin(0.3f * (float)i);
+
+    patch::LevelAccumulator sourceLevel, destinationLevel;
+    patch::kernels::resampleChannelsAndMix<2, true, float>({ left.data(), right.data() },
+                                                          { source.data(), source.data() }, 1.0,
+                                                          1.0, 2.f, size, sourceLevel,
+                                                          destinationLevel);
+
+    for(size_t i = 0; i < size; i++)
+    {
+        EXPECT_EQ(left[i], 0.5f + source[i + 1] * 2.f);
+        EXPECT_EQ(right[i], source[i + 1] * 2.f);
+    }
+    EXPECT_EQ(sourceLevel.numberOfSamples, 2 * size);
+}
+
+TEST(MixKernelsTest, ResampleFollowsLines)
+{
+    // the spline goes through straight lines exactly
+    constexpr size_t size = 29;
+    std::vector<double> source(64);
+    for(size_t i = 0; i < source.size(); i++)
+        source[i] = 3.0 * (double)i - 7.0;
+
+    for(const double step : { 0.998, 1.0013, 1.5 })
+    {
+        std::vector<double> destination(size, 0.0);
+        patch::LevelAccumulator sourceLevel, destinationLevel;
+        patch::kernels::resampleChannelsAndMix<1, false, double>({ destination.data() },
+                                                                { source.data() }, 1.25, step, 1.0,
+                                                                size, sourceLevel, destinationLevel);
+
+        for(size_t i = 0; i < size; i++)
+            EXPECT_NEAR(destination[i], 3.0 * (1.25 + (double)i * step) - 7.0, 1.0e-9);
+    }
+}
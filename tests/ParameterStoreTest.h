@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <gtest/gtest.h>
+#include <ParameterStore.h>
+
+//==============================================================================
+
+TEST(ParameterStoreTest, PointersStayValid)
+{
+    patch::ParameterStore store;
+    std::vector<patch::ConnectionParameters*> parameters;
+
+    for(size_t i = 0; i < 3 * patch::ParameterStore::chunkSize + 1; i++)
+    {
+        parameters.push_back(store.allocate());
+        parameters.back()->gain.setValue((float)i);
+    }
+
+    EXPECT_EQ(store.getNumberOfAllocated(), parameters.size());
+    EXPECT_EQ(store.getCapacity(), 4 * patch::ParameterStore::chunkSize);
+
+    for(size_t i = 0; i < parameters.size(); i++)
+    {
+        EXPECT_EQ(parameters[i]->gain.getValue(), (float)i);
+    }
+}
+
+TEST(ParameterStoreTest, ReleaseResets)
+{
+    patch::ParameterStore store;
+
+    auto* parameters = store.allocate();
+    parameters->on.setValue(true);
+    parameters->gain.setValue(0.5f);
+    parameters->protection.setValue(patch::OverdriveProtection::clip);
+    store.release(parameters);
+    EXPECT_EQ(store.getNumberOfAllocated(), 0u);
+
+    auto* reused = store.allocate();
+    EXPECT_EQ(reused, parameters);
+    EXPECT_FALSE(reused->on.getValue());
+    EXPECT_EQ(reused->gain.getValue(), 0.f);
+    EXPECT_EQ(reused->protection.getValue(), patch::OverdriveProtection::off);
+}
+
+TEST(ParameterStoreTest, HandlesSeeRelease)
+{
+    patch::ParameterStore store;
+
+    auto* parameters = store.allocate();
+    const patch::ConnectionHandle handle(parameters);
+    EXPECT_EQ(handle.get(), parameters);
+    EXPECT_EQ(patch::ConnectionHandle().get(), nullptr);
+    EXPECT_FALSE(patch::ConnectionHandle().isReleased());
+
+    // the slot goes to the next connection, the old handle does not follow
+    store.release(parameters);
+    auto* reused = store.allocate();
+    EXPECT_EQ(reused, parameters);
+    EXPECT_TRUE(handle.isReleased());
+    EXPECT_EQ(handle.get(), nullptr);
+    EXPECT_EQ(patch::ConnectionHandle(reused).get(), reused);
+}
+
+TEST(ParameterStoreTest, Sequence)
+{
+    patch::AtomicParameter<float> gain = 0.f;
+
+    const uint64_t before = patch::parameterSequence.load();
+    gain.setValue(1.f);
+    EXPECT_GT(patch::parameterSequence.load(), before);
+    EXPECT_EQ(gain.getValue(), 1.f);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <PerformanceCounters.h>
+
+namespace
+{
+    juce::int64 microsToTicks(double micros)
+    {
+        return juce::Time::secondsToHighResolutionTicks(micros * 1.0e-6);
+    }
+}
+
+//==============================================================================
+
+TEST(PerformanceCountersTest, EmptyHistogram)
+{
+    patch::DurationHistogram histogram;
+    auto snapshot = histogram.getSnapshot();
+
+    EXPECT_EQ(snapshot.count, 0u);
+    EXPECT_DOUBLE_EQ(snapshot.getMeanSeconds(), 0.0);
+    EXPECT_DOUBLE_EQ(snapshot.getPercentileSeconds(0.5), 0.0);
+}
+
+TEST(PerformanceCountersTest, HistogramBuckets)
+{
+    patch::DurationHistogram histogram;
+    histogram.record(microsToTicks(0.5));
+    histogram.record(microsToTicks(1.5));
+    histogram.record(microsToTicks(3.0));
+    histogram.record(microsToTicks(100.0));
+
+    auto snapshot = histogram.getSnapshot();
+
+    EXPECT_EQ(snapshot.count, 4u);
+    EXPECT_EQ(snapshot.buckets[0], 1u);
+    EXPECT_EQ(snapshot.buckets[1], 1u);
+    EXPECT_EQ(snapshot.buckets[2], 1u);
+    EXPECT_EQ(snapshot.buckets[7], 1u);
+    EXPECT_NEAR(snapshot.maxSeconds, 100.0e-6, 1.0e-7);
+    EXPECT_NEAR(snapshot.lastSeconds, 100.0e-6, 1.0e-7);
+    EXPECT_NEAR(snapshot.getMeanSeconds(), 105.0e-6 / 4.0, 1.0e-7);
+    EXPECT_DOUBLE_EQ(snapshot.getPercentileSeconds(0.5), 2.0e-6);
+}
+
+TEST(PerformanceCountersTest, Reset)
+{
+    patch::DurationHistogram histogram;
+    histogram.record(microsToTicks(10.0));
+    histogram.reset();
+
+    auto snapshot = histogram.getSnapshot();
+    EXPECT_EQ(snapshot.count, 0u);
+    EXPECT_DOUBLE_EQ(snapshot.maxSeconds, 0.0);
+}
+
+TEST(PerformanceCountersTest, Counter)
+{
+    patch::Counter counter;
+    counter.add();
+    counter.add(41);
+    EXPECT_EQ(counter.get(), 42u);
+
+    counter.set(3);
+    EXPECT_EQ(counter.get(), 3u);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <RoutingGraph.h>
+#include <cstdlib>
+#include <map>
+
+TEST(RoutingGraphTest, Chain)
+{
+    patch::RoutingGraph graph;
+    graph.reset(3);
+    graph.addEdge(0, 1);
+    graph.addEdge(1, 2);
+    graph.findComponents();
+
+    EXPECT_EQ(graph.getNumberOfComponents(), 3u);
+    EXPECT_FALSE(graph.isOnLoop(0, 1));
+    EXPECT_FALSE(graph.isOnLoop(1, 2));
+}
+
+TEST(RoutingGraphTest, Loops)
+{
+    // 0 -> 1 -> 2 -> 0 and 3 <-> 4, with 2 -> 3 leading from one into the other
+    patch::RoutingGraph graph;
+    graph.reset(6);
+    graph.addEdge(0, 1);
+    graph.addEdge(1, 2);
+    graph.addEdge(2, 0);
+    graph.addEdge(2, 3);
+    graph.addEdge(3, 4);
+    graph.addEdge(4, 3);
+    graph.findComponents();
+
+    EXPECT_EQ(graph.getNumberOfComponents(), 3u);
+    EXPECT_TRUE(graph.isOnLoop(0, 1));
+    EXPECT_TRUE(graph.isOnLoop(2, 0));
+    EXPECT_TRUE(graph.isOnLoop(4, 3));
+    EXPECT_FALSE(graph.isOnLoop(2, 3));
+    EXPECT_NE(graph.getComponent(5), patch::RoutingGraph::invalid);
+    EXPECT_EQ(graph.getComponent(6), patch::RoutingGraph::invalid);
+}
+
+TEST(RoutingGraphTest, LongChainClosed)
+{
+    // deep enough to overflow a recursive implementation
+    const size_t numberOfNodes = 100000;
+    patch::RoutingGraph graph;
+    graph.reset(numberOfNodes);
+    for(size_t node = 0; node + 1 < numberOfNodes; node++)
+        graph.addEdge(node, node + 1);
+    graph.addEdge(numberOfNodes - 1, 0);
+    graph.findComponents();
+
+    EXPECT_EQ(graph.getNumberOfComponents(), 1u);
+    EXPECT_TRUE(graph.isOnLoop(numberOfNodes - 1, 0));
+}
+
+TEST(RoutingGraphTest, EditsKeepComponents)
+{
+    // every edit is checked against finding the components from scratch
+    const size_t numberOfNodes = 12;
+    patch::RoutingGraph graph, reference;
+    graph.resize(numberOfNodes);
+    std::vector<std::vector<bool>> edges(numberOfNodes, std::vector<bool>(numberOfNodes, false));
+    std::srand(49);
+
+    for(int edit = 0; edit < 2000; edit++)
+    {
+        const size_t from = (size_t)std::rand() % numberOfNodes;
+        const size_t to = (size_t)std::rand() % numberOfNodes;
+        if(edges[from][to])
+            graph.removeEdge(from, to);
+        else
+            graph.addEdge(from, to);
+        edges[from][to] = !edges[from][to];
+
+        reference.reset(numberOfNodes);
+        for(size_t a = 0; a < numberOfNodes; a++)
+            for(size_t b = 0; b < numberOfNodes; b++)
+                if(edges[a][b])
+                    reference.addEdge(a, b);
+        reference.findComponents();
+
+        ASSERT_EQ(graph.getNumberOfComponents(), reference.getNumberOfComponents()) << edit;
+        for(size_t a = 0; a < numberOfNodes; a++)
+            for(size_t b = 0; b < numberOfNodes; b++)
+                ASSERT_EQ(graph.getComponent(a) == graph.getComponent(b),
+                          reference.getComponent(a) == reference.getComponent(b)) << edit;
+    }
+}
+
+TEST(RoutingGraphTest, LoopGain)
+{
+    // 0 -> 1 -> 0, the geometric mean of its gains
+    patch::RoutingGraph graph;
+    graph.resize(4);
+    graph.setEdges({{ 0, 1, 2.f }, { 1, 0, 0.5f }});
+    EXPECT_NEAR(graph.getLoopGain(graph.getComponent(0)), 1.0, 1.0e-6);
+    EXPECT_EQ(graph.getLoopGain(graph.getComponent(2)), 0.0);
+
+    graph.setEdges({{ 0, 1, 2.f }, { 1, 0, 0.32f }});
+    EXPECT_NEAR(graph.getLoopGain(graph.getComponent(0)), 0.8, 1.0e-6);
+
+    // 0 -> 2 -> 0 shares 0 with the first loop, each of the two decays on
+    // its own, together they do not
+    graph.setEdges({{ 0, 1, 2.f }, { 1, 0, 0.32f }, { 0, 2, 1.f }, { 2, 0, 0.64f }});
+    EXPECT_EQ(graph.getNumberOfComponents(), 2u);
+    EXPECT_NEAR(graph.getLoopGain(graph.getComponent(0)), std::sqrt(0.64 + 0.64), 1.0e-6);
+
+    // taking the edge away splits the loops again
+    graph.setEdges({{ 0, 1, 2.f }, { 1, 0, 0.32f }, { 0, 2, 1.f }});
+    EXPECT_EQ(graph.getNumberOfComponents(), 3u);
+    EXPECT_FALSE(graph.isOnLoop(0, 2));
+    EXPECT_NEAR(graph.getLoopGain(graph.getComponent(0)), 0.8, 1.0e-6);
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <SharedRouting.h>
+#include <Core.h>
+#include <Instance.h>
+#include <chrono>
+#include <thread>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+    // a segment of its own for every test process
+    juce::String sharedRoutingTestName(const char* test)
+    {
+#if !defined(_WIN32)
+        return juce::String("patch-test-") + test + "-" + juce::String((int)::getpid());
+#else
+        return juce::String("patch-test-") + test;
+#endif
+    }
+
+    void writeConstant(patch::SharedRouting& sharedRouting, int slot, float value, size_t numberOfSamples)
+    {
+        std::vector<float> left(numberOfSamples, value), right(numberOfSamples, value);
+        const float* channels[] = { left.data(), right.data() };
+        sharedRouting.write(slot, channels, numberOfSamples);
+    }
+}
+
+//==============================================================================
+TEST(SharedRoutingTest, ReadsWhatWasWritten)
+{
+    const juce::String name = sharedRoutingTestName("ring");
+    auto writer = patch::SharedRouting::open(name);
+    if(writer == nullptr) GTEST_SKIP() << "no shared memory";
+    auto reader = patch::SharedRouting::open(name);
+    ASSERT_NE(reader, nullptr);
+
+    const juce::Uuid id;
+    const int slot = writer->publish(id, "Drums");
+    ASSERT_GE(slot, 0);
+    EXPECT_EQ(reader->findTransmitter(id), slot);
+    ASSERT_EQ(reader->getTransmitters().size(), 1u);
+    EXPECT_EQ(reader->getTransmitters()[0].name, juce::String("Drums"));
+    ASSERT_NE(reader->attach(slot, id), 0u);
+
+    // a reader starts two blocks behind the writer
+    for(int block = 0; block < 3; block++)
+        writeConstant(*writer, slot, (float)block, 64);
+
+    uint64_t readPosition = patch::SharedRouting::notStarted;
+    patch::SharedRouting::Pieces pieces;
+    ASSERT_EQ(reader->read(slot, readPosition, 64, pieces), 64u);
+    EXPECT_EQ(pieces.size[0] + pieces.size[1], 64u);
+    EXPECT_EQ(pieces.data[0][0][0], 1);
+    EXPECT_EQ(pieces.data[0][1][63], 1);
+    EXPECT_EQ(reader->read(slot, readPosition, 64, pieces), 64u);
+    EXPECT_EQ(pieces.data[0][0][0], 2);
+    EXPECT_EQ(reader->read(slot, readPosition, 64, pieces), 0u);
+
+    // around the end of the ring
+    for(size_t written = 192; written < patch::SharedRouting::ringSize - 64; written += 64)
+    {
+        writeConstant(*writer, slot, 3.f, 64);
+        reader->read(slot, readPosition, 64, pieces);
+    }
+    std::vector<float> left(96), right(96);
+    for(size_t i = 0; i < 96; i++)
+        left[i] = right[i] = (float)i;
+    const float* channels[] = { left.data(), right.data() };
+    writer->write(slot, channels, 96);
+    ASSERT_EQ(reader->read(slot, readPosition, 96, pieces), 96u);
+    ASSERT_EQ(pieces.size[0], 64u);
+    ASSERT_EQ(pieces.size[1], 32u);
+    EXPECT_EQ(pieces.data[0][1][63], 63);
+    EXPECT_EQ(pieces.data[1][1][0], 64);
+
+    writer->withdraw(slot);
+    EXPECT_EQ(reader->findTransmitter(id), -1);
+    EXPECT_FALSE(reader->holds(slot, id));
+    patch::SharedRouting::remove(name);
+}
+
+#if !defined(_WIN32)
+TEST(SharedRoutingTest, TwoProcesses)
+{
+    const juce::String name = sharedRoutingTestName("processes");
+    auto reader = patch::SharedRouting::open(name);
+    if(reader == nullptr) GTEST_SKIP() << "no shared memory";
+
+    const juce::Uuid id;
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if(child == 0)
+    {
+        // the transmitter, it exits without withdrawing like a crashed host
+        auto writer = patch::SharedRouting::open(name);
+        const int slot = writer != nullptr ? writer->publish(id, "Other process") : -1;
+        for(int block = 0; block < 2000 && slot >= 0; block++)
+        {
+            writeConstant(*writer, slot, 0.5f, 64);
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        std::_Exit(slot >= 0 ? 0 : 1);
+    }
+
+    int slot = -1;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(slot < 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        slot = reader->findTransmitter(id);
+        std::this_thread::yield();
+    }
+    ASSERT_GE(slot, 0);
+    EXPECT_FALSE(reader->getTransmitters()[0].isLocal);
+    ASSERT_NE(reader->attach(slot, id), 0u);
+
+    uint64_t readPosition = patch::SharedRouting::notStarted;
+    size_t recieved = 0;
+    bool isConstant = true;
+    while(recieved < 4096 && std::chrono::steady_clock::now() < deadline)
+    {
+        patch::SharedRouting::Pieces pieces;
+        const size_t available = reader->read(slot, readPosition, 64, pieces);
+        for(size_t piece = 0; piece < 2; piece++)
+            for(size_t i = 0; i < pieces.size[piece]; i++)
+                isConstant = isConstant && pieces.data[piece][0][i] == (patch::RoutingSample)0.5f;
+        recieved += available;
+    }
+    EXPECT_GE(recieved, 4096u);
+    EXPECT_TRUE(isConstant);
+
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // what a dead process left behind is not listed and gets taken over
+    EXPECT_TRUE(reader->getTransmitters().empty());
+    const juce::Uuid next;
+    EXPECT_EQ(reader->publish(next, "Next"), slot);
+    patch::SharedRouting::remove(name);
+}
+#endif
+
+TEST(SharedRoutingTest, WritesOnlyWhileAttached)
+{
+    const juce::String name = sharedRoutingTestName("attach");
+    auto writer = patch::SharedRouting::open(name);
+    if(writer == nullptr) GTEST_SKIP() << "no shared memory";
+    auto reader = patch::SharedRouting::open(name);
+    ASSERT_NE(reader, nullptr);
+
+    const juce::Uuid id;
+    const int slot = writer->publish(id, "Drums");
+    ASSERT_GE(slot, 0);
+    EXPECT_EQ(reader->attach(slot, juce::Uuid()), 0u);
+
+    const uint64_t attachment = reader->attach(slot, id);
+    ASSERT_NE(attachment, 0u);
+    EXPECT_TRUE(writer->isAttached(slot));
+    writeConstant(*writer, slot, 1.f, 64);
+
+    // written while nobody listened, a reader attaching later gets none of it
+    reader->detach(slot, attachment);
+    EXPECT_FALSE(writer->isAttached(slot));
+    for(int block = 0; block < 3; block++)
+        writeConstant(*writer, slot, 2.f, 64);
+
+    ASSERT_NE(reader->attach(slot, id), 0u);
+    uint64_t readPosition = patch::SharedRouting::notStarted;
+    patch::SharedRouting::Pieces pieces;
+    EXPECT_EQ(reader->read(slot, readPosition, 64, pieces), 0u);
+
+    writeConstant(*writer, slot, 3.f, 64);
+    readPosition = patch::SharedRouting::notStarted;
+    ASSERT_EQ(reader->read(slot, readPosition, 64, pieces), 64u);
+    EXPECT_EQ(pieces.data[0][0][0], 3);
+
+    // attachments end with the transmitter, the next one of the slot starts
+    // without readers
+    writer->withdraw(slot);
+    const juce::Uuid next;
+    ASSERT_EQ(writer->publish(next, "Bass"), slot);
+    EXPECT_FALSE(writer->isAttached(slot));
+    reader.reset();
+    EXPECT_FALSE(writer->isAttached(slot));
+    writer.reset();
+}
+
+#if !defined(_WIN32)
+TEST(SharedRoutingTest, LastUserRemovesTheSegment)
+{
+    const juce::String name = sharedRoutingTestName("remove");
+    const std::string segmentName = "/" + name.toStdString();
+    auto first = patch::SharedRouting::open(name);
+    if(first == nullptr) GTEST_SKIP() << "no shared memory";
+    auto second = patch::SharedRouting::open(name);
+    ASSERT_NE(second, nullptr);
+
+    const auto exists = [&segmentName]()
+    {
+        const int descriptor = ::shm_open(segmentName.c_str(), O_RDONLY, 0600);
+        if(descriptor < 0) return false;
+        ::close(descriptor);
+        return true;
+    };
+
+    first.reset();
+    EXPECT_TRUE(exists());
+    second.reset();
+    EXPECT_FALSE(exists());
+}
+#endif
+
+TEST(SharedRoutingTest, CoreRecievesFromOtherProcess)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    const juce::String name = sharedRoutingTestName("core");
+    if(!core->enableSharedRouting(name)) GTEST_SKIP() << "no shared memory";
+
+    // stands in for the Core of another process
+    auto other = patch::SharedRouting::open(name);
+    ASSERT_NE(other, nullptr);
+    const juce::Uuid remote;
+    const int slot = other->publish(remote, "Remote");
+    ASSERT_GE(slot, 0);
+
+    patch::Instance transmitter, reciever;
+    transmitter.prepareToPlay(48000, 64);
+    reciever.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    reciever.setMode(patch::Mode::recieve);
+
+    // local transmitters are published, remote ones are listed
+    EXPECT_GE(other->findTransmitter(transmitter.getId()), 0);
+    EXPECT_TRUE(core->isRemoteTransmitter(remote));
+    EXPECT_FALSE(core->isRemoteTransmitter(transmitter.getId()));
+    EXPECT_TRUE(core->getRemoteTransmitters().contains(remote));
+    EXPECT_FALSE(core->getRemoteTransmitters().contains(transmitter.getId()));
+
+    core->applyConnectionEdits({{ remote, reciever.getId(), true, 0.5f }});
+    ASSERT_NE(core->getConnectionParameters(remote, reciever.getId()), nullptr);
+    // the transmitter only writes its ring once the connection reads it
+    EXPECT_TRUE(other->isAttached(slot));
+    EXPECT_FALSE(other->isAttached(other->findTransmitter(transmitter.getId())));
+
+    juce::AudioBuffer<float> block(2, 64);
+    for(int i = 0; i < 8; i++)
+    {
+        writeConstant(*other, slot, 1.f, 64);
+        block.clear();
+        reciever.processBlock(block);
+    }
+    EXPECT_FLOAT_EQ(block.getSample(0, 0), 0.5f);
+    EXPECT_FLOAT_EQ(block.getSample(1, 63), 0.5f);
+
+    // connections to other processes are saved by the reciever
+    const patch::InstanceState state = reciever.getState();
+    ASSERT_EQ(state.connections.size(), 1u);
+    EXPECT_EQ(state.connections[0].peer, remote);
+
+    core->disableSharedRouting();
+    EXPECT_FALSE(other->isAttached(slot));
+    other->withdraw(slot);
+    EXPECT_FALSE(core->isRemoteTransmitter(remote));
+    patch::SharedRouting::remove(name);
+}
+
+TEST(SharedRoutingTest, CoreCountsUnsharedTransmitters)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    const juce::String name = sharedRoutingTestName("full");
+    if(!core->enableSharedRouting(name)) GTEST_SKIP() << "no shared memory";
+
+    // other processes took every slot
+    auto other = patch::SharedRouting::open(name);
+    ASSERT_NE(other, nullptr);
+    std::vector<int> slots;
+    for(size_t i = 0; i < patch::SharedRouting::maxTransmitters; i++)
+        slots.push_back(other->publish(juce::Uuid(), "Remote"));
+    EXPECT_EQ(other->publish(juce::Uuid(), "One too many"), -1);
+
+    patch::Instance transmitter;
+    transmitter.prepareToPlay(48000, 64);
+    transmitter.setMode(patch::Mode::transmit);
+    EXPECT_EQ(core->getNumberOfUnsharedTransmitters(), 1u);
+
+    // published once there is room again
+    other->withdraw(slots.back());
+    core->finishStateRestore();
+    EXPECT_EQ(core->getNumberOfUnsharedTransmitters(), 0u);
+    EXPECT_GE(other->findTransmitter(transmitter.getId()), 0);
+
+    core->disableSharedRouting();
+    EXPECT_EQ(core->getNumberOfUnsharedTransmitters(), 0u);
+}
+
+TEST(SharedRoutingTest, CoreCompensatesDrift)
+{
+    const auto core = patch::Core::getDomain(patch::Core::defaultDomain);
+    const juce::String name = sharedRoutingTestName("drift");
+    if(!core->enableSharedRouting(name)) GTEST_SKIP() << "no shared memory";
+
+    // the other process runs 0.1% fast, without compensation the reader
+    // would fall behind by more than the ring allows
+    auto other = patch::SharedRouting::open(name);
+    ASSERT_NE(other, nullptr);
+    const juce::Uuid remote;
+    const int slot = other->publish(remote, "Fast clock");
+    ASSERT_GE(slot, 0);
+
+    patch::Instance reciever;
+    reciever.prepareToPlay(48000, 64);
+    reciever.setMode(patch::Mode::recieve);
+    core->applyConnectionEdits({{ remote, reciever.getId(), true, 1.f }});
+
+    const auto before = core->getStatistics();
+    juce::AudioBuffer<float> block(2, 64);
+    double writtenExactly = 0.0;
+    size_t written = 0;
+    bool isContinuous = true;
+    for(int pass = 0; pass < 40000; pass++)
+    {
+        writtenExactly += 64 * 1.001;
+        writeConstant(*other, slot, 1.f, (size_t)writtenExactly - written);
+        written = (size_t)writtenExactly;
+
+        block.clear();
+        reciever.processBlock(block);
+        if(pass > 8)
+            for(int i = 0; i < 64; i++)
+                isContinuous = isContinuous && block.getSample(0, i) == 1.f;
+    }
+
+    const auto after = core->getStatistics();
+    EXPECT_EQ(after.underruns - before.underruns, 0u);
+    EXPECT_EQ(after.overruns - before.overruns, 0u);
+    EXPECT_TRUE(isContinuous);
+
+    other->withdraw(slot);
+    core->disableSharedRouting();
+    patch::SharedRouting::remove(name);
+}
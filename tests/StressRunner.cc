@@ -0,0 +1,15 @@
+/*  Runner of the concurrency stress tests. They take seconds and are meant to
+    run in the sanitizer builds (the "config tsan" and "config asan" presets),
+    so they are kept apart from the unit tests in TestRunner.cc.
+    PATCH_STRESS_SECONDS sets how long each test runs, with
+    PATCH_STRESS_MAX_STALL_MS the longest processBlock fails the test.
+*/
+
+#include <gtest/gtest.h>
+
+#include "ConcurrencyStressTest.h"
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -15,6 +15,16 @@
 // include headers containing the unit tests here
 #include "HelloTest.h"
 #include "CircularTest.h"
+#include "PerformanceCountersTest.h"
+#include "TracerTest.h"
+#include "MixKernelsTest.h"
+#include "ParameterStoreTest.h"
+#include "InstanceStateTest.h"
+#include "CoreTest.h"
+#include "RoutingGraphTest.h"
+#include "SharedRoutingTest.h"
+#include "DriftCompensatorTest.h"
+#include "GoldenRoutingTest.h"
 
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
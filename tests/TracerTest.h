@@ -0,0 +1,122 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <Tracer.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using TraceBuffer = patch::Tracer::ThreadBuffer;
+
+    std::vector<juce::int64> consumeTicks(TraceBuffer& buffer)
+    {
+        std::vector<juce::int64> ticks;
+        buffer.consume([&ticks](const patch::Tracer::Event& event) { ticks.push_back(event.ticks); });
+        return ticks;
+    }
+}
+
+//==============================================================================
+
+TEST(TracerTest, RingKeepsOrder)
+{
+    auto buffer = std::make_unique<TraceBuffer>();
+    for(juce::int64 i = 0; i < 3; i++)
+        EXPECT_TRUE(buffer->push({ "event", i, 0, 'B' }));
+
+    EXPECT_EQ(consumeTicks(*buffer), (std::vector<juce::int64>{ 0, 1, 2 }));
+    EXPECT_TRUE(consumeTicks(*buffer).empty());
+}
+
+TEST(TracerTest, RingWrapsAround)
+{
+    auto buffer = std::make_unique<TraceBuffer>();
+    for(size_t i = 0; i < TraceBuffer::capacity - 1; i++)
+        buffer->push({ "event", 0, 0, 'B' });
+    consumeTicks(*buffer);
+
+    // the indices keep counting, the slots start over
+    for(juce::int64 i = 0; i < (juce::int64)TraceBuffer::capacity; i++)
+        EXPECT_TRUE(buffer->push({ "event", i, 0, 'B' }));
+
+    const auto ticks = consumeTicks(*buffer);
+    ASSERT_EQ(ticks.size(), TraceBuffer::capacity);
+    for(size_t i = 0; i < ticks.size(); i++)
+        EXPECT_EQ(ticks[i], (juce::int64)i);
+}
+
+TEST(TracerTest, FullRingDrops)
+{
+    auto buffer = std::make_unique<TraceBuffer>();
+    for(juce::int64 i = 0; i < (juce::int64)TraceBuffer::capacity; i++)
+        EXPECT_TRUE(buffer->push({ "event", i, 0, 'B' }));
+
+    // what the writer did not get to yet is kept, the new event is dropped
+    EXPECT_FALSE(buffer->push({ "dropped", -1, 0, 'B' }));
+    const auto ticks = consumeTicks(*buffer);
+    ASSERT_EQ(ticks.size(), TraceBuffer::capacity);
+    EXPECT_EQ(ticks.back(), (juce::int64)TraceBuffer::capacity - 1);
+
+    EXPECT_TRUE(buffer->push({ "event", 0, 0, 'B' }));
+}
+
+TEST(TracerTest, WritesChromeTrace)
+{
+    auto* tracer = patch::Tracer::getInstance();
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                          .getChildFile("patch-tracer-test.json");
+    const juce::Uuid id;
+    const juce::uint64 droppedBefore = tracer->getNumberOfDroppedEvents();
+
+    ASSERT_TRUE(tracer->start(file));
+    EXPECT_FALSE(tracer->start(file));
+    {
+        patch::ScopedTraceEvent event("TracerTest", id);
+    }
+    // a thread of its own gets a buffer of its own
+    std::thread([]() { patch::ScopedTraceEvent event("TracerTest::thread"); }).join();
+    tracer->stop();
+
+    EXPECT_FALSE(patch::Tracer::isRecording());
+    EXPECT_EQ(tracer->getNumberOfDroppedEvents(), droppedBefore);
+
+    const juce::String json = file.loadFileAsString();
+    EXPECT_TRUE(json.startsWith("[\n"));
+    EXPECT_TRUE(json.endsWith("\n]\n"));
+    EXPECT_TRUE(json.contains("{\"name\":\"TracerTest\",\"cat\":\"patch\",\"ph\":\"B\""));
+    EXPECT_TRUE(json.contains("{\"name\":\"TracerTest\",\"cat\":\"patch\",\"ph\":\"E\""));
+    EXPECT_TRUE(json.contains("{\"name\":\"TracerTest::thread\",\"cat\":\"patch\",\"ph\":\"B\""));
+    EXPECT_TRUE(json.contains("\"args\":{\"id\":\""
+                              + juce::String::toHexString((juce::int64)patch::Tracer::idOf(id))
+                                    .paddedLeft('0', 16)
+                              + "\"}"));
+    file.deleteFile();
+}
+
+TEST(TracerTest, ThreadsGiveTheirBuffersBack)
+{
+    // hosts start and stop worker threads all the time, far more of them than
+    // there are buffers over a session
+    auto* tracer = patch::Tracer::getInstance();
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                          .getChildFile("patch-tracer-threads-test.json");
+    const juce::uint64 droppedBefore = tracer->getNumberOfDroppedEvents();
+    constexpr int numberOfThreads = 3 * patch::Tracer::maxNumberOfThreads;
+
+    ASSERT_TRUE(tracer->start(file));
+    for(int thread = 0; thread < numberOfThreads; thread++)
+        std::thread([]() { patch::ScopedTraceEvent event("TracerTest::churn"); }).join();
+    tracer->stop();
+
+    EXPECT_EQ(tracer->getNumberOfDroppedEvents(), droppedBefore);
+
+    const juce::String json = file.loadFileAsString();
+    int events = 0;
+    for(int index = json.indexOf("TracerTest::churn"); index >= 0;
+        index = json.indexOf(index + 1, "TracerTest::churn"))
+        events++;
+    EXPECT_EQ(events, 2 * numberOfThreads);
+    file.deleteFile();
+}